@@ -8,4 +8,6 @@ public final class ErrorCode {
    public static final int ERR_EXIT_USER = 3;
    public static final int ERR_NOT_EXISTS = 4;
    public static final int ERR_UNKNOWN = 5;
+   public static final int ERR_BUSY = 6;
+   public static final int ERR_CANCELLED = 7;
 }
\ No newline at end of file
@@ -35,5 +35,7 @@ LOCAL_SRC_FILES :=        \
     SaceTypes.cpp         \
     SaceServiceInfo.cpp   \
     SaceParams.cpp        \
+    SaceStream.cpp        \
+    SaceRing.cpp          \
 
 include $(BUILD_SHARED_LIBRARY)
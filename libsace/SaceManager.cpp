@@ -20,7 +20,9 @@
 #include "sace/SaceManager.h"
 #include <sace/SaceServiceInfo.h>
 
+#ifndef SACE_SENDER
 #define SACE_SENDER SACE_SENDER_SOCKEET
+#endif
 
 namespace android {
 
@@ -29,6 +31,8 @@ static sp<SaceSender> createSaceSender () {
     return new SaceSocketSender("sace_socket", SOCK_STREAM);
 #elif SACE_SENDER == SACE_SENDER_BINDER
     return new SaceBinderSender();
+#elif SACE_SENDER == SACE_SENDER_SHM
+    return new SaceShmSender();
 #else
     return new SaceSocketSender("sace_socket", SOCK_STREAM);
 #endif
@@ -90,10 +94,7 @@ SaceManager* SaceManager::getInstance () {
     return mInstance;
 }
 
-sp<SaceCommandObj> SaceManager::runCommand (const char* cmd, shared_ptr<SaceCommandParams> param, bool in) {
-    sp<SaceCommandObj> cmdObj = nullptr;
-    ErrorCode errCode = ERR_UNKNOWN;
-
+sp<SaceCommandObj> SaceManager::runCommand (const char* cmd, shared_ptr<SaceCommandParams> param, bool in, int timeout_ms) {
     SaceCommand mCmd;
     mCmd.init();
     mCmd.type = SACE_TYPE_NORMAL;
@@ -107,10 +108,60 @@ sp<SaceCommandObj> SaceManager::runCommand (const char* cmd, shared_ptr<SaceComm
         mCmd.command_params = cmd_param;
 
     SACE_LOGI("runCommand cmd=%s, sequence=%d, in=%d", cmd, mCmd.sequence, in);
-    SaceResult mRlt = mSender->excuteCommand(mCmd);
+    SaceResult mRlt = excute(mCmd, timeout_ms);
+    return commandByResult(mCmd, mRlt, in);
+}
+
+sp<SaceCommandObj> SaceManager::runCommand (const vector<string> &argv, shared_ptr<SaceCommandParams> param, bool in, int timeout_ms) {
+    SaceCommand mCmd;
+    mCmd.init();
+    mCmd.type = SACE_TYPE_NORMAL;
+    mCmd.normalCmdType = SACE_NORMAL_CMD_START;
+    mCmd.flags = in? SACE_CMD_FLAG_IN : SACE_CMD_FLAG_OUT;
+    mCmd.command_params = param? param : cmd_param;
+    mCmd.argv = argv;
+
+    for (const string &arg : argv)
+        mCmd.command.append(mCmd.command.empty()? "" : " ").append(arg);
+
+    if (argv.empty() || argv[0].empty()) {
+        SACE_LOGE("runCommand empty argv, sequence=%d", mCmd.sequence);
+        return new SaceCommandObj(ERR_UNKNOWN, mCmd.command, SEQUENCE_TO_LABEL(mCmd.sequence, 0));
+    }
+
+    SACE_LOGI("runCommand argv=%s, sequence=%d, in=%d", mCmd.command.c_str(), mCmd.sequence, in);
+    SaceResult mRlt = excute(mCmd, timeout_ms);
+    return commandByResult(mCmd, mRlt, in);
+}
+
+sp<SaceCommandObj> SaceManager::runScript (const char* name, const string &body, shared_ptr<SaceCommandParams> param, bool in, int timeout_ms) {
+    SaceCommand mCmd;
+    mCmd.init();
+    mCmd.type = SACE_TYPE_NORMAL;
+    mCmd.normalCmdType = SACE_NORMAL_CMD_START;
+    mCmd.command.assign(name);
+    mCmd.flags = in? SACE_CMD_FLAG_IN : SACE_CMD_FLAG_OUT;
+    mCmd.command_params = param? param : cmd_param;
+
+    int fd = SaceCommand::createScript(body);
+    if (fd < 0) {
+        SACE_LOGE("runScript name=%s create script errno=%d errstr=%s", name, errno, strerror(errno));
+        return new SaceCommandObj(ERR_UNKNOWN, mCmd.command, SEQUENCE_TO_LABEL(mCmd.sequence, 0));
+    }
+    mCmd.script = make_shared<SaceFd>(fd);
+
+    SACE_LOGI("runScript name=%s, size=%d, sequence=%d, in=%d", name, (uint32_t)body.size(), mCmd.sequence, in);
+    SaceResult mRlt = excute(mCmd, timeout_ms);
+    return commandByResult(mCmd, mRlt, in);
+}
+
+sp<SaceCommandObj> SaceManager::commandByResult (const SaceCommand &mCmd, const SaceResult &mRlt, bool in) {
+    sp<SaceCommandObj> cmdObj = nullptr;
+    ErrorCode errCode = ERR_UNKNOWN;
+
     if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
         if (mRlt.resultType == SACE_RESULT_TYPE_FD) {
-            cmdObj = new SaceCommandObj(mSender, mRlt.label, string(cmd), mRlt.resultFd, in, mCmdCallback);
+            cmdObj = new SaceCommandObj(mSender, mRlt.label, mCmd.command, mRlt.resultFd, in, mCmdCallback);
 
             AutoMutex _lock(mMutex);
             mCommands.insert(pair<uint64_t, sp<SaceCommandObj>>(mRlt.label, cmdObj));
@@ -124,15 +175,12 @@ sp<SaceCommandObj> SaceManager::runCommand (const char* cmd, shared_ptr<SaceComm
     }
 
     if (!cmdObj)
-        cmdObj = new SaceCommandObj(errCode, string(cmd), SEQUENCE_TO_LABEL(mCmd.sequence, 0));
+        cmdObj = new SaceCommandObj(mSender, errCode, mCmd.command, SEQUENCE_TO_LABEL(mCmd.sequence, 0), mCmdCallback);
 
     return cmdObj;
 }
 
 sp<SaceServiceObj> SaceManager::queryService (const char* name) {
-    sp<SaceServiceObj> serviceObj = nullptr;
-    ErrorCode errCode = ERR_UNKNOWN;
-
     SaceCommand mCmd;
     mCmd.init();
     mCmd.type = SACE_TYPE_SERVICE;
@@ -143,31 +191,11 @@ sp<SaceServiceObj> SaceManager::queryService (const char* name) {
 
     /* query normal service */
     SACE_LOGI("queryService name=%s, sequence=%d", name, mCmd.sequence);
-    SaceResult mRlt = mSender->excuteCommand(mCmd);
-    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
-        if (mRlt.resultType == SACE_RESULT_TYPE_EXTRA) {
-            SaceServiceInfo::ServiceInfo info;
-            memcpy(&info, mRlt.resultExtra, mRlt.resultExtraLen);
-            serviceObj = new SaceServiceObj(mSender, info.label, info.name, info.cmd, mCmdCallback);
-        }
-        else
-            SACE_LOGW("finish queryService with invalid extra %s", mCmd.to_string().c_str());
-    }
-    else {
-        errCode = result_to_error(mRlt.resultStatus);
-        SACE_LOGE("error queryService %s", mCmd.to_string().c_str());
-    }
-
-    if (!serviceObj)
-        serviceObj = new SaceServiceObj(errCode, string(name), string(name), SEQUENCE_TO_LABEL(mCmd.sequence, 0));
-
-    return serviceObj;
+    SaceResult mRlt = excute(mCmd);
+    return serviceByInfo(mCmd, mRlt);
 }
 
 sp<SaceServiceObj> SaceManager::queryEventService (const char* name) {
-    sp<SaceServiceObj> serviceObj = nullptr;
-    ErrorCode errCode = ERR_UNKNOWN;
-
     SaceCommand mCmd;
     mCmd.init();
     mCmd.type = SACE_TYPE_EVENT;
@@ -177,7 +205,15 @@ sp<SaceServiceObj> SaceManager::queryEventService (const char* name) {
     mCmd.name.assign(name);
 
     SACE_LOGI("queryEventService name=%s, sequence=%d", name, mCmd.sequence);
-    SaceResult mRlt = mSender->excuteCommand(mCmd);
+    SaceResult mRlt = excute(mCmd);
+    return serviceByInfo(mCmd, mRlt);
+}
+
+/* result of a SACE_SERVICE_CMD_INFO/SACE_EVENT_TYPE_INFO query */
+sp<SaceServiceObj> SaceManager::serviceByInfo (const SaceCommand &mCmd, const SaceResult &mRlt) {
+    sp<SaceServiceObj> serviceObj = nullptr;
+    ErrorCode errCode = ERR_UNKNOWN;
+
     if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
         if (mRlt.resultType == SACE_RESULT_TYPE_EXTRA) {
             SaceServiceInfo::ServiceInfo info;
@@ -185,20 +221,20 @@ sp<SaceServiceObj> SaceManager::queryEventService (const char* name) {
             serviceObj = new SaceServiceObj(mSender, info.label, info.name, info.cmd, mCmdCallback);
         }
         else
-            SACE_LOGW("finish queryEventService with invalid extra %s", mCmd.to_string().c_str());
+            SACE_LOGW("finish query service with invalid extra %s", mCmd.to_string().c_str());
     }
     else {
         errCode = result_to_error(mRlt.resultStatus);
-        SACE_LOGE("error queryEventService %s", mCmd.to_string().c_str());
+        SACE_LOGE("error query service %s", mCmd.to_string().c_str());
     }
 
     if (!serviceObj)
-        serviceObj = new SaceServiceObj(errCode, string(name), string(name), SEQUENCE_TO_LABEL(mCmd.sequence, 0));
+        serviceObj = new SaceServiceObj(errCode, mCmd.name, mCmd.name, SEQUENCE_TO_LABEL(mCmd.sequence, 0));
 
     return serviceObj;
 }
 
-sp<SaceServiceObj> SaceManager::checkService (const char *name, const char *cmd, shared_ptr<SaceCommandParams> param) {
+sp<SaceServiceObj> SaceManager::checkService (const char *name, const char *cmd, shared_ptr<SaceCommandParams> param, int timeout_ms) {
     sp<SaceServiceObj> sve = nullptr;
     ErrorCode errCode = ERR_UNKNOWN;
 
@@ -226,7 +262,7 @@ sp<SaceServiceObj> SaceManager::checkService (const char *name, const char *cmd,
         mCmd.command_params = service_param;
 
     SACE_LOGI("checkService name=%s, cmd=%s, sequence=%d", name, cmd, mCmd.sequence);
-    SaceResult mRlt = mSender->excuteCommand(mCmd);
+    SaceResult mRlt = excute(mCmd, timeout_ms);
     if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
         sve = new SaceServiceObj(mSender, mRlt.label, string(name), string(cmd), mCmdCallback);
 
@@ -240,7 +276,7 @@ sp<SaceServiceObj> SaceManager::checkService (const char *name, const char *cmd,
     }
 
     if (!sve)
-        sve = new SaceServiceObj(errCode, string(name), string(cmd), SEQUENCE_TO_LABEL(mCmd.sequence, 0));
+        sve = new SaceServiceObj(mSender, errCode, string(name), string(cmd), SEQUENCE_TO_LABEL(mCmd.sequence, 0), mCmdCallback);
 
     return sve;
 }
@@ -260,7 +296,7 @@ int SaceManager::addEvent (const char* name, const char* cmd, shared_ptr<SaceEve
         mCmd.command_params = static_pointer_cast<SaceCommandParams>(param);
 
     SACE_LOGI("addEvent name=%s, cmd=%s", name, cmd);
-    SaceResult mRlt = mSender->excuteCommand(mCmd);
+    SaceResult mRlt = excute(mCmd);
     return mRlt.resultStatus == SACE_RESULT_STATUS_OK;
 }
 
@@ -275,10 +311,231 @@ int SaceManager::deleteEvent (const char* name, bool __unused stop) {
     mCmd.extraLen = sizeof(bool);
 
     SACE_LOGI("deleteEvent name=%s", name);
-    SaceResult mRlt = mSender->excuteCommand(mCmd);
+    SaceResult mRlt = excute(mCmd);
     return mRlt.resultStatus == SACE_RESULT_STATUS_OK;
 }
 
+// ----------------------------------------------------------------
+SaceResult SaceManager::excute (SaceCommand &cmd, int timeout_ms) {
+    cmd.setTimeout(timeout_ms);
+    return mSender->excuteCommand(cmd);
+}
+
+vector<SaceResult> SaceManager::excuteBatch (const vector<SaceCommand> &cmds, int timeout_ms) {
+    vector<SaceResult> results;
+
+    for (size_t start = 0; start < cmds.size(); start += SACE_MAX_BATCH_COMMANDS) {
+        size_t count = min(cmds.size() - start, (size_t)SACE_MAX_BATCH_COMMANDS);
+
+        SaceCommand mCmd;
+        mCmd.init();
+        mCmd.type = SACE_TYPE_BATCH;
+        mCmd.batch.assign(cmds.begin() + start, cmds.begin() + start + count);
+
+        SACE_LOGI("excuteBatch count=%d, sequence=%d", (int)count, mCmd.sequence);
+        SaceResult mRlt = excute(mCmd, timeout_ms);
+        if (mRlt.resultType == SACE_RESULT_TYPE_BATCH && mRlt.results.size() == count) {
+            results.insert(results.end(), mRlt.results.begin(), mRlt.results.end());
+            continue;
+        }
+
+        SACE_LOGE("error excuteBatch %s", mRlt.to_string().c_str());
+        for (size_t i = start; i < start + count; i++) {
+            SaceResult rslt;
+            rslt.sequence = cmds[i].sequence;
+            rslt.name = cmds[i].name;
+            rslt.resultStatus = mRlt.resultStatus == SACE_RESULT_STATUS_OK? SACE_RESULT_STATUS_FAIL : mRlt.resultStatus;
+            rslt.resultFd = -1;
+            results.push_back(rslt);
+        }
+    }
+
+    return results;
+}
+
+vector<sp<SaceCommandObj>> SaceManager::runCommands (const vector<string> &cmds, shared_ptr<SaceCommandParams> param, bool in, int timeout_ms) {
+    vector<SaceCommand> saceCmds(cmds.size());
+
+    for (size_t i = 0; i < cmds.size(); i++) {
+        SaceCommand &mCmd = saceCmds[i];
+        mCmd.type = SACE_TYPE_NORMAL;
+        mCmd.normalCmdType = SACE_NORMAL_CMD_START;
+        mCmd.command.assign(cmds[i]);
+        mCmd.flags = in? SACE_CMD_FLAG_IN : SACE_CMD_FLAG_OUT;
+        mCmd.command_params = param? param : cmd_param;
+    }
+
+    SACE_LOGI("runCommands count=%d, in=%d", (int)cmds.size(), in);
+    vector<SaceResult> results = excuteBatch(saceCmds, timeout_ms);
+
+    vector<sp<SaceCommandObj>> cmdObjs;
+    for (size_t i = 0; i < saceCmds.size(); i++)
+        cmdObjs.push_back(commandByResult(saceCmds[i], results[i], in));
+
+    return cmdObjs;
+}
+
+vector<sp<SaceServiceObj>> SaceManager::checkServices (const vector<pair<string, string>> &services, shared_ptr<SaceCommandParams> param, int timeout_ms) {
+    vector<sp<SaceServiceObj>> sves(services.size());
+    vector<SaceCommand> queryCmds(services.size() * 2);
+
+    /* query normal and event services first, as checkService */
+    for (size_t i = 0; i < services.size(); i++) {
+        SaceCommand &sveCmd = queryCmds[i * 2];
+        sveCmd.type = SACE_TYPE_SERVICE;
+        sveCmd.serviceCmdType = SACE_SERVICE_CMD_INFO;
+        sveCmd.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
+        sveCmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
+        sveCmd.name.assign(services[i].first);
+
+        SaceCommand &eventCmd = queryCmds[i * 2 + 1];
+        eventCmd.type = SACE_TYPE_EVENT;
+        eventCmd.eventType  = SACE_EVENT_TYPE_INFO;
+        eventCmd.eventFlags = SACE_EVENT_FLAG_NONE;
+        eventCmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
+        eventCmd.name.assign(services[i].first);
+    }
+
+    SACE_LOGI("checkServices count=%d", (int)services.size());
+    vector<SaceResult> results = excuteBatch(queryCmds, timeout_ms);
+
+    vector<SaceCommand> startCmds;
+    vector<size_t> startIndex;
+    for (size_t i = 0; i < services.size(); i++) {
+        sp<SaceServiceObj> sve;
+        if ((sve = serviceByInfo(queryCmds[i * 2], results[i * 2]))->getError() == ERR_OK ||
+            (sve = serviceByInfo(queryCmds[i * 2 + 1], results[i * 2 + 1]))->getError() == ERR_OK) {
+            AutoMutex _lock(mMutex);
+            mServices.insert(pair<uint64_t, sp<SaceServiceObj>>(sve->label, sve));
+            sves[i] = sve;
+            continue;
+        }
+
+        if (services[i].second.empty()) {
+            sves[i] = new SaceServiceObj(ERR_NOT_EXISTS, services[i].first, services[i].second, SEQUENCE_TO_LABEL(0, 0));
+            continue;
+        }
+
+        SaceCommand mCmd;
+        mCmd.type = SACE_TYPE_SERVICE;
+        mCmd.serviceCmdType = SACE_SERVICE_CMD_START;
+        mCmd.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
+        mCmd.name.assign(services[i].first);
+        mCmd.command.assign(services[i].second);
+        mCmd.command_params = param? param : service_param;
+
+        startCmds.push_back(mCmd);
+        startIndex.push_back(i);
+    }
+
+    if (startCmds.empty())
+        return sves;
+
+    results = excuteBatch(startCmds, timeout_ms);
+    for (size_t i = 0; i < startCmds.size(); i++) {
+        const SaceCommand &mCmd = startCmds[i];
+        const SaceResult  &mRlt = results[i];
+
+        if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
+            sp<SaceServiceObj> sve = new SaceServiceObj(mSender, mRlt.label, mCmd.name, mCmd.command, mCmdCallback);
+
+            AutoMutex _lock(mMutex);
+            mServices.insert(pair<uint64_t, sp<SaceServiceObj>>(mRlt.label, sve));
+            sves[startIndex[i]] = sve;
+        }
+        else {
+            SACE_LOGE("error checkServices %s", mCmd.to_string().c_str());
+            sves[startIndex[i]] = new SaceServiceObj(mSender, result_to_error(mRlt.resultStatus), mCmd.name, mCmd.command,
+                SEQUENCE_TO_LABEL(mCmd.sequence, 0), mCmdCallback);
+        }
+    }
+
+    return sves;
+}
+
+vector<bool> SaceManager::stopServices (const vector<sp<SaceServiceObj>> &services) {
+    vector<bool> stopped(services.size(), false);
+    vector<SaceCommand> saceCmds;
+    vector<size_t> cmdIndex;
+
+    /* services that can't be stopped are reported false instead of throwing */
+    for (size_t i = 0; i < services.size(); i++) {
+        sp<SaceServiceObj> sve = services[i];
+        if (sve == nullptr || sve->getError() != ERR_OK || !sve->label) {
+            SACE_LOGE("stopServices skip service %s", sve == nullptr? "null" : sve->getName().c_str());
+            continue;
+        }
+
+        SaceCommand mCmd;
+        mCmd.label = sve->label;
+        mCmd.sequence = LABEL_TO_SEQUENCE(sve->label);
+        mCmd.type  = SACE_TYPE_SERVICE;
+        mCmd.serviceCmdType = SACE_SERVICE_CMD_STOP;
+
+        saceCmds.push_back(mCmd);
+        cmdIndex.push_back(i);
+    }
+
+    SACE_LOGI("stopServices count=%d", (int)saceCmds.size());
+    vector<SaceResult> results = excuteBatch(saceCmds);
+    for (size_t i = 0; i < saceCmds.size(); i++) {
+        sp<SaceServiceObj> sve = services[cmdIndex[i]];
+        sve->setError(result_to_error(results[i].resultStatus));
+        stopped[cmdIndex[i]] = results[i].resultStatus == SACE_RESULT_STATUS_OK;
+
+        AutoMutex _lock(mMutex);
+        mServices.erase(sve->label);
+    }
+
+    return stopped;
+}
+
+vector<int> SaceManager::addEvents (const vector<pair<string, string>> &events, shared_ptr<SaceEventParams> param) {
+    vector<SaceCommand> saceCmds(events.size());
+
+    for (size_t i = 0; i < events.size(); i++) {
+        SaceCommand &mCmd = saceCmds[i];
+        mCmd.type = SACE_TYPE_EVENT;
+        mCmd.eventType  = SACE_EVENT_TYPE_ADD;
+        mCmd.eventFlags = SACE_EVENT_FLAG_NONE;
+        mCmd.name.assign(events[i].first);
+        mCmd.command.assign(events[i].second);
+        mCmd.command_params = static_pointer_cast<SaceCommandParams>(param? param : event_param);
+    }
+
+    SACE_LOGI("addEvents count=%d", (int)events.size());
+    vector<SaceResult> results = excuteBatch(saceCmds);
+
+    vector<int> added;
+    for (auto &rslt : results)
+        added.push_back(rslt.resultStatus == SACE_RESULT_STATUS_OK);
+
+    return added;
+}
+
+vector<int> SaceManager::deleteEvents (const vector<string> &names, bool stop) {
+    vector<SaceCommand> saceCmds(names.size());
+
+    for (size_t i = 0; i < names.size(); i++) {
+        SaceCommand &mCmd = saceCmds[i];
+        mCmd.type = SACE_TYPE_EVENT;
+        mCmd.eventType = SACE_EVENT_TYPE_DEL;
+        mCmd.name.assign(names[i]);
+
+        memcpy(mCmd.extra, &stop, sizeof(bool));
+        mCmd.extraLen = sizeof(bool);
+    }
+
+    SACE_LOGI("deleteEvents count=%d", (int)names.size());
+    vector<SaceResult> results = excuteBatch(saceCmds);
+
+    vector<int> deleted;
+    for (auto &rslt : results)
+        deleted.push_back(rslt.resultStatus == SACE_RESULT_STATUS_OK);
+
+    return deleted;
+}
+
 void SaceManager::onResponse (const SaceStatusResponse &response) {
     uint64_t label = response.label;
 
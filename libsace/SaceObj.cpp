@@ -40,6 +40,10 @@ enum ErrorCode result_to_error (SaceResultStatus status) {
             return ERR_OK;
         case SACE_RESULT_STATUS_TIMEOUT:
             return ERR_TIMEOUT;
+        case SACE_RESULT_STATUS_BUSY:
+            return ERR_BUSY;
+        case SACE_RESULT_STATUS_CANCELLED:
+            return ERR_CANCELLED;
         case SACE_RESULT_STATUS_FAIL:
         case SACE_RESULT_STATUS_SECURE:
         return ERR_EXIT_USER;
@@ -119,6 +123,35 @@ void SaceCommandObj::close () {
         mCmdCallback(SACE_TYPE_NORMAL, label);
 }
 
+bool SaceCommandObj::cancel () {
+    /* label keeps the sequence even when the start failed or timed out */
+    if (!connected() || !label || getError() == ERR_CANCELLED)
+        return false;
+
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    SaceCommand command;
+    command.label = label;
+    command.type  = SACE_TYPE_NORMAL;
+    command.normalCmdType = SACE_NORMAL_CMD_CANCEL;
+    command.command.assign(cmd);
+    SaceResult result = excute(command);
+
+    if (result.resultStatus != SACE_RESULT_STATUS_OK) {
+        SACE_LOGE("cancel %s fail", cmd.c_str());
+        return false;
+    }
+
+    setError(ERR_CANCELLED);
+    if (mCmdCallback)
+        mCmdCallback(SACE_TYPE_NORMAL, label);
+
+    return true;
+}
+
 // -------------------------------------------------
 bool SaceServiceObj::stop () {
     enum ErrorCode code = getError();
@@ -216,6 +249,28 @@ bool SaceServiceObj::restart () {
     return mRlt.resultStatus == SACE_RESULT_STATUS_OK;
 }
 
+bool SaceServiceObj::cancel () {
+    if (!connected() || !label || getError() == ERR_CANCELLED)
+        return false;
+
+    mCmd.init();
+    mCmd.label = label;
+    mCmd.type  = SACE_TYPE_SERVICE;
+    mCmd.serviceCmdType = SACE_SERVICE_CMD_CANCEL;
+
+    mRlt = excute(mCmd);
+    if (mRlt.resultStatus != SACE_RESULT_STATUS_OK) {
+        SACE_LOGE("cancel service %s fail", name.c_str());
+        return false;
+    }
+
+    setError(ERR_CANCELLED);
+    if (mCmdCallback)
+        mCmdCallback(SACE_TYPE_SERVICE, label);
+
+    return true;
+}
+
 enum SaceServiceInfo::ServiceState SaceServiceObj::getState() {
     if (getError() == ERR_EXIT)
         throw RemoteException(name + " Exit Abnormally");
@@ -15,8 +15,11 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
 #include <pwd.h>
+#include <unordered_map>
 #include <cutils/properties.h>
+#include <utils/Mutex.h>
 
 #include "sace/SaceParams.h"
 #include "sace/SaceLog.h"
@@ -52,55 +55,151 @@ string BootTrigger::to_string () const  {
 }
 
 // ------------ SaceCommandParams ------------------
+const size_t SaceCommandParams::MAX_CACHED_PARAMS = 64;
+
+static Mutex params_lock;
+static unordered_map<string, sp<CommandParams>> params_cache;
+
+/* numeric ids go as uint32, names as strings for saced to look up */
+void SaceCommandParams::writeId (Parcel* parcel, const string &id) {
+    char *end = nullptr;
+    unsigned long value = id.empty()? 0 : strtoul(id.c_str(), &end, 10);
+
+    if (!id.empty() && isdigit(id[0]) && *end == '\0' && value <= UINT32_MAX) {
+        parcel->writeBool(false);
+        parcel->writeUint32(static_cast<uint32_t>(value));
+    }
+    else {
+        parcel->writeBool(true);
+        parcel->writeUtf8AsUtf16(id);
+    }
+}
+
+status_t SaceCommandParams::readId (const Parcel* parcel, string *id) {
+    if (parcel->readBool())
+        return parcel->readUtf8FromUtf16(id);
+
+    *id = ::to_string(parcel->readUint32());
+    return OK;
+}
+
 status_t SaceCommandParams::writeToParcel (Parcel* parcel) const {
     status_t status = OK;
 
-    status |= parcel->writeUtf8AsUtf16(uid);
-    status |= parcel->writeUtf8AsUtf16(gid);
-    status |= parcel->writeUtf8VectorAsUtf16Vector(supp_gids);
+    writeId(parcel, uid);
+    writeId(parcel, gid);
+    status |= parcel->writeUint32(supp_gids.size());
+    for (auto &g : supp_gids)
+        writeId(parcel, g);
+
     status |= parcel->writeUtf8AsUtf16(seclabel);
-    status |= parcel->writeUint64(capabilities.to_ulong());
-    parcel->writeUtf8VectorAsUtf16Vector(rlimits);
+    status |= parcel->writeUint64(capabilities.to_ullong());
+
+    status |= parcel->writeUint32(rlimits.size());
+    for (auto &rlt : rlimits) {
+        parcel->writeInt32(rlt.first);
+        parcel->writeUint64(rlt.second.rlim_cur);
+        parcel->writeUint64(rlt.second.rlim_max);
+    }
 
     return status;
 }
 
 status_t SaceCommandParams::readFromParcel (const Parcel* parcel) {
     status_t status = OK;
+    size_t start = parcel->dataPosition();
+
+    status |= readId(parcel, &uid);
+    status |= readId(parcel, &gid);
+
+    uint32_t count = parcel->readUint32();
+    if (count > NGROUPS_MAX)
+        return BAD_VALUE;
+
+    supp_gids.resize(count);
+    for (auto &g : supp_gids)
+        status |= readId(parcel, &g);
 
-    status |= parcel->readUtf8FromUtf16(&uid);
-    status |= parcel->readUtf8FromUtf16(&gid);
-    status |= parcel->readUtf8VectorFromUtf16Vector(&supp_gids);
     status |= parcel->readUtf8FromUtf16(&seclabel);
     capabilities = CapSet(parcel->readUint64());
-    status |= parcel->readUtf8VectorFromUtf16Vector(&rlimits);
+
+    count = parcel->readUint32();
+    if (count > RLIM_NLIMITS)
+        return BAD_VALUE;
+
+    rlimits.resize(count);
+    for (auto &rlt : rlimits) {
+        rlt.first = parcel->readInt32();
+        rlt.second.rlim_cur = parcel->readUint64();
+        rlt.second.rlim_max = parcel->readUint64();
+    }
+
+    if (status == OK && parcel->dataPosition() > start)
+        fingerprint.assign(reinterpret_cast<const char*>(parcel->data()) + start, parcel->dataPosition() - start);
+    else
+        fingerprint.clear();
 
     return status;
 }
 
+/* params built in saced have no encoding yet */
+string SaceCommandParams::getFingerprint () const {
+    if (!fingerprint.empty())
+        return fingerprint;
+
+    Parcel parcel;
+    SaceCommandParams::writeToParcel(&parcel);
+    return string(reinterpret_cast<const char*>(parcel.data()), parcel.dataSize());
+}
+
 sp<CommandParams> SaceCommandParams::parseCommandParams () const {
+    string key = getFingerprint();
+    {
+        AutoMutex _lock(params_lock);
+        auto it = params_cache.find(key);
+        if (it != params_cache.end())
+            return it->second;
+    }
+
+    bool complete;
+    sp<CommandParams> cmdParams = resolve(&complete);
+
+    /* a name that failed may resolve later */
+    if (complete) {
+        AutoMutex _lock(params_lock);
+        if (params_cache.size() >= MAX_CACHED_PARAMS)
+            params_cache.clear();
+
+        params_cache[key] = cmdParams;
+    }
+
+    return cmdParams;
+}
+
+sp<CommandParams> SaceCommandParams::resolve (bool *complete) const {
     sp<CommandParams> cmdParams = new CommandParams();
 
+    *complete = true;
     cmdParams->seclabel = seclabel;
     cmdParams->capabilities = capabilities;
+    cmdParams->rlimits = rlimits;
 
-    if (!decode_uid(uid, &cmdParams->uid))
+    if (!decode_uid(uid, &cmdParams->uid)) {
         cmdParams->uid = DEF_UID;
+        *complete = *complete && uid.empty();
+    }
 
-    if (!decode_uid(gid, &cmdParams->gid))
+    if (!decode_uid(gid, &cmdParams->gid)) {
         cmdParams->gid = DEF_GID;
+        *complete = *complete && gid.empty();
+    }
 
     gid_t supp_gid;
     for (auto g : supp_gids) {
-        if (!decode_uid(g, &supp_gid)) cmdParams->supp_gids.push_back(supp_gid);
-    }
-
-    int resource;
-    struct rlimit limit;
-    for (auto rls : rlimits) {
-        stringstream out_stream(rls);
-        out_stream>>resource>>limit.rlim_cur>>limit.rlim_max;
-        cmdParams->rlimits.push_back(pair<int, rlimit>(resource, limit));
+        if (decode_uid(g, &supp_gid))
+            cmdParams->supp_gids.push_back(supp_gid);
+        else
+            *complete = false;
     }
 
     return cmdParams;
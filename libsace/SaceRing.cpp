@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <new>
+
+#include "sace/SaceRing.h"
+#include "sace/SaceLog.h"
+
+namespace android {
+
+// ------------------------------ SaceRing ------------------------------
+void SaceRing::init (void *base, uint32_t size) {
+    mHeader = new (base) SaceRingHeader();
+    mData   = (uint8_t*)base + sizeof(SaceRingHeader);
+    mSize   = size;
+
+    mHeader->head.store(0);
+    mHeader->tail.store(0);
+    mHeader->needWakeup.store(0);
+    mHeader->needSpace.store(0);
+    mHeader->magic = SACE_SHM_MAGIC;
+    mHeader->size  = size;
+}
+
+bool SaceRing::attach (void *base, uint32_t size) {
+    SaceRingHeader *header = (SaceRingHeader*)base;
+    if (header->magic != SACE_SHM_MAGIC || header->size != size)
+        return false;
+
+    mHeader = header;
+    mData   = (uint8_t*)base + sizeof(SaceRingHeader);
+    mSize   = size;
+    return true;
+}
+
+void SaceRing::copyIn (uint32_t pos, const uint8_t *data, uint32_t len) {
+    uint32_t off   = pos & (mSize - 1);
+    uint32_t first = min(len, mSize - off);
+
+    memcpy(mData + off, data, first);
+    if (first < len)
+        memcpy(mData, data + first, len - first);
+}
+
+void SaceRing::copyOut (uint32_t pos, uint8_t *data, uint32_t len) const {
+    uint32_t off   = pos & (mSize - 1);
+    uint32_t first = min(len, mSize - off);
+
+    memcpy(data, mData + off, first);
+    if (first < len)
+        memcpy(data + first, mData, len - first);
+}
+
+bool SaceRing::push (const uint8_t *data, uint32_t len) {
+    uint32_t head = mHeader->head.load(memory_order_relaxed);
+    uint32_t tail = mHeader->tail.load(memory_order_acquire);
+
+    if (len > mSize - (head - tail))
+        return false;
+
+    copyIn(head, data, len);
+    mHeader->head.store(head + len, memory_order_release);
+    return true;
+}
+
+bool SaceRing::needWakeup () {
+    /* pairs with prepareWait : either we see the flag or the consumer sees our head */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (mHeader->needWakeup.load(memory_order_relaxed) == 0)
+        return false;
+
+    return mHeader->needWakeup.exchange(0) != 0;
+}
+
+bool SaceRing::prepareFull (uint32_t len) {
+    mHeader->needSpace.store(1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    uint32_t head = mHeader->head.load(memory_order_relaxed);
+    uint32_t tail = mHeader->tail.load(memory_order_relaxed);
+    if (len <= mSize - (head - tail)) {
+        mHeader->needSpace.store(0, memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+enum SaceStreamBuffer::FrameState SaceRing::pop (vector<uint8_t> &frame, uint32_t min_frame) {
+    uint32_t tail = mHeader->tail.load(memory_order_relaxed);
+    uint32_t head = mHeader->head.load(memory_order_acquire);
+    uint32_t avail = head - tail;
+
+    if (avail == 0)
+        return SaceStreamBuffer::FRAME_NONE;
+
+    uint32_t len;
+    if (avail < SACE_FRAME_LEN_SIZE)
+        return SaceStreamBuffer::FRAME_INVALID;
+
+    copyOut(tail, (uint8_t*)&len, sizeof(len));
+    if (len < min_frame || len > SACE_MAX_FRAME_SIZE || len > avail)
+        return SaceStreamBuffer::FRAME_INVALID;
+
+    frame.resize(len);
+    copyOut(tail, frame.data(), len);
+    mHeader->tail.store(tail + len, memory_order_release);
+
+    return SaceStreamBuffer::FRAME_READY;
+}
+
+bool SaceRing::empty () const {
+    return mHeader->head.load(memory_order_acquire) == mHeader->tail.load(memory_order_relaxed);
+}
+
+bool SaceRing::prepareWait () {
+    mHeader->needWakeup.store(1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!empty()) {
+        finishWait();
+        return false;
+    }
+
+    return true;
+}
+
+void SaceRing::finishWait () {
+    mHeader->needWakeup.store(0, memory_order_relaxed);
+}
+
+bool SaceRing::needSpace () {
+    /* pairs with prepareFull : either we see the flag or the producer sees our tail */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (mHeader->needSpace.load(memory_order_relaxed) == 0)
+        return false;
+
+    return mHeader->needSpace.exchange(0) != 0;
+}
+
+// ---------------------------- SaceShmRegion ----------------------------
+int SaceShmRegion::create () {
+    size_t ring_len = SaceRing::regionSize(SACE_RING_DATA_SIZE);
+
+    int memfd = memfd_create("sace_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        SACE_LOGE("SaceShmRegion memfd_create errno=%d errstr=%s", errno, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(memfd, mapSize()) < 0) {
+        SACE_LOGE("SaceShmRegion ftruncate errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    /* saced maps it too, it must never shrink under the daemon */
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        SACE_LOGE("SaceShmRegion seal errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    mBase = mmap(nullptr, mapSize(), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (mBase == MAP_FAILED) {
+        SACE_LOGE("SaceShmRegion mmap errno=%d errstr=%s", errno, strerror(errno));
+        mBase = nullptr;
+        goto err;
+    }
+
+    mLen = mapSize();
+    submit.init(mBase, SACE_RING_DATA_SIZE);
+    complete.init((uint8_t*)mBase + ring_len, SACE_RING_DATA_SIZE);
+    return memfd;
+
+err:
+    close(memfd);
+    return -1;
+}
+
+bool SaceShmRegion::map (int memfd) {
+    size_t ring_len = SaceRing::regionSize(SACE_RING_DATA_SIZE);
+    struct stat st;
+
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) {
+        SACE_LOGE("SaceShmRegion unsealed memfd seals=%d", seals);
+        return false;
+    }
+
+    if (fstat(memfd, &st) < 0 || (size_t)st.st_size != mapSize()) {
+        SACE_LOGE("SaceShmRegion invalid memfd size");
+        return false;
+    }
+
+    mBase = mmap(nullptr, mapSize(), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (mBase == MAP_FAILED) {
+        SACE_LOGE("SaceShmRegion mmap errno=%d errstr=%s", errno, strerror(errno));
+        mBase = nullptr;
+        return false;
+    }
+
+    mLen = mapSize();
+    if (!submit.attach(mBase, SACE_RING_DATA_SIZE) || !complete.attach((uint8_t*)mBase + ring_len, SACE_RING_DATA_SIZE)) {
+        SACE_LOGE("SaceShmRegion invalid ring header");
+        unmap();
+        return false;
+    }
+
+    return true;
+}
+
+void SaceShmRegion::unmap () {
+    if (mBase != nullptr)
+        munmap(mBase, mLen);
+
+    mBase = nullptr;
+    mLen  = 0;
+}
+
+}; //namespace android
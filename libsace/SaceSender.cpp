@@ -18,10 +18,13 @@
 #include <sys/eventfd.h>
 #include <sys/select.h>
 #include <sys/prctl.h>
+#include <sys/time.h>
+#include <poll.h>
 #include <cutils/sockets.h>
 #include <binder/IServiceManager.h>
 #include <binder/IPCThreadState.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <math.h>
 
 #include "android/BpSaceManager.h"
@@ -32,6 +35,7 @@ namespace android {
 
 // -------------------------------------------------------------------------- {
 const char *SaceBinderSender::NAME = "SSBinder";
+const int   SaceBinderSender::SEM_WAIT_TIMEOUT = 3;
 
 bool SaceBinderSender::init () {
     sp<IBinder> binder = defaultServiceManager()->getService(String16("SaceService"));
@@ -48,6 +52,45 @@ bool SaceBinderSender::init () {
     return true;
 }
 
+/* CLOCK_REALTIME end of the result wait, the command deadline when it has one */
+static void result_wait_time (const SaceCommand &cmd, int def_sec, struct timespec *timeout) {
+    struct timeval now;
+    int64_t wait = (int64_t)def_sec * 1000000000LL;
+
+    if (cmd.deadline > 0) {
+        wait = cmd.deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+        if (wait < 0)
+            wait = 0;
+    }
+
+    gettimeofday(&now, nullptr);
+    int64_t nsec = (int64_t)now.tv_usec * 1000 + wait % 1000000000LL;
+    timeout->tv_sec  = now.tv_sec + wait / 1000000000LL + nsec / 1000000000LL;
+    timeout->tv_nsec = nsec % 1000000000LL;
+}
+
+/* fds of the result parcel are closed once onResult returns */
+static bool dup_result_fds (SaceResult &rslt) {
+    bool ok = true;
+
+    if (rslt.resultType == SACE_RESULT_TYPE_FD && rslt.resultFd >= 0 &&
+        (rslt.resultFd = fcntl(rslt.resultFd, F_DUPFD_CLOEXEC, 0)) < 0)
+        ok = false;
+
+    for (auto &sub : rslt.results)
+        ok = dup_result_fds(sub) && ok;
+
+    return ok;
+}
+
+static void close_result_fds (const SaceResult &rslt) {
+    if (rslt.resultType == SACE_RESULT_TYPE_FD && rslt.resultFd >= 0)
+        close(rslt.resultFd);
+
+    for (auto &sub : rslt.results)
+        close_result_fds(sub);
+}
+
 SaceResult SaceBinderSender::excuteCommand (const SaceCommand &cmd) {
     mRlt.resultType   = SACE_RESULT_TYPE_NONE;
     mRlt.resultStatus = SACE_RESULT_STATUS_FAIL;
@@ -56,8 +99,67 @@ SaceResult SaceBinderSender::excuteCommand (const SaceCommand &cmd) {
         return mRlt;
 
     SaceResult result;
-    manager->sendCommand(cmd, &result);
+    result.resultType   = SACE_RESULT_TYPE_NONE;
+    result.resultStatus = SACE_RESULT_STATUS_FAIL;
+    result.sequence     = cmd.sequence;
+
+    pthread_mutex_lock(&syncMutex);
+    mWaiting.insert(cmd.sequence);
+    pthread_mutex_unlock(&syncMutex);
+
+    int ret = 0;
+    if (!manager->submitCommand(cmd).isOk()) {
+        SACE_LOGE("%s submitCommand fail %s", NAME, cmd.to_string().c_str());
+        ret = EPIPE;
+    }
+
+    struct timespec timeout;
+    result_wait_time(cmd, SEM_WAIT_TIMEOUT, &timeout);
+
+    pthread_mutex_lock(&syncMutex);
+    while (ret == 0) {
+        map<uint32_t, SaceResult>::iterator it = mResult.find(cmd.sequence);
+        if (it != mResult.end()) {
+            result = it->second;
+            mResult.erase(it);
+            break;
+        }
+
+        ret = pthread_cond_timedwait(&syncCond, &syncMutex, &timeout);
+    }
+
+    /* a late result is dropped by handleResult */
+    mWaiting.erase(cmd.sequence);
+    pthread_mutex_unlock(&syncMutex);
+
+    if (ret == ETIMEDOUT) {
+        SACE_LOGI("%s TIMEOUT RESULT %s", NAME, cmd.to_string().c_str());
+        result.resultStatus = SACE_RESULT_STATUS_TIMEOUT;
+    }
+
+    SACE_LOGI("%s excuteCommand result=%s", NAME, result.to_string().c_str());
     return result;
+}
+
+void SaceBinderSender::handleResult (const SaceResult &result) {
+    SaceResult rslt(result);
+    SACE_LOGI("%s handle result %s", NAME, rslt.to_string().c_str());
+
+    if (!dup_result_fds(rslt))
+        SACE_LOGE("%s dup result fd errno=%d errstr=%s", NAME, errno, strerror(errno));
+
+    pthread_mutex_lock(&syncMutex);
+    if (mWaiting.find(rslt.sequence) == mWaiting.end()) {
+        pthread_mutex_unlock(&syncMutex);
+
+        SACE_LOGW("%s drop unexpected result %s", NAME, rslt.to_string().c_str());
+        close_result_fds(rslt);
+        return;
+    }
+
+    mResult.insert(pair<uint32_t, SaceResult>(rslt.sequence, rslt));
+    pthread_cond_broadcast(&syncCond);
+    pthread_mutex_unlock(&syncMutex);
 } //}
 
 // ---------------------------------------------------------------------------- {
@@ -73,8 +175,10 @@ bool SaceSocketSender::init () {
         SACE_LOGE("%s socket_local_client errno=%d errstr=%s", NAME, errno, strerror(errno));
         goto err;
     }
+    /* not for the children of the client */
+    fcntl(sockfd, F_SETFD, FD_CLOEXEC);
 
-    if ((event_fd = eventfd(0, 0)) < 0) {
+    if ((event_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
         SACE_LOGE("%s eventfd errno=%d errstr=%s", NAME, errno, strerror(errno));
         goto err1;
     }
@@ -89,14 +193,24 @@ bool SaceSocketSender::init () {
         goto err3;
     }
 
+    if (pthread_mutex_init(&writeMutex, nullptr) < 0) {
+        SACE_LOGE("%s pthread_mutex_init errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err4;
+    }
+
+    mRecvBuf.clear();
+    mRecvFds.clear();
+
     /* setup receive thread */
     if (pthread_create(&recv_thread, nullptr, recv_thread_run, (void*)this) < 0) {
         SACE_LOGE("%s pthread_create errno=%d errstr=%s", NAME, errno, strerror(errno));
-        goto err4;
+        goto err5;
     }
 
     return (initlized = true);
 
+err5:
+    pthread_mutex_destroy(&writeMutex);
 err4:
     pthread_cond_destroy(&syncCond);
 err3:
@@ -118,14 +232,131 @@ void SaceSocketSender::uninit () {
 
     pthread_cond_destroy(&syncCond);
     pthread_mutex_destroy(&syncMutex);
+    pthread_mutex_destroy(&writeMutex);
 
     initlized = false;
 }
 
+/* the fd of a SACE_RESULT_TYPE_FD result arrives with the first byte of its frame,
+ * so fds are queued in arrival order and handed to FD results in frame order.
+ */
+/* saced passes the fds of FD results, batched sub results included, in result order */
+static size_t count_result_fds (const SaceResult &rslt) {
+    size_t count = rslt.resultType == SACE_RESULT_TYPE_FD? 1 : 0;
+    for (auto &sub : rslt.results)
+        count += count_result_fds(sub);
+
+    return count;
+}
+
+static void assign_result_fds (SaceResult &rslt, deque<int> &fds) {
+    rslt.resultFd = -1;
+    if (rslt.resultType == SACE_RESULT_TYPE_FD) {
+        if (!fds.empty()) {
+            rslt.resultFd = fds.front();
+            fds.pop_front();
+        }
+        else
+            SACE_LOGE("missing fd for result %s", rslt.to_string().c_str());
+    }
+
+    for (auto &sub : rslt.results)
+        assign_result_fds(sub, fds);
+}
+
+void SaceSocketSender::handleFrame (const uint8_t *data, uint32_t len) {
+    // transform from bytes
+    Parcel parcel;
+    parcel.setData(data, len);
+
+    SaceResultHeader headerRslt;
+    headerRslt.readFromParcel(&parcel);
+
+    // reset
+    parcel.setDataPosition(0);
+
+    if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
+        SaceResult rslt;
+        if (rslt.readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s drop malformed result", THREAD_NAME);
+            return;
+        }
+        assign_result_fds(rslt, mRecvFds);
+        handleResult(rslt);
+    }
+    else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
+        SaceStatusResponse response;
+        if (response.readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s drop malformed response", THREAD_NAME);
+            return;
+        }
+        handleResponse(response);
+    }
+    else
+        SACE_LOGW("%s receive invalid type %d", THREAD_NAME, headerRslt.type);
+}
+
+bool SaceSocketSender::recvFrames () {
+    struct msghdr msg;
+
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    struct iovec iov[1];
+    iov[0].iov_base = mRecvBuf.reserve(SACE_STREAM_READ_SIZE);
+    iov[0].iov_len  = mRecvBuf.writable();
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = sizeof(control_un.control);
+
+    int ret = TEMP_FAILURE_RETRY(recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC));
+    if (ret <= 0) {
+        if (ret == 0)
+            SACE_LOGE("%s exit peer close", THREAD_NAME);
+        else
+            SACE_LOGE("%s exit recvmsg errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
+        return false;
+    }
+
+    for (struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg); pcmsg != nullptr; pcmsg = CMSG_NXTHDR(&msg, pcmsg)) {
+        if (pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int *fds = (int*)CMSG_DATA(pcmsg);
+        size_t fd_num = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < fd_num; i++)
+            mRecvFds.push_back(fds[i]);
+    }
+
+    mRecvBuf.commit(ret);
+
+    const uint8_t *data;
+    uint32_t len;
+    while (true) {
+        enum SaceStreamBuffer::FrameState state = mRecvBuf.nextFrame(&data, &len);
+        if (state == SaceStreamBuffer::FRAME_NONE)
+            return true;
+
+        if (state == SaceStreamBuffer::FRAME_INVALID) {
+            SACE_LOGE("%s receive invalid frame, pending=%d", THREAD_NAME, (uint32_t)mRecvBuf.pending());
+            return false;
+        }
+
+        handleFrame(data, len);
+        mRecvBuf.consume(len);
+    }
+}
+
 void* SaceSocketSender::recv_thread_run (void *data) {
     SaceSocketSender *self = (SaceSocketSender*)data;
     fd_set fd_reads;
-    char buf[SACE_RESULT_BUF_SIZE];
 
     prctl(PR_SET_NAME, THREAD_NAME);
     self->recv_thread_id = gettid();
@@ -142,87 +373,8 @@ void* SaceSocketSender::recv_thread_run (void *data) {
             return 0;
         }
 
-        if (FD_ISSET(self->sockfd, &fd_reads)) {
-            struct msghdr msg;
-            uint32_t size;
-
-            union {
-                struct cmsghdr cm;
-                char control[CMSG_SPACE(sizeof(int))];
-            } control_un;
-            struct cmsghdr *pcmsg = nullptr;
-
-            memset(control_un.control, sizeof(control_un.control), 0);
-            memset(buf, sizeof(buf), 0);
-
-            struct iovec iov[1];
-            iov[0].iov_base = buf;
-            iov[0].iov_len  = sizeof(buf);
-
-            msg.msg_name    = nullptr;
-            msg.msg_namelen = 0;
-            msg.msg_iov    = iov;
-            msg.msg_iovlen = 1;
-            msg.msg_control    = control_un.control;
-            msg.msg_controllen = sizeof(control_un.control);
-
-            ret = TEMP_FAILURE_RETRY(recvmsg(self->sockfd, &msg, 0));
-            if (ret <= 0) {
-                if (ret == 0)
-                    SACE_LOGE("%s exit peer close", THREAD_NAME);
-                else
-                    SACE_LOGE("%s exit recvmsg errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
-                return 0;
-            }
-
-            if ((size_t)ret < SaceResultHeader::parcelSize()) {
-                SACE_LOGE("%s smaller Req : %d Real : %d", THREAD_NAME, SaceResultHeader::parcelSize(), ret);
-                continue;
-            }
-
-            // transform from bytes
-            Parcel parcel;
-            parcel.setData((uint8_t*)buf, ret);
-
-            SaceResultHeader headerRslt;
-            headerRslt.readFromParcel(&parcel);
-
-            // reset
-            parcel.setDataPosition(0);
-
-            if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
-                if (parcel.dataSize() < headerRslt.len) {
-                    SACE_LOGE("%s receive invalid result Req : %d Real : %d", THREAD_NAME, headerRslt.len, (uint32_t)parcel.dataSize());
-                    continue;
-                }
-                else {
-                    SaceResult rslt;
-                    rslt.readFromParcel(&parcel);
-
-                    pcmsg = CMSG_FIRSTHDR(&msg);
-                    if (pcmsg != nullptr && pcmsg->cmsg_len == CMSG_LEN(sizeof(int)) &&
-                        pcmsg->cmsg_level == SOL_SOCKET && pcmsg->cmsg_type == SCM_RIGHTS)
-                        rslt.resultFd = *((int*)CMSG_DATA(pcmsg));
-                    else
-                        rslt.resultFd = -1;
-
-                    self->handleResult(rslt);
-                }
-            }
-            else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
-                if (parcel.dataSize() < headerRslt.len) {
-                    SACE_LOGE("%s receive invalid response Req : %d Real : %d", THREAD_NAME, headerRslt.len, (uint32_t)parcel.dataSize());
-                    continue;
-                }
-                else {
-                    SaceStatusResponse response;
-                    response.readFromParcel(&parcel);
-                    self->handleResponse(response);
-                }
-            }
-            else
-                SACE_LOGW("%s receive invalid type %d", THREAD_NAME, headerRslt.type);
-        }
+        if (FD_ISSET(self->sockfd, &fd_reads) && !self->recvFrames())
+            return 0;
 
         if (FD_ISSET(self->event_fd, &fd_reads)) {
             close(self->event_fd);
@@ -232,6 +384,67 @@ void* SaceSocketSender::recv_thread_run (void *data) {
     }
 }
 
+/* several threads may excute commands concurrently, a frame must never interleave */
+/* script fds of cmd and its sub commands, in the order saced attaches them */
+static void collect_script_fds (const SaceCommand &cmd, vector<int> &fds) {
+    if (cmd.script)
+        fds.push_back(cmd.script->get());
+
+    for (auto &sub : cmd.batch)
+        collect_script_fds(sub, fds);
+}
+
+/* fds ride on the first byte, saced reads them before the frame completes */
+static int send_with_fds (int sockfd, const uint8_t *data, size_t len, const vector<int> &fds) {
+    struct msghdr msg;
+    struct iovec iov[1];
+
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    iov[0].iov_base = (void*)data;
+    iov[0].iov_len  = len;
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_flags  = 0;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+    struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg);
+    pcmsg->cmsg_len   = CMSG_LEN(sizeof(int) * fds.size());
+    pcmsg->cmsg_level = SOL_SOCKET;
+    pcmsg->cmsg_type  = SCM_RIGHTS;
+    memcpy(CMSG_DATA(pcmsg), fds.data(), sizeof(int) * fds.size());
+
+    return TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, MSG_NOSIGNAL));
+}
+
+bool SaceSocketSender::writeFrame (const uint8_t *data, size_t len, const vector<int> &fds) {
+    size_t written = 0;
+
+    pthread_mutex_lock(&writeMutex);
+    while (written < len) {
+        int ret = (written == 0 && !fds.empty())? send_with_fds(sockfd, data, len, fds) :
+            TEMP_FAILURE_RETRY(send(sockfd, data + written, len - written, MSG_NOSIGNAL));
+        if (ret <= 0) {
+            SACE_LOGE("%s excuteCommand Require %d Real %d errno=%d errstr=%s", NAME, (uint32_t)len, (uint32_t)written,
+                errno, strerror(errno));
+            break;
+        }
+
+        written += ret;
+    }
+    pthread_mutex_unlock(&writeMutex);
+
+    return written == len;
+}
+
 SaceResult SaceSocketSender::excuteCommand (const SaceCommand &cmd) {
     SaceResult result;
     result.resultType   = SACE_RESULT_TYPE_NONE;
@@ -242,27 +455,25 @@ SaceResult SaceSocketSender::excuteCommand (const SaceCommand &cmd) {
     if (!initlized && !init())
         return result;
 
+    vector<int> fds;
+    collect_script_fds(cmd, fds);
+    if (fds.size() > SACE_MAX_RECV_FDS) {
+        SACE_LOGE("%s too many scripts %d", NAME, (uint32_t)fds.size());
+        return result;
+    }
+
     /* translate to bytes */
     Parcel parcel;
     cmd.writeToParcel(&parcel);
 
-    int ret = TEMP_FAILURE_RETRY(write(sockfd, (char*)parcel.data(), parcel.dataSize()));
-    if (ret <= 0) {
-        SACE_LOGE("%s excuteCommand errno=%d errstr=%s", NAME, errno, strerror(errno));
+    if (!writeFrame(parcel.data(), parcel.dataSize(), fds)) {
         uninit();
         return result;
     }
 
-    if ((size_t)ret != parcel.dataSize()) {
-        SACE_LOGE("%s excuteCommand Require %d Real %d", NAME, (uint32_t)parcel.dataSize(), ret);
-        return result;
-    }
-
-	struct timeval now, future;
+	int ret;
     struct timespec timeout;
-    gettimeofday(&now, nullptr);
-    timeout.tv_sec  = now.tv_sec + SEM_WAIT_TIMEOUT;
-    timeout.tv_nsec = now.tv_usec * 1000;
+    result_wait_time(cmd, SEM_WAIT_TIMEOUT, &timeout);
 
     while (true) {
        pthread_mutex_lock(&syncMutex);
@@ -312,4 +523,406 @@ void SaceSocketSender::handleResult (const SaceResult &result) {
     pthread_mutex_unlock(&syncMutex);
 } //}
 
+// ---------------------------------------------------------------------------- {
+const int SaceShmSender::SEM_WAIT_TIMEOUT = 3;
+const int SaceShmSender::RING_FULL_WAIT = 1; //ms
+const uint64_t SaceShmSender::RECV_THREAD_EXIT = 0x01;
+
+const char *SaceShmSender::THREAD_NAME = "SSShm.MT";
+const char *SaceShmSender::NAME = "SSShm";
+
+/* hand the ring memory and both doorbells to saced */
+bool SaceShmSender::handshake (int memfd) {
+    struct msghdr msg;
+    struct cmsghdr *pcmsg;
+    uint32_t magic = SACE_SHM_MAGIC;
+
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_SHM_FD_NUM)];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    struct iovec iov[1];
+    iov[0].iov_base = &magic;
+    iov[0].iov_len  = sizeof(magic);
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = sizeof(control_un.control);
+
+    pcmsg = CMSG_FIRSTHDR(&msg);
+    pcmsg->cmsg_len   = CMSG_LEN(sizeof(int) * SACE_SHM_FD_NUM);
+    pcmsg->cmsg_level = SOL_SOCKET;
+    pcmsg->cmsg_type  = SCM_RIGHTS;
+
+    int *fds = (int*)CMSG_DATA(pcmsg);
+    fds[SACE_SHM_FD_MEMORY]        = memfd;
+    fds[SACE_SHM_FD_SUBMIT_BELL]   = submit_bell;
+    fds[SACE_SHM_FD_COMPLETE_BELL] = complete_bell;
+
+    if (TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, MSG_NOSIGNAL)) != sizeof(magic)) {
+        SACE_LOGE("%s handshake errno=%d errstr=%s", NAME, errno, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool SaceShmSender::init () {
+    int memfd = mRegion.create();
+    if (memfd < 0)
+        goto err;
+
+    if ((submit_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        SACE_LOGE("%s eventfd errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err1;
+    }
+
+    if ((complete_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        SACE_LOGE("%s eventfd errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err2;
+    }
+
+    if ((sockfd = socket_local_client(SACE_SHM_SOCKET_NAME, ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM)) < 0) {
+        SACE_LOGE("%s socket_local_client errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err3;
+    }
+    fcntl(sockfd, F_SETFD, FD_CLOEXEC);
+
+    if (!handshake(memfd))
+        goto err4;
+
+    /* saced holds its own mapping */
+    close(memfd);
+    memfd = -1;
+
+    if ((event_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+        SACE_LOGE("%s eventfd errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err4;
+    }
+
+    if (pthread_mutex_init(&syncMutex, nullptr) < 0) {
+        SACE_LOGE("%s pthread_mutex_init errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err5;
+    }
+
+    if (pthread_cond_init(&syncCond, nullptr) < 0) {
+        SACE_LOGE("%s pthread_cond_init errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err6;
+    }
+
+    if (pthread_mutex_init(&writeMutex, nullptr) < 0) {
+        SACE_LOGE("%s pthread_mutex_init errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err7;
+    }
+
+    if (pthread_create(&recv_thread, nullptr, recv_thread_run, (void*)this) < 0) {
+        SACE_LOGE("%s pthread_create errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err8;
+    }
+
+    return (initlized = true);
+
+err8:
+    pthread_mutex_destroy(&writeMutex);
+err7:
+    pthread_cond_destroy(&syncCond);
+err6:
+    pthread_mutex_destroy(&syncMutex);
+err5:
+    close(event_fd);
+    event_fd = -1;
+err4:
+    close(sockfd);
+    sockfd = -1;
+err3:
+    close(complete_bell);
+    complete_bell = -1;
+err2:
+    close(submit_bell);
+    submit_bell = -1;
+err1:
+    if (memfd >= 0)
+        close(memfd);
+    mRegion.unmap();
+err:
+    return false;
+}
+
+void SaceShmSender::uninit () {
+    /* exit recv_thread_run before the rings go away */
+    uint64_t value = RECV_THREAD_EXIT;
+    if (TEMP_FAILURE_RETRY(write(event_fd, &value, sizeof(value))) < 0)
+        SACE_LOGE("%s exit recv_thread_run errno=%d errstr=%s", NAME, errno, strerror(errno));
+    pthread_join(recv_thread, nullptr);
+
+    close(sockfd);
+    close(event_fd);
+    close(submit_bell);
+    close(complete_bell);
+    sockfd = submit_bell = complete_bell = event_fd = -1;
+    mRegion.unmap();
+
+    pthread_cond_destroy(&syncCond);
+    pthread_mutex_destroy(&syncMutex);
+    pthread_mutex_destroy(&writeMutex);
+
+    initlized = false;
+}
+
+/* saced sends the fds of a result on the socket right after publishing the result */
+bool SaceShmSender::recvResultFds (deque<int> &fds, size_t count) {
+    struct msghdr msg;
+    uint8_t byte;
+
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    struct iovec iov[1];
+    iov[0].iov_base = &byte;
+    iov[0].iov_len  = sizeof(byte);
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = sizeof(control_un.control);
+
+    if (TEMP_FAILURE_RETRY(recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC)) <= 0) {
+        SACE_LOGE("%s recv result fd errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
+        return false;
+    }
+
+    struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg);
+    if (pcmsg == nullptr || pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS)
+        return false;
+
+    int *pfds = (int*)CMSG_DATA(pcmsg);
+    size_t nfds = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < nfds; i++)
+        fds.push_back(pfds[i]);
+
+    if (nfds != count)
+        SACE_LOGE("%s expect %d result fds, receive %d", THREAD_NAME, (int)count, (int)nfds);
+    return true;
+}
+
+void SaceShmSender::handleFrame (const uint8_t *data, uint32_t len) {
+    Parcel parcel;
+    parcel.setData(data, len);
+
+    SaceResultHeader headerRslt;
+    headerRslt.readFromParcel(&parcel);
+
+    // reset
+    parcel.setDataPosition(0);
+
+    if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
+        SaceResult rslt;
+        if (rslt.readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s drop malformed result", THREAD_NAME);
+            return;
+        }
+
+        deque<int> fds;
+        size_t count = count_result_fds(rslt);
+        if (count > 0)
+            recvResultFds(fds, count);
+
+        assign_result_fds(rslt, fds);
+        /* more fds than results, don't leak them */
+        for (int fd : fds)
+            close(fd);
+        handleResult(rslt);
+    }
+    else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
+        SaceStatusResponse response;
+        if (response.readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s drop malformed response", THREAD_NAME);
+            return;
+        }
+
+        SACE_LOGI("%s handleResponse %s", NAME, response.to_string().c_str());
+        onCommandResponse(response);
+    }
+    else
+        SACE_LOGW("%s receive invalid type %d", THREAD_NAME, headerRslt.type);
+}
+
+bool SaceShmSender::drainCompletions () {
+    vector<uint8_t> frame;
+
+    while (true) {
+        enum SaceStreamBuffer::FrameState state = mRegion.complete.pop(frame, SaceResultHeader::parcelSize());
+        if (state == SaceStreamBuffer::FRAME_NONE) {
+            /* saced queued results on a full ring, the submit doorbell lets it flush them */
+            uint64_t value = 1;
+            if (mRegion.complete.needSpace() && TEMP_FAILURE_RETRY(write(submit_bell, &value, sizeof(value))) < 0)
+                SACE_LOGE("%s ring submit doorbell errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
+            return true;
+        }
+
+        if (state == SaceStreamBuffer::FRAME_INVALID) {
+            SACE_LOGE("%s receive invalid frame", THREAD_NAME);
+            return false;
+        }
+
+        handleFrame(frame.data(), frame.size());
+    }
+}
+
+void* SaceShmSender::recv_thread_run (void *data) {
+    SaceShmSender *self = (SaceShmSender*)data;
+    uint64_t value;
+
+    prctl(PR_SET_NAME, THREAD_NAME);
+    SACE_LOGI("%s recv_thread_run %d", THREAD_NAME, gettid());
+
+    struct pollfd fds[3];
+    fds[0] = {self->complete_bell, POLLIN, 0};
+    fds[1] = {self->event_fd, POLLIN, 0};
+    /* the socket only carries result fds, watch it for hangup */
+    fds[2] = {self->sockfd, POLLRDHUP, 0};
+
+    while (true) {
+        if (!self->drainCompletions())
+            return 0;
+
+        /* saced keeps pushing without doorbells until we arm needWakeup */
+        if (!self->mRegion.complete.prepareWait())
+            continue;
+
+        int ret = TEMP_FAILURE_RETRY(poll(fds, 3, -1));
+        self->mRegion.complete.finishWait();
+        if (ret < 0) {
+            SACE_LOGE("%s exit poll errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
+            return 0;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            SACE_LOGI("%s exit recv_thread_run %s", NAME, THREAD_NAME);
+            return 0;
+        }
+
+        if (fds[2].revents & (POLLRDHUP | POLLHUP | POLLERR)) {
+            SACE_LOGE("%s exit peer close", THREAD_NAME);
+            return 0;
+        }
+
+        if (fds[0].revents & POLLIN)
+            TEMP_FAILURE_RETRY(read(self->complete_bell, &value, sizeof(value)));
+    }
+}
+
+bool SaceShmSender::submitFrame (const uint8_t *data, uint32_t len, const vector<int> &fds) {
+    uint64_t value = 1;
+    int waited = 0;
+    uint8_t byte = 0;
+
+    pthread_mutex_lock(&writeMutex);
+    /* queued on the socket before the frame is visible, in submit order */
+    if (!fds.empty() && send_with_fds(sockfd, &byte, sizeof(byte), fds) != sizeof(byte)) {
+        pthread_mutex_unlock(&writeMutex);
+        SACE_LOGE("%s send script fds errno=%d errstr=%s", NAME, errno, strerror(errno));
+        return false;
+    }
+
+    while (!mRegion.submit.push(data, len)) {
+        /* ring full : saced is busy draining, back off briefly */
+        if (waited >= SEM_WAIT_TIMEOUT * 1000) {
+            pthread_mutex_unlock(&writeMutex);
+            SACE_LOGE("%s submit ring full", NAME);
+            return false;
+        }
+
+        usleep(RING_FULL_WAIT * 1000);
+        waited += RING_FULL_WAIT;
+    }
+
+    bool wakeup = mRegion.submit.needWakeup();
+    pthread_mutex_unlock(&writeMutex);
+
+    if (wakeup && TEMP_FAILURE_RETRY(write(submit_bell, &value, sizeof(value))) < 0)
+        SACE_LOGE("%s ring submit doorbell errno=%d errstr=%s", NAME, errno, strerror(errno));
+
+    return true;
+}
+
+SaceResult SaceShmSender::excuteCommand (const SaceCommand &cmd) {
+    SaceResult result;
+    result.resultType   = SACE_RESULT_TYPE_NONE;
+    result.resultStatus = SACE_RESULT_STATUS_FAIL;
+
+    if (!initlized && !init()) {
+        SACE_LOGE("%s excuteCommand init fail", NAME);
+        return result;
+    }
+
+    vector<int> fds;
+    collect_script_fds(cmd, fds);
+    if (fds.size() > SACE_MAX_RECV_FDS) {
+        SACE_LOGE("%s too many scripts %d", NAME, (uint32_t)fds.size());
+        return result;
+    }
+
+    SACE_LOGI("%s excuteCommand %s", NAME, cmd.to_string().c_str());
+    Parcel parcel;
+    cmd.writeToParcel(&parcel);
+
+    if (!submitFrame(parcel.data(), parcel.dataSize(), fds))
+        return result;
+
+    int ret;
+    struct timespec timeout;
+    result_wait_time(cmd, SEM_WAIT_TIMEOUT, &timeout);
+
+    while (true) {
+        pthread_mutex_lock(&syncMutex);
+        map<uint32_t, SaceResult>::iterator it = mResult.find(cmd.sequence);
+        if (it != mResult.end()) {
+            result = it->second;
+            mResult.erase(it);
+            pthread_mutex_unlock(&syncMutex);
+            ret = 0;
+            break;
+        }
+
+        ret = pthread_cond_timedwait(&syncCond, &syncMutex, &timeout);
+        pthread_mutex_unlock(&syncMutex);
+        if (ret)
+            break;
+    }
+
+    if (ret) {
+        if (ret == ETIMEDOUT) {
+            SACE_LOGI("%s TIMEOUT RESULT %s", NAME, cmd.to_string().c_str());
+            result.resultStatus = SACE_RESULT_STATUS_TIMEOUT;
+        }
+        else {
+            SACE_LOGI("%s WAIT RESULT %s errno=%d, errstr=%s", NAME, cmd.to_string().c_str(), ret, strerror(ret));
+            result.resultStatus = SACE_RESULT_STATUS_FAIL;
+        }
+    }
+
+    SACE_LOGI("%s excuteCommand result=%s", NAME, result.to_string().c_str());
+    return result;
+}
+
+void SaceShmSender::handleResult (const SaceResult &result) {
+    SACE_LOGI("%s handle result %s", NAME, result.to_string().c_str());
+
+    pthread_mutex_lock(&syncMutex);
+    mResult.insert(pair<uint32_t, SaceResult>(result.sequence, result));
+    pthread_cond_broadcast(&syncCond);
+    pthread_mutex_unlock(&syncMutex);
+} //}
+
 }; //namespace android
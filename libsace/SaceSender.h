@@ -20,11 +20,15 @@
 #include <semaphore.h>
 #include <utils/RefBase.h>
 #include <map>
+#include <set>
+#include <deque>
 
 #include "android/ISaceListener.h"
 #include "android/ISaceManager.h"
 #include "android/BnSaceListener.h"
 #include "sace/SaceLog.h"
+#include "sace/SaceStream.h"
+#include "sace/SaceRing.h"
 
 using namespace std;
 
@@ -54,13 +58,23 @@ protected:
 };
 
 // ----------------------------------------------------
+/* commands are submitted oneway, saced answers through ISaceListener.onResult
+ * so neither side parks a binder thread while a command runs.
+ */
 class SaceBinderSender : public SaceSender {
     static const char *NAME;
+    static const int   SEM_WAIT_TIMEOUT;
 
     sp<ISaceListener> listener;
     sp<ISaceManager>  manager;
 	SaceResult mRlt;
 
+    /* synchronized with onResult */
+    pthread_cond_t syncCond;
+    pthread_mutex_t syncMutex;
+    map<uint32_t, SaceResult> mResult;
+    set<uint32_t> mWaiting;
+
    /* Callback */
     class SaceListenerService : public BnSaceListener {
         SaceBinderSender *self;
@@ -73,15 +87,35 @@ class SaceBinderSender : public SaceSender {
             self->onCommandResponse(response);
             return android::binder::Status::ok();
         }
+
+        android::binder::Status onResponses (const vector<SaceStatusResponse>& responses) override {
+            for (auto &response : responses)
+                self->onCommandResponse(response);
+            return android::binder::Status::ok();
+        }
+
+        android::binder::Status onResult (const SaceResult& result) override {
+            self->handleResult(result);
+            return android::binder::Status::ok();
+        }
     };
 
     bool init();
+    void handleResult (const SaceResult &result);
 public:
+    SaceBinderSender () {
+        pthread_mutex_init(&syncMutex, nullptr);
+        pthread_cond_init(&syncCond, nullptr);
+    }
+
     virtual SaceResult excuteCommand (const SaceCommand &);
 
     virtual ~SaceBinderSender() {
         if (manager != nullptr)
             manager->unregisterListener();
+
+        pthread_cond_destroy(&syncCond);
+        pthread_mutex_destroy(&syncMutex);
     }
 };
 
@@ -106,15 +140,25 @@ class SaceSocketSender : public SaceSender {
     map<uint32_t, SaceResult> mResult;
     bool initlized;
 
+    /* keep each command frame contiguous while several threads send */
+    pthread_mutex_t writeMutex;
+
+    /* only touched by recv_thread_run */
+    SaceStreamBuffer mRecvBuf;
+    deque<int> mRecvFds;
+
 private:
     bool init();
     void uninit();
+    bool writeFrame (const uint8_t *data, size_t len, const vector<int> &fds);
+    bool recvFrames ();
+    void handleFrame (const uint8_t *data, uint32_t len);
     void handleResponse (const SaceStatusResponse &response);
     void handleResult (const SaceResult &result);
     static void* recv_thread_run (void *data);
 
 public:
-    explicit SaceSocketSender (const char* sock_name, int sock_type) {
+    explicit SaceSocketSender (const char* sock_name, int sock_type):mRecvBuf(SaceResultHeader::parcelSize()) {
         mSockName = string(sock_name);
         mSockType = sock_type;
 		initlized = false;
@@ -128,6 +172,60 @@ public:
     SaceResult excuteCommand (const SaceCommand &);
 };
 
+// ----------------------------------------------------
+/* commands and results go through shared rings, the doorbells are only
+ * rung when the peer is about to sleep, so a busy client makes no syscall
+ * per command.
+ */
+class SaceShmSender : public SaceSender {
+    static const char *THREAD_NAME;
+    static const char *NAME;
+    static const int   SEM_WAIT_TIMEOUT;
+    static const int   RING_FULL_WAIT;
+    static const uint64_t RECV_THREAD_EXIT;
+
+    pthread_t recv_thread;
+
+    /* synchronized with recv_thread_run */
+    pthread_cond_t syncCond;
+    pthread_mutex_t syncMutex;
+    int event_fd;
+
+    /* submit ring has a single producer */
+    pthread_mutex_t writeMutex;
+
+    int sockfd;
+    int submit_bell;
+    int complete_bell;
+    SaceShmRegion mRegion;
+    map<uint32_t, SaceResult> mResult;
+    bool initlized;
+
+private:
+    bool init();
+    void uninit();
+    bool handshake (int memfd);
+    bool submitFrame (const uint8_t *data, uint32_t len, const vector<int> &fds);
+    bool drainCompletions ();
+    void handleFrame (const uint8_t *data, uint32_t len);
+    bool recvResultFds (deque<int> &fds, size_t count);
+    void handleResult (const SaceResult &result);
+    static void* recv_thread_run (void *data);
+
+public:
+    explicit SaceShmSender () {
+        sockfd = submit_bell = complete_bell = event_fd = -1;
+        initlized = false;
+    }
+
+    ~SaceShmSender () {
+        if (initlized)
+            uninit();
+    }
+
+    SaceResult excuteCommand (const SaceCommand &);
+};
+
 }; //namespace android
 
 #endif
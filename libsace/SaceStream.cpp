@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "sace/SaceStream.h"
+
+namespace android {
+
+uint8_t* SaceStreamBuffer::reserve (size_t len) {
+    if (writable() >= len)
+        return &mBuffer[mEnd];
+
+    /* move the partial frame to the front before growing */
+    if (mStart > 0) {
+        size_t remain = pending();
+        if (remain > 0)
+            memmove(&mBuffer[0], &mBuffer[mStart], remain);
+
+        mStart = 0;
+        mEnd   = remain;
+    }
+
+    if (writable() < len) {
+        size_t capacity = mBuffer.size() > 0? mBuffer.size() : SACE_STREAM_READ_SIZE;
+        while (capacity - mEnd < len)
+            capacity *= 2;
+
+        mBuffer.resize(capacity);
+    }
+
+    return &mBuffer[mEnd];
+}
+
+enum SaceStreamBuffer::FrameState SaceStreamBuffer::nextFrame (const uint8_t **data, uint32_t *len) const {
+    if (pending() < SACE_FRAME_LEN_SIZE)
+        return FRAME_NONE;
+
+    uint32_t frame_len;
+    memcpy(&frame_len, &mBuffer[mStart], sizeof(frame_len));
+
+    if (frame_len < mMinFrame || frame_len > SACE_MAX_FRAME_SIZE)
+        return FRAME_INVALID;
+
+    if (pending() < frame_len)
+        return FRAME_NONE;
+
+    *data = &mBuffer[mStart];
+    *len  = frame_len;
+    return FRAME_READY;
+}
+
+void SaceStreamBuffer::consume (size_t len) {
+    mStart += len;
+
+    /* drained, restart at the front without copying */
+    if (mStart >= mEnd)
+        mStart = mEnd = 0;
+}
+
+void SaceStreamBuffer::clear () {
+    mStart = mEnd = 0;
+}
+
+}; //namespace android
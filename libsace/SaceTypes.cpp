@@ -11,15 +11,21 @@
  * limitations under the License.
  */
 
+#include <sys/mman.h>
+#include <fcntl.h>
+
 #include "sace/SaceTypes.h"
 
 namespace android {
+#define SACE_SCRIPT_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
 uint16_t SaceCommandHeader::mSequence = 0;
 
 void SaceCommandHeader::reserveSpace (Parcel *data) const {
     data->writeUint32(0);
     data->writeByte(static_cast<int8_t>(type));
     data->writeUint32(sequence);
+    data->writeInt64(deadline);
 }
 
 status_t SaceCommandHeader::writeToParcel (Parcel *data) const {
@@ -36,12 +42,13 @@ status_t SaceCommandHeader::readFromParcel (const Parcel *data) {
     len  = data->readUint32();
     type = static_cast<enum SaceCommandType>(data->readByte());
     sequence = data->readUint32();
+    deadline = data->readInt64();
 
     return OK;
 }
 
 uint32_t SaceCommandHeader::parcelSize () {
-    return sizeof(uint32_t)*2 + sizeof(int8_t);
+    return sizeof(uint32_t)*2 + sizeof(int8_t) + sizeof(int64_t);
 }
 
 string SaceCommandHeader::mapCmdTypeStr (enum SaceCommandType type) {
@@ -52,6 +59,8 @@ string SaceCommandHeader::mapCmdTypeStr (enum SaceCommandType type) {
             return "SACE_TYPE_SERVICE";
         case SACE_TYPE_EVENT:
             return "SACE_TYPE_EVENT";
+        case SACE_TYPE_BATCH:
+            return "SACE_TYPE_BATCH";
         default:
             return "UNKNOWN";
     }
@@ -80,6 +89,12 @@ status_t SaceCommand::writeToParcel (Parcel *data) const {
         data->writeByte(static_cast<int8_t>(eventFlags));
     }
 
+    data->writeBool(script != nullptr);
+    if (script)
+        data->writeFileDescriptor(script->get());
+
+    data->writeUtf8VectorAsUtf16Vector(argv);
+
     /* Note : Must be last */
     if (command_params) {
         data->writeBool(true);
@@ -88,16 +103,35 @@ status_t SaceCommand::writeToParcel (Parcel *data) const {
     else
         data->writeBool(false);
 
+    /* sub commands are written in place, the outer len is fixed up last */
+    if (type == SACE_TYPE_BATCH) {
+        data->writeUint32(batch.size());
+        for (auto &cmd : batch)
+            cmd.writeToParcel(data);
+    }
+
     return SaceCommandHeader::writeToParcel(data);
 }
 
 status_t SaceCommand::readFromParcel (const Parcel *data) {
+    return readFromParcel(data, false);
+}
+
+status_t SaceCommand::readFromParcel (const Parcel *data, bool nested) {
     SaceCommandHeader::readFromParcel(data);
+    /* the peer could nest batches without bound, refuse before recursing */
+    if (nested && type == SACE_TYPE_BATCH)
+        return BAD_VALUE;
 
     label = data->readUint64();
     data->readUtf8FromUtf16(&name);
     data->readUtf8FromUtf16(&command);
     extraLen = data->readUint32();
+    /* the peer is not trusted, extra is a fixed buffer */
+    if (extraLen > EXTRA_BUFER_LEN) {
+        extraLen = 0;
+        return BAD_VALUE;
+    }
     data->read(extra, extraLen);
 
     if (type == SACE_TYPE_NORMAL) {
@@ -113,12 +147,34 @@ status_t SaceCommand::readFromParcel (const Parcel *data) {
         eventFlags = static_cast<enum SaceEventFlags>(data->readByte());
     }
 
+    script = nullptr;
+    if (data->readBool()) {
+        /* binder parcels own the fd, stream transports attach it after parsed */
+        int fd = data->readFileDescriptor();
+        script = make_shared<SaceFd>(fd >= 0 && data->objectsCount() > 0? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1);
+    }
+
+    data->readUtf8VectorFromUtf16Vector(&argv);
+
     /* Note : Must be last */
     if (data->readBool()) {
         command_params = (type == SACE_TYPE_EVENT)? make_shared<SaceEventParams>() : make_shared<SaceCommandParams>();
         command_params->readFromParcel(data);
     }
 
+    batch.clear();
+    if (type == SACE_TYPE_BATCH) {
+        uint32_t count = data->readUint32();
+        if (count > SACE_MAX_BATCH_COMMANDS)
+            return BAD_VALUE;
+
+        batch.resize(count);
+        for (auto &cmd : batch) {
+            if (cmd.readFromParcel(data, true) != OK)
+                return BAD_VALUE;
+        }
+    }
+
     return OK;
 }
 
@@ -134,6 +190,8 @@ string SaceCommand::mapServiceCmdTypeStr (enum SaceServiceCommandType type) {
             return "SACE_SERVICE_CMD_PAUSE";
         case SACE_SERVICE_CMD_RESTART:
             return "SACE_SERVICE_CMD_RESTART";
+        case SACE_SERVICE_CMD_CANCEL:
+            return "SACE_SERVICE_CMD_CANCEL";
         default:
             return "UNKNOWN";
     }
@@ -156,6 +214,8 @@ string SaceCommand::mapNormalCmdTypeStr (enum SaceNormalCommandType type) {
             return "SACE_NORMAL_CMD_START";
         case SACE_NORMAL_CMD_CLOSE:
             return "SACE_NORMAL_CMD_CLOSE";
+        case SACE_NORMAL_CMD_CANCEL:
+            return "SACE_NORMAL_CMD_CANCEL";
         default:
             return "UNKNOWN";
     }
@@ -215,11 +275,50 @@ const string SaceCommand::to_string() const {
         cmdDescriptor.append(" eventType="  + mapEventTypeStr(eventType));
         cmdDescriptor.append(" eventFlags=" + mapEventFlagStr(eventFlags));
     }
+    else if (type == SACE_TYPE_BATCH)
+        cmdDescriptor.append(" batch=" + ::to_string(batch.size()));
+
+    if (script)
+        cmdDescriptor.append(" script=" + ::to_string(script->get()));
+
+    if (!argv.empty())
+        cmdDescriptor.append(" argv=" + ::to_string(argv.size()));
 
     cmdDescriptor.append("}");
     return cmdDescriptor;
 }
 
+int SaceCommand::createScript (const string &body) {
+    size_t written = 0;
+    int fd = memfd_create("sace_script", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    while (written < body.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, body.data() + written, body.size() - written));
+        if (ret <= 0)
+            goto fail;
+
+        written += ret;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, SACE_SCRIPT_SEALS) < 0)
+        goto fail;
+
+    return fd;
+fail:
+    close(fd);
+    return -1;
+}
+
+bool SaceCommand::sealedScript (int fd) {
+    if (fd < 0)
+        return false;
+
+    int seals = fcntl(fd, F_GET_SEALS);
+    return seals >= 0 && (seals & SACE_SCRIPT_SEALS) == SACE_SCRIPT_SEALS;
+}
+
 // SaceResultHeader --------------------------------------------
 uint32_t SaceResultHeader::parcelSize () {
     return sizeof(uint32_t) + sizeof(int8_t) + sizeof(uint64_t);
@@ -259,6 +358,7 @@ void SaceResult::operator= (const SaceResult &rslt) {
     resultFd = rslt.resultFd;
     resultExtraLen = rslt.resultExtraLen;
     memcpy(resultExtra, rslt.resultExtra, resultExtraLen);
+    results = rslt.results;
 }
 
 status_t SaceResult::writeToParcel (Parcel *data) const {
@@ -274,6 +374,13 @@ status_t SaceResult::writeToParcel (Parcel *data) const {
     if (resultType == SACE_RESULT_TYPE_FD)
         data->writeFileDescriptor(resultFd);
 
+    /* sub results are written in place, the outer len is fixed up last */
+    if (resultType == SACE_RESULT_TYPE_BATCH) {
+        data->writeUint32(results.size());
+        for (auto &rslt : results)
+            rslt.writeToParcel(data);
+    }
+
     return SaceResultHeader::writeToParcel(data);
 }
 
@@ -285,11 +392,28 @@ status_t SaceResult::readFromParcel (const Parcel *data) {
     resultType   = static_cast<enum SaceResultType>(data->readByte());
     resultStatus = static_cast<enum SaceResultStatus>(data->readByte());
     resultExtraLen = data->readUint32();
+    if (resultExtraLen > EXTRA_BUFER_LEN) {
+        resultExtraLen = 0;
+        return BAD_VALUE;
+    }
     data->read(resultExtra, resultExtraLen);
 
    if (resultType == SACE_RESULT_TYPE_FD)
         resultFd = data->readFileDescriptor();
 
+    results.clear();
+    if (resultType == SACE_RESULT_TYPE_BATCH) {
+        uint32_t count = data->readUint32();
+        if (count > SACE_MAX_BATCH_COMMANDS)
+            return BAD_VALUE;
+
+        results.resize(count);
+        for (auto &rslt : results) {
+            if (rslt.readFromParcel(data) != OK)
+                return BAD_VALUE;
+        }
+    }
+
     return OK;
 }
 
@@ -307,6 +431,8 @@ string SaceResult::mapResultTypeStr (enum SaceResultType type) {
             return "SACE_RESULT_TYPE_START";
         case SACE_RESULT_TYPE_CLOSE:
             return "SACE_RESULT_TYPE_CLOSE";
+        case SACE_RESULT_TYPE_BATCH:
+            return "SACE_RESULT_TYPE_BATCH";
         default:
             return "UNKNOWN";
     }
@@ -322,6 +448,10 @@ string SaceResult::mapResultStatusStr (enum SaceResultStatus status) {
             return "SACE_RESULT_STATUS_SECURE";
         case SACE_RESULT_STATUS_TIMEOUT:
             return "SACE_RESULT_STATUS_TIMEOUT";
+        case SACE_RESULT_STATUS_BUSY:
+            return "SACE_RESULT_STATUS_BUSY";
+        case SACE_RESULT_STATUS_CANCELLED:
+            return "SACE_RESULT_STATUS_CANCELLED";
         default:
             return "UNKNOWN";
     }
@@ -336,6 +466,9 @@ const string SaceResult::to_string() const {
         .append(" resultStatus=" + mapResultStatusStr(resultStatus))
         .append(" resultFd=" + ::to_string(resultFd));
 
+    if (resultType == SACE_RESULT_TYPE_BATCH)
+        resultDescriptor.append(" results=" + ::to_string(results.size()));
+
     resultDescriptor.append("}");
     return resultDescriptor;
 }
@@ -369,6 +502,10 @@ status_t SaceStatusResponse::readFromParcel (const Parcel *data) {
     type   = static_cast<enum SaceResponseType>(data->readByte());
     status = static_cast<enum SaceResponseStatus>(data->readByte());
     extraLen = data->readUint32();
+    if (extraLen > EXTRA_BUFER_LEN) {
+        extraLen = 0;
+        return BAD_VALUE;
+    }
     data->read(extra, extraLen);
 
     return OK;
@@ -26,6 +26,7 @@
 
 #define SACE_SENDER_SOCKEET 0x01
 #define SACE_SENDER_BINDER  0x02
+#define SACE_SENDER_SHM     0x03
 
 namespace android {
 
@@ -52,6 +53,12 @@ class SaceManager : public SaceSender::Callback {
 
     sp<SaceServiceObj> queryService (const char* name);
     sp<SaceServiceObj> queryEventService (const char* name);
+
+    /* saced drops the command unstarted once timeout_ms has passed */
+    SaceResult excute (SaceCommand &cmd, int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    vector<SaceResult> excuteBatch (const vector<SaceCommand> &cmds, int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    sp<SaceCommandObj> commandByResult (const SaceCommand &cmd, const SaceResult &rslt, bool in);
+    sp<SaceServiceObj> serviceByInfo (const SaceCommand &cmd, const SaceResult &rslt);
 public:
     static SaceManager* getInstance ();
 
@@ -60,10 +67,30 @@ public:
         mCallback = callback;
     }
 
-    sp<SaceCommandObj> runCommand (const char* cmd, shared_ptr<SaceCommandParams> = nullptr, bool in = true);
-    sp<SaceServiceObj> checkService (const char* name, const char* cmd = nullptr, shared_ptr<SaceCommandParams> params = nullptr);
+    /* timeout_ms : how long to wait for saced, it won't start the command any later */
+    sp<SaceCommandObj> runCommand (const char* cmd, shared_ptr<SaceCommandParams> = nullptr, bool in = true,
+        int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    /* argv[0] is looked up in PATH and exec'd by saced directly, no sh in between */
+    sp<SaceCommandObj> runCommand (const vector<string> &argv, shared_ptr<SaceCommandParams> param = nullptr, bool in = true,
+        int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    /* body goes to saced as a sealed memfd and runs with sh, name only identifies it */
+    sp<SaceCommandObj> runScript (const char* name, const string &body, shared_ptr<SaceCommandParams> param = nullptr, bool in = true,
+        int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    sp<SaceServiceObj> checkService (const char* name, const char* cmd = nullptr, shared_ptr<SaceCommandParams> params = nullptr,
+        int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
     int addEvent (const char* name, const char* cmd, shared_ptr<SaceEventParams> param = nullptr);
     int deleteEvent (const char* name, bool stop = true);
+
+    /* bulk calls, one round trip per SACE_MAX_BATCH_COMMANDS, results in request order */
+    vector<sp<SaceCommandObj>> runCommands (const vector<string> &cmds, shared_ptr<SaceCommandParams> param = nullptr, bool in = true,
+        int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    /* pairs of service name and command, a missing service is started when its command is not empty */
+    vector<sp<SaceServiceObj>> checkServices (const vector<pair<string, string>> &services, shared_ptr<SaceCommandParams> param = nullptr,
+        int timeout_ms = SACE_DEFAULT_TIMEOUT_MS);
+    vector<bool> stopServices (const vector<sp<SaceServiceObj>> &services);
+    /* pairs of event name and command */
+    vector<int> addEvents (const vector<pair<string, string>> &events, shared_ptr<SaceEventParams> param = nullptr);
+    vector<int> deleteEvents (const vector<string> &names, bool stop = true);
 protected:
     virtual void onResponse (const SaceStatusResponse &response);
 };
@@ -38,6 +38,9 @@ enum ErrorCode {
     ERR_EXIT_USER,
     ERR_NOT_EXISTS,
     ERR_UNKNOWN,
+    /* appended only, the values are shared with ErrorCode.java */
+    ERR_BUSY,
+    ERR_CANCELLED,
 };
 
 enum ErrorCode response_to_error (SaceResponseStatus status);
@@ -63,13 +66,25 @@ public:
         mCmdCallback = nullptr;
     }
 
+    /* failed but still cancelable, saced may have started it after we gave up */
+    SaceCmdObj (sp<SaceSender> obj, Callback& callback, enum ErrorCode code) {
+        mCmdSender = obj;
+        mCmdCallback = callback;
+        mError = code;
+    }
+
     enum ErrorCode getError () {
         AutoMutex _lock(error_mutex);
         return mError;
     }
 
 protected:
+    bool connected () const {
+        return mCmdSender != nullptr;
+    }
+
     SaceResult excute (SaceCommand &cmd) {
+        cmd.setTimeout(SACE_DEFAULT_TIMEOUT_MS);
         return mCmdSender->excuteCommand(cmd);
     }
 
@@ -102,6 +117,16 @@ public:
     SaceCommandObj (enum ErrorCode code, string cmd, uint64_t label):SaceCmdObj(code) {
         this->label = label;
         this->cmd = cmd;
+        this->fd  = -1;
+        this->in  = true;
+    }
+
+    SaceCommandObj (sp<SaceSender> obj, enum ErrorCode code, string cmd, uint64_t label, Callback& callback)
+        :SaceCmdObj(obj, callback, code) {
+        this->label = label;
+        this->cmd = cmd;
+        this->fd  = -1;
+        this->in  = true;
     }
 
     ~SaceCommandObj () {
@@ -115,6 +140,8 @@ public:
     int read (char *buf, int len);
     int write (char *buf, int len);
     void close();
+    /* kill it now, or drop its start if saced still has it queued */
+    bool cancel();
 };
 
 // ----------------------------------------------
@@ -141,9 +168,18 @@ public:
         this->label = label;
     }
 
+    SaceServiceObj (sp<SaceSender> obj, enum ErrorCode code, string name, string command, uint64_t label, Callback& callback)
+        :SaceCmdObj(obj, callback, code) {
+        this->name = name;
+        this->command = command;
+        this->label = label;
+    }
+
     bool stop();
     bool pause();
     bool restart();
+    /* SIGKILL instead of stop, or drop its start if saced still has it queued */
+    bool cancel();
 
     string getName() {
         return name;
@@ -96,48 +96,66 @@ struct EventParams : public RefBase {
     vector<shared_ptr<Trigger>> triggers;
 };
 
-/* User friendly Comamnd Params */
+/* User friendly Comamnd Params
+ * ids are sent as numbers unless given by name, rlimits as they are.
+ * saced keeps what it resolved by the encoded bytes, a repeated identity
+ * costs no parsing nor passwd lookup.
+ */
 class SaceEvent;
 class SaceCommandParams : public Parcelable {
+    static const size_t MAX_CACHED_PARAMS;
+
     string uid;
     string gid;
     vector<string> supp_gids;
-    vector<string> rlimits;
+    vector<pair<int, rlimit>> rlimits;
     string  seclabel;
     CapSet capabilities;
+    /* encoded bytes as received, empty once changed */
+    string fingerprint;
 
     friend class SaceEvent;
 private:
     bool decode_uid (string uid_str, uid_t* uid) const;
+    sp<CommandParams> resolve (bool *complete) const;
+    string getFingerprint () const;
+
+    static void writeId (Parcel* parcel, const string &id);
+    static status_t readId (const Parcel* parcel, string *id);
 
 public:
     virtual ~SaceCommandParams () {}
 
     void set_uid (uid_t uid)  { set_uid(::to_string(uid)); }
-    void set_uid (string uid) { this->uid = uid; }
+    void set_uid (string uid) { this->uid = uid; fingerprint.clear(); }
 
     void set_gid (gid_t gid)  { set_gid(::to_string(gid)); }
-    void set_gid (string gid) { this->gid = gid; }
+    void set_gid (string gid) { this->gid = gid; fingerprint.clear(); }
 
     void add_gids (gid_t gid)  { add_gids(::to_string(gid)); }
-    void add_gids (string gid) { supp_gids.push_back(gid);   }
+    void add_gids (string gid) { supp_gids.push_back(gid); fingerprint.clear(); }
 
-    void set_seclabel (string seclabel) { this->seclabel = seclabel; }
+    void set_seclabel (string seclabel) { this->seclabel = seclabel; fingerprint.clear(); }
 
     bool set_capabilities (unsigned int cap) {
         if (cap >= capabilities.size())
             return false;
 
         capabilities[cap] = true;
+        fingerprint.clear();
         return true;
     }
 
+    /* a negative limit is RLIM_INFINITY */
     void add_rlimits (int rlimit, int soft, int hard) {
-        stringstream in_stream;
-        in_stream<<rlimit<<soft<<hard;
-        rlimits.push_back(in_stream.str());
+        struct rlimit limit;
+        limit.rlim_cur = soft < 0? RLIM_INFINITY : (rlim_t)soft;
+        limit.rlim_max = hard < 0? RLIM_INFINITY : (rlim_t)hard;
+        rlimits.push_back(pair<int, struct rlimit>(rlimit, limit));
+        fingerprint.clear();
     }
 
+    /* shared with every command of the same params, read only */
     sp<CommandParams> parseCommandParams () const;
 
     virtual status_t writeToParcel (Parcel* parcel) const override;
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_RING_H
+#define _SACE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+#include <sace/SaceStream.h>
+
+using namespace std;
+
+/* Shared-memory transport : the client creates a sealed memfd holding a
+ * submission ring (client -> saced) and a completion ring (saced -> client),
+ * plus one eventfd doorbell per ring, and passes them over SACE_SHM_SOCKET_NAME.
+ * The socket stays connected for peer death and for fds of FD results.
+ */
+#define SACE_SHM_SOCKET_NAME   "sace_shm"
+#define SACE_SHM_MAGIC         0x53414345  /* SACE */
+#define SACE_RING_DATA_SIZE    (128 * 1024)
+#define SACE_RING_CACHELINE    64
+
+/* fds of the handshake, in order */
+enum SaceShmFd {
+    SACE_SHM_FD_MEMORY,
+    SACE_SHM_FD_SUBMIT_BELL,
+    SACE_SHM_FD_COMPLETE_BELL,
+    SACE_SHM_FD_NUM,
+};
+
+namespace android {
+
+/* head/tail are free running byte counters, each on its own cache line */
+struct SaceRingHeader {
+    alignas(SACE_RING_CACHELINE) atomic<uint32_t> head;        /* producer */
+    alignas(SACE_RING_CACHELINE) atomic<uint32_t> tail;        /* consumer */
+    alignas(SACE_RING_CACHELINE) atomic<uint32_t> needWakeup;  /* consumer going to sleep */
+    alignas(SACE_RING_CACHELINE) atomic<uint32_t> needSpace;   /* producer waiting for room */
+    uint32_t magic;
+    uint32_t size;
+};
+
+/* single producer single consumer ring of length-prefixed frames.
+ * the peer maps the same memory, so size is kept privately and every
+ * frame length read from it is validated.
+ */
+class SaceRing {
+    SaceRingHeader *mHeader;
+    uint8_t *mData;
+    uint32_t mSize;
+
+    void copyIn (uint32_t pos, const uint8_t *data, uint32_t len);
+    void copyOut (uint32_t pos, uint8_t *data, uint32_t len) const;
+public:
+    SaceRing () {
+        mHeader = nullptr;
+        mData   = nullptr;
+        mSize   = 0;
+    }
+
+    static size_t regionSize (uint32_t size) {
+        return (sizeof(SaceRingHeader) + size + SACE_RING_CACHELINE - 1) & ~(size_t)(SACE_RING_CACHELINE - 1);
+    }
+
+    /* creator formats, peer attaches and checks */
+    void init (void *base, uint32_t size);
+    bool attach (void *base, uint32_t size);
+
+    /* producer side, false if no room */
+    bool push (const uint8_t *data, uint32_t len);
+    /* true if the consumer must be woken up by the doorbell */
+    bool needWakeup ();
+    /* arm needSpace after a failed push, false if room appeared meanwhile */
+    bool prepareFull (uint32_t len);
+
+    /* consumer side */
+    enum SaceStreamBuffer::FrameState pop (vector<uint8_t> &frame, uint32_t min_frame);
+    bool empty () const;
+    /* arm needWakeup before sleeping, false if frames arrived meanwhile */
+    bool prepareWait ();
+    void finishWait ();
+    /* true if the producer must be told by the other doorbell that room is back */
+    bool needSpace ();
+};
+
+/* both rings in one mapping */
+class SaceShmRegion {
+    void  *mBase;
+    size_t mLen;
+public:
+    SaceRing submit;
+    SaceRing complete;
+
+    SaceShmRegion () {
+        mBase = nullptr;
+        mLen  = 0;
+    }
+
+    ~SaceShmRegion () {
+        unmap();
+    }
+
+    static size_t mapSize () {
+        return SaceRing::regionSize(SACE_RING_DATA_SIZE) * 2;
+    }
+
+    /* client : create, size, seal and format the memfd */
+    int create ();
+    /* saced : map a client memfd, must be sealed against resize */
+    bool map (int memfd);
+    void unmap ();
+};
+
+}; //namespace android
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_STREAM_H
+#define _SACE_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+/* Every SaceCommand/SaceResult/SaceStatusResponse parcel starts with its
+ * total size (SaceCommandHeader::len / SaceResultHeader::len), which is
+ * used as the frame length on stream sockets and pipes.
+ */
+#define SACE_FRAME_LEN_SIZE    sizeof(uint32_t)
+#define SACE_MAX_FRAME_SIZE    (64 * 1024)
+#define SACE_STREAM_READ_SIZE  1024
+/* fds carried by one recvmsg, results are coalesced by the daemon */
+#define SACE_MAX_RECV_FDS      16
+
+namespace android {
+
+class SaceStreamBuffer {
+    vector<uint8_t> mBuffer;
+    size_t mStart;
+    size_t mEnd;
+    size_t mMinFrame;
+
+public:
+    enum FrameState {
+        FRAME_NONE,     /* need more bytes */
+        FRAME_READY,    /* a complete frame is available */
+        FRAME_INVALID,  /* corrupted length, stream can't be resynchronized */
+    };
+
+    explicit SaceStreamBuffer (size_t min_frame = SACE_FRAME_LEN_SIZE) {
+        mStart = mEnd = 0;
+        mMinFrame = min_frame;
+    }
+
+    /* make room for at least len bytes, return where to receive them */
+    uint8_t* reserve (size_t len = SACE_STREAM_READ_SIZE);
+
+    /* bytes writable at reserve() pointer */
+    size_t writable () const {
+        return mBuffer.size() - mEnd;
+    }
+
+    void commit (size_t len) {
+        mEnd += len;
+    }
+
+    /* buffered bytes not consumed yet */
+    size_t pending () const {
+        return mEnd - mStart;
+    }
+
+    /* peek the next complete frame, must consume() it after handled */
+    enum FrameState nextFrame (const uint8_t **data, uint32_t *len) const;
+    void consume (size_t len);
+    void clear ();
+};
+
+}; //namespace android
+
+#endif
@@ -20,6 +20,8 @@
 #include <binder/Parcelable.h>
 #include <binder/Parcel.h>
 #include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <unistd.h>
 
 #include <sace/SaceServiceInfo.h>
 #include <sace/SaceParams.h>
@@ -27,6 +29,10 @@
 using namespace std;
 
 #define SACE_RESULT_BUF_SIZE  1024
+/* all fds of a batch go out in one SCM_RIGHTS, bounded by SACE_MAX_RECV_FDS */
+#define SACE_MAX_BATCH_COMMANDS  16
+/* how long a client waits for a result unless the call says otherwise */
+#define SACE_DEFAULT_TIMEOUT_MS  3000
 
 #define LABEL_TO_SEQUENCE(x)     static_cast<uint32_t>(static_cast<uint64_t>(x) & 0xFFFFFFFF)
 #define SEQUENCE_TO_LABEL(x, y)  ((static_cast<uint64_t>(x) & 0xFFFFFFFF) | (static_cast<uint64_t>(y) << 32))
@@ -39,6 +45,7 @@ enum SaceCommandType: int8_t {
     SACE_TYPE_NORMAL,
     SACE_TYPE_SERVICE,
     SACE_TYPE_EVENT,
+    SACE_TYPE_BATCH,
 };
 
 class SaceCommandHeader : public Parcelable, public RefBase {
@@ -49,6 +56,8 @@ public:
     uint32_t len;
     enum SaceCommandType type;
     uint32_t sequence;
+    /* CLOCK_MONOTONIC ns the client stops waiting at, 0 never expires */
+    int64_t deadline;
 
     SaceCommandHeader () {
         init();
@@ -58,22 +67,33 @@ public:
         len  = command.len;
         type = command.type;
         sequence = command.sequence;
+        deadline = command.deadline;
     }
 
     void init () {
         len  = 0;
         type = SACE_TYPE_NORMAL;
         sequence = gettid() << 16 | ++mSequence;
+        deadline = 0;
     }
 
     SaceCommandHeader& operator= (const SaceCommandHeader &header) {
         len  = header.len;
         type = header.type;
         sequence = header.sequence;
+        deadline = header.deadline;
 
         return *this;
     }
 
+    void setTimeout (int timeout_ms) {
+        deadline = timeout_ms > 0? systemTime(SYSTEM_TIME_MONOTONIC) + milliseconds_to_nanoseconds(timeout_ms) : 0;
+    }
+
+    bool expired () const {
+        return deadline > 0 && systemTime(SYSTEM_TIME_MONOTONIC) >= deadline;
+    }
+
     // must invoke after SubClass
     virtual status_t writeToParcel (Parcel *data) const override;
     // must invoke before SubClass
@@ -91,12 +111,14 @@ enum SaceServiceCommandType: int8_t {
     SACE_SERVICE_CMD_PAUSE,
     SACE_SERVICE_CMD_RESTART,
     SACE_SERVICE_CMD_INFO,
+    SACE_SERVICE_CMD_CANCEL,    /* label carries the target, kill it or drop its queued start */
 };
 
 enum SaceNormalCommandType: int8_t {
     SACE_NORMAL_CMD_START,
     SACE_NORMAL_CMD_CLOSE,
     SACE_NORMAL_CMD_DESTROY,
+    SACE_NORMAL_CMD_CANCEL,     /* label carries the target, kill it or drop its queued start */
 };
 
 enum SaceEventType: int8_t {
@@ -120,6 +142,23 @@ enum SaceEventFlags: int8_t {
     SACE_EVENT_FLAG_RESTART,
 };
 
+/* fd shared by SaceCommand copies, closed with the last one */
+class SaceFd {
+    int mFd;
+public:
+    explicit SaceFd (int fd = -1):mFd(fd) {}
+    ~SaceFd () {
+        if (mFd >= 0) close(mFd);
+    }
+
+    SaceFd (const SaceFd&) = delete;
+    SaceFd& operator= (const SaceFd&) = delete;
+
+    int get () const {
+        return mFd;
+    }
+};
+
 class SaceCommand : public SaceCommandHeader {
 public:
     uint64_t label;
@@ -128,6 +167,12 @@ public:
     shared_ptr<SaceCommandParams> command_params;
     uint8_t  extra[EXTRA_BUFER_LEN];
     uint32_t extraLen;
+    /* SACE_TYPE_BATCH : sub commands, any type but batch */
+    vector<SaceCommand> batch;
+    /* sealed memfd ran by sh instead of command, no size limit */
+    shared_ptr<SaceFd> script;
+    /* exec'd as is without sh, command only names it then */
+    vector<string> argv;
 
     union {
         /* SACE_TYPE_SERVICE */
@@ -158,6 +203,9 @@ public:
         command = "";
         command_params = nullptr;
         extraLen = 0;
+        batch.clear();
+        script = nullptr;
+        argv.clear();
         normalCmdType = SACE_NORMAL_CMD_START;
         flags = SACE_CMD_FLAG_IN;
     }
@@ -173,6 +221,9 @@ public:
         command_params = cmd.command_params;
         extraLen = cmd.extraLen;
         memcpy(extra, cmd.extra, extraLen);
+        batch = cmd.batch;
+        script = cmd.script;
+        argv = cmd.argv;
 
         if (type == SACE_TYPE_SERVICE) {
             serviceCmdType = cmd.serviceCmdType;
@@ -197,6 +248,9 @@ public:
         extraLen = cmd.extraLen;
         memcpy(extra, cmd.extra, extraLen);
         command_params = cmd.command_params;
+        batch = cmd.batch;
+        script = cmd.script;
+        argv = cmd.argv;
 
         if (type == SACE_TYPE_SERVICE) {
             serviceCmdType = cmd.serviceCmdType;
@@ -225,7 +279,16 @@ public:
     static string mapEventFlagStr (enum SaceEventFlags flag);
     static string mapEventTypeStr (enum SaceEventType type);
 
+    /* memfd holding body with every seal applied, -1 on failure */
+    static int createScript (const string &body);
+    /* saced only runs scripts which can't change after checked */
+    static bool sealedScript (int fd);
+
     const string to_string() const;
+
+private:
+    /* a sub command of a batch may not be a batch itself */
+    status_t readFromParcel (const Parcel *data, bool nested);
 };
 
 // ----------------------------------------------------
@@ -277,6 +340,8 @@ enum SaceResultStatus {
     SACE_RESULT_STATUS_FAIL,
     SACE_RESULT_STATUS_SECURE,
     SACE_RESULT_STATUS_EXISTS,
+    SACE_RESULT_STATUS_BUSY,    /* excutor queue full, retry later */
+    SACE_RESULT_STATUS_CANCELLED,
 };
 
 enum SaceResultType {
@@ -286,6 +351,7 @@ enum SaceResultType {
     SACE_RESULT_TYPE_FD,
     SACE_RESULT_TYPE_EXTRA,
     SACE_RESULT_TYPE_LABEL,
+    SACE_RESULT_TYPE_BATCH,
 };
 
 class SaceResult : public SaceResultHeader {
@@ -297,6 +363,8 @@ public:
     uint8_t  resultExtra[EXTRA_BUFER_LEN];
     uint32_t resultExtraLen;
     int resultFd;
+    /* SACE_RESULT_TYPE_BATCH : one result per sub command, in command order */
+    vector<SaceResult> results;
 
     virtual status_t writeToParcel (Parcel *data) const override;
     virtual status_t readFromParcel (const Parcel *data) override;
@@ -323,6 +391,7 @@ public:
         resultFd = rslt.resultFd;
         resultExtraLen = rslt.resultExtraLen;
         memcpy(resultExtra, rslt.resultExtra, resultExtraLen);
+        results = rslt.results;
     }
 
     const string to_string() const;
@@ -23,12 +23,20 @@ LIB_SACE_INCLUDE = $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../libsace/include
 LOCAL_SRC_FILES :=               \
 	SaceCommandDispatcher.cpp    \
 	SaceCommandMonitor.cpp       \
+	SaceConfig.cpp               \
 	SaceEvent.cpp 				 \
 	SaceExcutor.cpp				 \
 	sace_main.cpp				 \
 	SaceMessage.cpp				 \
+	SaceMessagePool.cpp			 \
 	SaceReader.cpp				 \
+	SaceSpawn.cpp				 \
+	SaceSpawner.cpp				 \
+	SaceStats.cpp				 \
+	SaceTimerWheel.cpp			 \
+	SaceUring.cpp				 \
 	SaceWriter.cpp				 \
+	SaceWorkerPool.cpp			 \
 
 LOCAL_C_INCLUDES := $(LIB_SACE_INCLUDE)
 LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libselinux libcap libsace libprocessgroup
@@ -18,30 +18,33 @@
 #include "sace/SaceLog.h"
 #include "SaceWriter.h"
 #include "SaceEvent.h"
+#include "SaceConfig.h"
 
 namespace android {
 
-void MessageDistributable::post (sp<SaceMessageHeader> msg) {
-    sp<MessageHandlerWrapper> wrapper = new MessageHandlerWrapper(this, msg);
-    mLooper->sendMessage(wrapper, Message(MessageHandlerWrapper::MESSAGE_HANDLER_ID));
+void MessageDistributable::post (const sp<SaceMessageHeader> &msg) {
+    mDispatcher->handleMessage(msg);
 }
 
-const int MessageDistributable::MessageHandlerWrapper::MESSAGE_HANDLER_ID = 0x01;
-void MessageDistributable::MessageHandlerWrapper::handleMessage (const Message &message) {
-    if (message.what == MESSAGE_HANDLER_ID)
-        self->mDispatcher->handleMessage(msg);
-    else
-        SACE_LOGW("MessageHandlerWrapper Invalide MessageType %d", message.what);
+void MessageDistributable::postUnlessExpired (const sp<SaceMessageHeader> &msg) {
+    if (expiredMessage(msg)) {
+        SaceStats::deadlineMissed(SACE_STAGE_READER);
+        rejectMessage(msg, SACE_RESULT_STATUS_TIMEOUT);
+        return;
+    }
+
+    post(msg);
 }
 
 // ----------------------------------------------------------------------------
-const int   SaceCommandDispatcher::POLL_WAIT_TIMEOUT = 1000; //1s
 const char* SaceCommandDispatcher::NAME = "SaceCommandDispatcher";
 
 shared_ptr<SaceCommandDispatcher> SaceCommandDispatcher::mInstance = make_shared<SaceCommandDispatcher>();
 
 SaceCommandDispatcher::SaceCommandDispatcher () {
-    mLooper = new Looper(false);
+    for (int i = 0; i < SACE_MESSAGE_HANDLER_MAX; i++)
+        mRoute[i] = nullptr;
+    mPool = nullptr;
 }
 
 shared_ptr<SaceCommandDispatcher> SaceCommandDispatcher::getInstance () {
@@ -56,62 +59,105 @@ shared_ptr<SaceCommandDispatcher> SaceCommandDispatcher::getInstance () {
     return mInstance;
 }
 
-void* SaceCommandDispatcher::dispatch_thread (void *data) {
-    SaceCommandDispatcher *dispatcher = reinterpret_cast<SaceCommandDispatcher*>(data);
-    sp<Looper> looper = dispatcher->mLooper;
+bool SaceCommandDispatcher::dispatch (const sp<SaceMessageHeader> &msg) {
+    if (msg->msgHandler < 0 || msg->msgHandler >= SACE_MESSAGE_HANDLER_MAX)
+        return false;
 
-    while (true) {
-        int ret = looper->pollOnce(SaceCommandDispatcher::POLL_WAIT_TIMEOUT);
-        if (ret == Looper::POLL_ERROR) {
-            SACE_LOGE("%s pollOnce fail errno=%d errstr=%s", SaceCommandDispatcher::NAME, errno, strerror(errno));
-            continue;
-        }
-        else if (ret == Looper::POLL_WAKE) {
-            SACE_LOGE("%s pollOnce awake errno=%d errstr=%s", SaceCommandDispatcher::NAME, errno, strerror(errno));
-            continue;
-        }
-        else if (ret == Looper::POLL_TIMEOUT) {
-            if (!dispatcher->mExit)
-                continue;
+    SaceExcutor *excutor = mRoute[msg->msgHandler];
+    if (excutor == nullptr)
+        return false;
 
-            break;
-        }
+    if (expiredMessage(msg)) {
+        SaceStats::deadlineMissed(SACE_STAGE_DISPATCHER);
+        rejectMessage(msg, SACE_RESULT_STATUS_TIMEOUT);
+        return true;
     }
 
-	return 0;
+    msg->msgPriority = priorityOfMsg(msg);
+    return excutor->excute(msg);
 }
 
-void SaceCommandDispatcher::handleMessage (sp<SaceMessageHeader> msg) {
-    bool handle = false;
+void SaceCommandDispatcher::handleMessage (const sp<SaceMessageHeader> &msg) {
+    if (msg->msgHandler == SACE_MESSAGE_HANDLER_BATCH)
+        handleBatchMessage(msg);
+    else if (!dispatch(msg))
+        handleDefaultMessage(msg);
+}
 
-    for (vector<SaceExcutor*>::iterator it = mExcutor.begin(); it != mExcutor.end(); it++) {
-        SaceExcutor *excutor = *it;
-        if (excutor->excute(msg))
-            handle = true;
+/* fan the sub commands out to their excutors, SaceBatchWriter gathers the results */
+void SaceCommandDispatcher::handleBatchMessage (const sp<SaceMessageHeader> &msg) {
+    SaceReaderMessage *batchMsg = msg->asReader();
+    if (batchMsg == nullptr)
+        return;
+
+    const sp<SaceCommand> &batchCmd = batchMsg->msgCmd;
+
+    if (batchCmd->batch.empty() || batchCmd->batch.size() > SACE_MAX_BATCH_COMMANDS) {
+        SACE_LOGE("%s invalid batch %s", NAME, batchCmd->to_string().c_str());
+
+        SaceResult result = resultByFailure();
+        result.sequence = batchCmd->sequence;
+        result.name = batchCmd->name;
+        batchMsg->msgWriter->sendResult(result);
+        return;
     }
 
-    if (!handle)
-        handleDefaultMessage(msg);
+    sp<SaceWriter> writer = new SaceBatchWriter(batchMsg->msgClient.pid, batchMsg->msgWriter, *batchCmd);
+    for (auto &cmd : batchCmd->batch) {
+        sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
+        saceMsg->msgHandler = typeCmdToMsg(cmd.type);
+        saceMsg->msgCmd     = new SaceCommand(cmd);
+        if (saceMsg->msgCmd->deadline == 0)
+            saceMsg->msgCmd->deadline = batchCmd->deadline;
+        saceMsg->msgWriter  = writer;
+        saceMsg->msgClient  = batchMsg->msgClient;
+
+        /* batches don't nest */
+        if (saceMsg->msgHandler != SACE_MESSAGE_HANDLER_BATCH && dispatch(saceMsg))
+            continue;
+
+        SaceResult result = resultByFailure();
+        result.sequence = cmd.sequence;
+        result.name = cmd.name;
+        writer->sendResult(result);
+    }
 }
 
-void SaceCommandDispatcher::handleDefaultMessage (sp<SaceMessageHeader> msg) {
+void SaceCommandDispatcher::handleDefaultMessage (const sp<SaceMessageHeader> &msg) {
     SACE_LOGI("handleDefaultMessage %s", SaceMessageHeader::mapIdToName(msg->msgHandler).c_str());
 }
 
+void SaceCommandDispatcher::dump (string &out) {
+    for (vector<SaceExcutor*>::iterator it = mExcutor.begin(); it != mExcutor.end(); it++)
+        (*it)->dump(out);
+
+    SaceStats::dump(out);
+}
+
 bool SaceCommandDispatcher::start () {
-    if (pthread_create(&dispatch_thread_t, nullptr, dispatch_thread, (void*)this) < 0) {
-        SACE_LOGE("%s Start dispatch_thread fail errno=%d errstr=%s", NAME, errno, strerror(errno));
+    /* excutor timeouts and pclose kills hang on it */
+    if (!SaceTimerWheel::getInstance()->start()) {
+        SACE_LOGE("%s timer wheel not started", NAME);
         return false;
     }
 
+    /* no workers keeps every excutor on its own thread */
+    mPool = new SaceWorkerPool();
+    if (!mPool->start(SaceConfig::excutorWorkers()))
+        SACE_LOGW("%s worker pool not started, excutors run on their own threads", NAME);
+
     /* It's dangerous to change the order. */
     mExcutor.push_back(new SaceServiceExcutor());
     mExcutor.push_back(new SaceNormalExcutor());
     mExcutor.push_back(new SaceEvent());
 
+    /* routes are in place before SaceEvent starts posting from init */
+    for (vector<SaceExcutor*>::iterator it = mExcutor.begin(); it != mExcutor.end(); it++)
+        mRoute[(*it)->handlerType()] = *it;
+
     for (vector<SaceExcutor*>::iterator it = mExcutor.begin(); it != mExcutor.end(); it++) {
         SaceExcutor *excutor = *it;
-        excutor->init();
+        excutor->init(mPool);
     }
 
     return true;
@@ -123,8 +169,18 @@ void SaceCommandDispatcher::stop () {
         excutor->uninit();
     }
 
-    mExit = true;
-    pthread_join(dispatch_thread_t, nullptr);
+    for (int i = 0; i < SACE_MESSAGE_HANDLER_MAX; i++)
+        mRoute[i] = nullptr;
+
+    /* strands are quiesced by uninit, workers only find empty deques */
+    if (mPool != nullptr) {
+        mPool->stop();
+        delete mPool;
+        mPool = nullptr;
+    }
+
+    /* last, uninit may still schedule (sace_pclose kill timers) */
+    SaceTimerWheel::getInstance()->stop();
 
     for (vector<SaceExcutor*>::reverse_iterator it = mExcutor.rbegin(); it != mExcutor.rend(); it++)
         delete *it;
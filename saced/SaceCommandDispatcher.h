@@ -18,67 +18,58 @@
 #define _SACE_CONTROL_CENTER_H
 
 #include <cutils/list.h>
-#include <utils/Looper.h>
 #include <utils/RefBase.h>
 #include <vector>
 
 #include "SaceMessage.h"
 #include "SaceExcutor.h"
+#include "SaceWorkerPool.h"
 
 namespace android {
 
 // Dispatch Command -----------------------------------------------------
+/* readers route straight into the excutor mailboxes, no dispatch thread */
 class SaceCommandDispatcher {
-    static const int   POLL_WAIT_TIMEOUT;
     static const char* NAME;
 
     static shared_ptr<SaceCommandDispatcher> mInstance;
-    sp<Looper> mLooper;
     vector<SaceExcutor*> mExcutor;
-    bool mExit;
-    pthread_t dispatch_thread_t;
+    /* indexed by SaceMessageHandlerType, fixed once started */
+    SaceExcutor* mRoute[SACE_MESSAGE_HANDLER_MAX];
+    /* shared by the keyed excutors */
+    SaceWorkerPool *mPool;
 
 public:
     SaceCommandDispatcher ();
 
     static shared_ptr<SaceCommandDispatcher> getInstance ();
-    friend class MessageDistributable;
 
-    void handleMessage (sp<SaceMessageHeader> msg);
-    void handleDefaultMessage (sp<SaceMessageHeader> msg);
+    /* runs in the posting thread */
+    void handleMessage (const sp<SaceMessageHeader> &msg);
+    void handleBatchMessage (const sp<SaceMessageHeader> &msg);
+    void handleDefaultMessage (const sp<SaceMessageHeader> &msg);
     bool start();
     void stop();
+    /* queue statistics of every excutor */
+    void dump (string &out);
 
 private:
-    static void *dispatch_thread (void *data);
+    bool dispatch (const sp<SaceMessageHeader> &msg);
 };
 
 // Put Message -----------------------------------------------------------------------
 class MessageDistributable {
-    sp<Looper> mLooper;
     shared_ptr<SaceCommandDispatcher> mDispatcher;
 
 public:
     explicit MessageDistributable () {
         mDispatcher = SaceCommandDispatcher::getInstance();
-        mLooper     = mDispatcher->mLooper;
     }
 
 protected:
-    void post(sp<SaceMessageHeader> msg);
-
-private:
-    class MessageHandlerWrapper : public MessageHandler {
-        MessageDistributable *self;
-        sp<SaceMessageHeader> msg;
-        void handleMessage (const Message &message);
-    public:
-        static const int MESSAGE_HANDLER_ID;
-        MessageHandlerWrapper (MessageDistributable *self, sp<SaceMessageHeader> message) {
-            this->self = self;
-            this->msg  = message;
-        }
-    };
+    void post(const sp<SaceMessageHeader> &msg);
+    /* readers : a spawn already past its deadline is answered TIMEOUT here */
+    void postUnlessExpired(const sp<SaceMessageHeader> &msg);
 };
 
 }; //namespace android
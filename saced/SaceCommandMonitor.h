@@ -32,6 +32,7 @@ class SaceCommandMonitor {
 public:
     SaceCommandMonitor () {
         mReaders.push_back(new SaceSocketReader(SOCKET_NAME, SOCK_STREAM));
+        mReaders.push_back(new SaceShmReader(SACE_SHM_SOCKET_NAME));
         mReaders.push_back(new SaceBinderReader());
     }
 
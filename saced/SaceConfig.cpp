@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sstream>
+#include <cutils/properties.h>
+#include <cutils/sched_policy.h>
+
+#include "SaceConfig.h"
+#include "sace/SaceLog.h"
+
+namespace android {
+#define MAX_SOCKET_SHARDS 16
+#define MAX_EXCUTOR_WORKERS 16
+#define MAX_SPAWN_HELPERS 8
+
+thread_local bool SaceConfig::mSchedApplied = false;
+
+int SaceConfig::getInt (const char *name, int def, int min, int max) {
+    int value = property_get_int32(name, def);
+    if (value < min || value > max) {
+        SACE_LOGW("SaceConfig %s=%d out of [%d, %d], use %d", name, value, min, max, def);
+        return def;
+    }
+
+    return value;
+}
+
+string SaceConfig::getString (const char *name, const char *def) {
+    char value[PROPERTY_VALUE_MAX];
+
+    if (property_get(name, value, def) <= 0)
+        return string(def);
+
+    return string(value);
+}
+
+int SaceConfig::socketShards () {
+    int shards = getInt("persist.sace.socket.shards", 1, 1, MAX_SOCKET_SHARDS);
+
+    /* more readers than cores only adds context switches */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0 && shards > cpus)
+        shards = (int)cpus;
+
+    return shards;
+}
+
+enum SaceShardPolicy SaceConfig::socketShardPolicy () {
+    string policy = getString("persist.sace.socket.policy", "rr");
+
+    if (policy == "least")
+        return SACE_SHARD_POLICY_LEAST_CONN;
+    else if (policy == "hash")
+        return SACE_SHARD_POLICY_HASH;
+    else if (policy != "rr")
+        SACE_LOGW("SaceConfig unkown socket policy %s, use rr", policy.c_str());
+
+    return SACE_SHARD_POLICY_ROUND_ROBIN;
+}
+
+bool SaceConfig::socketUring () {
+    return property_get_bool("persist.sace.socket.uring", true);
+}
+
+size_t SaceConfig::socketOutQueueBytes () {
+    return (size_t)getInt("persist.sace.socket.outq_kb", 256, 16, 16 * 1024) * 1024;
+}
+
+enum SaceOverflowPolicy SaceConfig::socketOverflowPolicy () {
+    string policy = getString("persist.sace.socket.overflow", "disconnect");
+
+    if (policy == "drop")
+        return SACE_OVERFLOW_DROP;
+    else if (policy != "disconnect")
+        SACE_LOGW("SaceConfig unkown overflow policy %s, use disconnect", policy.c_str());
+
+    return SACE_OVERFLOW_DISCONNECT;
+}
+
+int SaceConfig::excutorWorkers () {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int def = (cpus > 0 && cpus < 4)? (int)cpus : 4;
+
+    return getInt("persist.sace.excutor.workers", def, 0, MAX_EXCUTOR_WORKERS);
+}
+
+int SaceConfig::excutorQueueLimit () {
+    return getInt("persist.sace.excutor.queue", 256, 0, 64 * 1024);
+}
+
+enum SaceShedPolicy SaceConfig::excutorShedPolicy () {
+    string policy = getString("persist.sace.excutor.shed", "expired");
+
+    if (policy == "reject")
+        return SACE_SHED_REJECT;
+    else if (policy != "expired")
+        SACE_LOGW("SaceConfig unkown shed policy %s, use expired", policy.c_str());
+
+    return SACE_SHED_EXPIRED;
+}
+
+int SaceConfig::excutorExpireMs () {
+    /* clients give up after 3s */
+    return getInt("persist.sace.excutor.expire_ms", 3000, 100, 60 * 1000);
+}
+
+bool SaceConfig::spawner () {
+    return property_get_bool("persist.sace.spawner", false);
+}
+
+int SaceConfig::spawnerHelpers () {
+    return getInt("persist.sace.spawner.helpers", 2, 1, MAX_SPAWN_HELPERS);
+}
+
+SaceSchedConfig::SaceSchedConfig () {
+    hasCpus = false;
+    CPU_ZERO(&cpus);
+    hasNice = false;
+    nice    = 0;
+    policy  = SP_DEFAULT;
+    fifo    = 0;
+}
+
+bool SaceSchedConfig::empty () const {
+    return !hasCpus && !hasNice && policy == SP_DEFAULT && cpuset.empty() && fifo <= 0;
+}
+
+void SaceSchedConfig::apply (const char *name) const {
+    pid_t tid = gettid();
+
+    if (hasCpus && sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+        SACE_LOGE("%s sched_setaffinity errno=%d errstr=%s", name, errno, strerror(errno));
+
+    if (policy != SP_DEFAULT && set_sched_policy(tid, (SchedPolicy)policy) < 0)
+        SACE_LOGE("%s set_sched_policy %d errno=%d errstr=%s", name, policy, errno, strerror(errno));
+
+    /* after the policy, which may move the thread to its own cpuset */
+    if (!cpuset.empty()) {
+        string path = "/dev/cpuset/" + cpuset + "/tasks";
+        string task = ::to_string(tid);
+
+        int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || TEMP_FAILURE_RETRY(write(fd, task.c_str(), task.size())) < 0)
+            SACE_LOGE("%s join cpuset %s errno=%d errstr=%s", name, cpuset.c_str(), errno, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+    }
+
+    if (hasNice && setpriority(PRIO_PROCESS, tid, nice) < 0)
+        SACE_LOGE("%s setpriority %d errno=%d errstr=%s", name, nice, errno, strerror(errno));
+
+    if (fifo > 0) {
+        struct sched_param param;
+        param.sched_priority = fifo;
+        /* a clone of this thread is SCHED_OTHER again */
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) < 0)
+            SACE_LOGE("%s SCHED_FIFO %d errno=%d errstr=%s", name, fifo, errno, strerror(errno));
+    }
+}
+
+const string SaceSchedConfig::to_string () const {
+    string out;
+
+    if (hasCpus) {
+        out.append("cpus=");
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpus))
+                out.append(::to_string(cpu)).append(",");
+        }
+        out.back() = ' ';
+    }
+    if (hasNice)
+        out.append("nice=" + ::to_string(nice) + " ");
+    if (policy != SP_DEFAULT)
+        out.append("policy=" + ::to_string(policy) + " ");
+    if (!cpuset.empty())
+        out.append("cpuset=" + cpuset + " ");
+    if (fifo > 0)
+        out.append("fifo=" + ::to_string(fifo) + " ");
+
+    return out.empty()? string("inherit") : out;
+}
+
+/* 0-3,6 */
+bool SaceConfig::parseCpus (const string &list, cpu_set_t *cpus) {
+    stringstream ss(list);
+    string range;
+
+    CPU_ZERO(cpus);
+    while (getline(ss, range, ',')) {
+        char *end;
+        long first = strtol(range.c_str(), &end, 10);
+        long last  = first;
+
+        if (end == range.c_str())
+            return false;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+    }
+
+    return CPU_COUNT(cpus) > 0;
+}
+
+SaceSchedConfig SaceConfig::threadSched (enum SaceThreadRole role) {
+    SaceSchedConfig sched;
+    char name[PROPERTY_KEY_MAX];
+
+    snprintf(name, sizeof(name), "persist.sace.sched.%s", mapThreadRoleToName(role));
+    /* event triggers were always background work */
+    string spec = getString(name, role == SACE_THREAD_BACKGROUND? "policy=background nice=10" : "");
+
+    stringstream ss(spec);
+    string item;
+    while (ss >> item) {
+        size_t eq = item.find('=');
+        string key   = item.substr(0, eq);
+        string value = eq == string::npos? string() : item.substr(eq + 1);
+
+        if (key == "cpus") {
+            sched.hasCpus = parseCpus(value, &sched.cpus);
+            if (!sched.hasCpus)
+                SACE_LOGW("SaceConfig %s invalid cpus %s", name, value.c_str());
+        }
+        else if (key == "nice") {
+            sched.nice    = atoi(value.c_str());
+            sched.hasNice = sched.nice >= -20 && sched.nice <= 19;
+            if (!sched.hasNice)
+                SACE_LOGW("SaceConfig %s nice %s out of [-20, 19]", name, value.c_str());
+        }
+        else if (key == "policy") {
+            if (value == "background")
+                sched.policy = SP_BACKGROUND;
+            else if (value == "foreground")
+                sched.policy = SP_FOREGROUND;
+            else if (value == "system")
+                sched.policy = SP_SYSTEM;
+            else if (value == "top")
+                sched.policy = SP_TOP_APP;
+            else
+                SACE_LOGW("SaceConfig %s unkown policy %s", name, value.c_str());
+        }
+        else if (key == "cpuset") {
+            if (value.empty() || value.find("..") != string::npos)
+                SACE_LOGW("SaceConfig %s invalid cpuset %s", name, value.c_str());
+            else
+                sched.cpuset = value;
+        }
+        else if (key == "fifo") {
+            int prio = atoi(value.c_str());
+            if (prio < 0 || prio > sched_get_priority_max(SCHED_FIFO))
+                SACE_LOGW("SaceConfig %s fifo %s out of range", name, value.c_str());
+            else
+                sched.fifo = prio;
+        }
+        else
+            SACE_LOGW("SaceConfig %s unkown key %s", name, key.c_str());
+    }
+
+    return sched;
+}
+
+void SaceConfig::applyThreadSched (enum SaceThreadRole role) {
+    SaceSchedConfig sched = threadSched(role);
+    char name[32];
+
+    if (prctl(PR_GET_NAME, name) < 0)
+        strcpy(name, mapThreadRoleToName(role));
+
+    SACE_LOGI("%s sched %s : %s", name, mapThreadRoleToName(role), sched.to_string().c_str());
+    if (sched.empty())
+        return;
+
+    mSchedApplied = true;
+    sched.apply(name);
+}
+
+bool SaceConfig::threadSchedApplied () {
+    return mSchedApplied;
+}
+
+const char* SaceConfig::mapShardPolicyToName (enum SaceShardPolicy policy) {
+    switch (policy) {
+        case SACE_SHARD_POLICY_LEAST_CONN:
+            return "least";
+        case SACE_SHARD_POLICY_HASH:
+            return "hash";
+        default:
+            return "rr";
+    }
+}
+
+const char* SaceConfig::mapThreadRoleToName (enum SaceThreadRole role) {
+    switch (role) {
+        case SACE_THREAD_READER:
+            return "reader";
+        case SACE_THREAD_SERVICE:
+            return "service";
+        case SACE_THREAD_NORMAL:
+            return "normal";
+        case SACE_THREAD_EVENT:
+            return "event";
+        case SACE_THREAD_WORKER:
+            return "worker";
+        case SACE_THREAD_BACKGROUND:
+            return "background";
+        case SACE_THREAD_TIMER:
+            return "timer";
+        default:
+            return "unknown";
+    }
+}
+
+}; //namespace android
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_CONFIG_H
+#define _SACE_CONFIG_H
+
+#include <sched.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+namespace android {
+
+/* how SaceSocketReader picks the shard of a new connection */
+enum SaceShardPolicy {
+    SACE_SHARD_POLICY_ROUND_ROBIN,
+    SACE_SHARD_POLICY_LEAST_CONN,
+    SACE_SHARD_POLICY_HASH,          /* by client pid, same process same shard */
+};
+
+/* what a SaceSocketWriter does when its client stops reading */
+enum SaceOverflowPolicy {
+    SACE_OVERFLOW_DISCONNECT,   /* shutdown the client, its commands are destroyed */
+    SACE_OVERFLOW_DROP,         /* drop the frame, the client times out */
+};
+
+/* what an excutor does with spawns it can't keep up with */
+enum SaceShedPolicy {
+    SACE_SHED_REJECT,           /* answer BUSY once the queue is full */
+    SACE_SHED_EXPIRED,          /* also drop queued spawns past their deadline, or the expire time without one */
+};
+
+/* saced threads sharing one scheduling config */
+enum SaceThreadRole {
+    SACE_THREAD_READER,       /* socket/shm readers, they also dispatch */
+    SACE_THREAD_SERVICE,      /* service excutor and its child watcher */
+    SACE_THREAD_NORMAL,       /* normal excutor thread */
+    SACE_THREAD_EVENT,        /* event excutor thread */
+    SACE_THREAD_WORKER,       /* pool running keyed excutor work */
+    SACE_THREAD_BACKGROUND,   /* event trigger monitor and property waiter */
+    SACE_THREAD_TIMER,
+    SACE_THREAD_MAX,
+};
+
+/* persist.sace.sched.<role> : space separated, unset keys are inherited
+ *   cpus=0-3,6         affinity
+ *   nice=-4            nice of the thread
+ *   policy=background  cgroup by set_sched_policy : background | foreground | system | top
+ *   cpuset=foreground  /dev/cpuset/<name>/tasks
+ *   fifo=2             SCHED_FIFO priority, 0 keeps SCHED_OTHER
+ */
+struct SaceSchedConfig {
+    bool hasCpus;
+    cpu_set_t cpus;
+    bool hasNice;
+    int nice;
+    int policy;   /* SchedPolicy, SP_DEFAULT keeps it */
+    string cpuset;
+    int fifo;
+
+    SaceSchedConfig ();
+    bool empty () const;
+    /* on the calling thread, children spawned by it are reset by SaceSpawn */
+    void apply (const char *name) const;
+    const string to_string () const;
+};
+
+/* saced tunables, read from system properties once at startup */
+class SaceConfig {
+public:
+    /* persist.sace.socket.shards : socket reader threads, 1 means the acceptor reads too */
+    static int socketShards ();
+    /* persist.sace.socket.policy : rr | least | hash */
+    static enum SaceShardPolicy socketShardPolicy ();
+    /* persist.sace.socket.uring : io_uring backend when the kernel has it */
+    static bool socketUring ();
+    /* persist.sace.socket.outq_kb : outbound queue limit of each socket client */
+    static size_t socketOutQueueBytes ();
+    /* persist.sace.socket.overflow : disconnect | drop */
+    static enum SaceOverflowPolicy socketOverflowPolicy ();
+    /* persist.sace.excutor.workers : pool for keyed excutors, 0 gives each its own thread only */
+    static int excutorWorkers ();
+    /* persist.sace.excutor.queue : queued spawns per excutor, 0 is unbounded */
+    static int excutorQueueLimit ();
+    /* persist.sace.excutor.shed : reject | expired */
+    static enum SaceShedPolicy excutorShedPolicy ();
+    /* persist.sace.excutor.expire_ms : queue wait after which a spawn without a deadline is stale */
+    static int excutorExpireMs ();
+    /* persist.sace.spawner : fork children from a helper process, read once at boot */
+    static bool spawner ();
+    /* persist.sace.spawner.helpers : helper processes, each serves one spawn at a time */
+    static int spawnerHelpers ();
+
+    /* persist.sace.sched.<role> */
+    static SaceSchedConfig threadSched (enum SaceThreadRole role);
+    /* loads and applies the config of role to the calling thread */
+    static void applyThreadSched (enum SaceThreadRole role);
+    /* the calling thread left the process defaults, its children must be put back */
+    static bool threadSchedApplied ();
+
+    static const char* mapShardPolicyToName (enum SaceShardPolicy policy);
+    static const char* mapThreadRoleToName (enum SaceThreadRole role);
+private:
+    static bool parseCpus (const string &list, cpu_set_t *cpus);
+    static int getInt (const char *name, int def, int min, int max);
+    static string getString (const char *name, const char *def);
+
+    /* children inherit the settings of the thread that spawns them only */
+    static thread_local bool mSchedApplied;
+};
+
+}; //namespace android
+
+#endif
@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
-#include <cutils/sched_policy.h>
 #include <sys/prctl.h>
+#include <sys/eventfd.h>
+#include <sys/system_properties.h>
+#include <cutils/properties.h>
+#include <poll.h>
 #include <pthread.h>
 #include <thread>
 #include <unistd.h>
@@ -26,12 +29,15 @@
 #include "SaceEvent.h"
 #include <sace/SaceLog.h>
 #include <sace/SaceParams.h>
+#include <sace/SaceStream.h>
 
 namespace android {
 
 const char* SaceEvent::EVENT_THREAD_NAME  = "SEEvent.EMT";
 const char* SaceEvent::NAME = "SEEvent";
 const char* SaceEvent::THREAD_NAME = "SEEvent.MT";
+const char* SaceEvent::PROPERTY_THREAD_NAME = "SEEvent.PW";
+const char* SaceEvent::PROPERTY_WAKE_NAME = "sace.event.wake";
 
 #define CAP_MAP_ENTRY(cap)  { #cap, CAP_##cap }
 static const map<string, int> cap_map = {
@@ -133,6 +139,8 @@ bool SaceEvent::Service::triggered () {
 }
 
 SaceEvent::SaceEvent ():SaceExcutor(SACE_MESSAGE_HANDLER_EVENT, NAME, THREAD_NAME) {
+    property_waiting = false;
+
     sp<SaceCommand> saceCmd = new SaceCommand();
     saceCmd->type = SACE_TYPE_SERVICE;
     saceCmd->serviceCmdType = SACE_SERVICE_CMD_STOP;
@@ -145,7 +153,7 @@ SaceEvent::SaceEvent ():SaceExcutor(SACE_MESSAGE_HANDLER_EVENT, NAME, THREAD_NAM
 
 bool SaceEvent::onInit () {
     int pfd[2];
-    if (pipe(pfd) < 0) {
+    if (pipe2(pfd, O_CLOEXEC) < 0) {
         SACE_LOGE("%s open writer pipe errno=%d errstr=%s", getName(), errno, strerror(errno));
         return false;
     }
@@ -153,6 +161,13 @@ bool SaceEvent::onInit () {
     writer_fd = pfd[0];
     event_writer = new SaceEventWriter(pfd[1], getpid());
 
+    trigger_wake = make_shared<TriggerWake>();
+    trigger_wake->fd = eventfd(0, EFD_CLOEXEC);
+    if (trigger_wake->fd < 0) {
+        SACE_LOGE("%s open trigger eventfd errno=%d errstr=%s", getName(), errno, strerror(errno));
+        return false;
+    }
+
     read_ini_file();
 
     running.store(true);
@@ -162,13 +177,35 @@ bool SaceEvent::onInit () {
         return false;
     }
 
+    shared_ptr<TriggerWake> *wake = new shared_ptr<TriggerWake>(trigger_wake);
+    property_waiting = pthread_create(&property_waiter, nullptr, property_wait_thread, (void*)wake) == 0;
+    if (!property_waiting) {
+        delete wake;
+        SACE_LOGE("%s start property_wait_thread errno=%d errstr=%s", getName(), errno, strerror(errno));
+    }
+
     return true;
 }
 
 void SaceEvent::onUninit () {
+    uint64_t one = 1;
+
     running.store(false);
+    if (trigger_wake)
+        TEMP_FAILURE_RETRY(write(trigger_wake->fd, &one, sizeof(one)));
     pthread_join(event_monitor, nullptr);
 
+    if (trigger_wake) {
+        trigger_wake->stop();
+        /* property_wait_thread waits on the property serial, any change ends it */
+        if (property_waiting && property_set(PROPERTY_WAKE_NAME, ::to_string(systemTime(SYSTEM_TIME_MONOTONIC)).c_str()) < 0)
+            SACE_LOGE("%s set %s fail, property_wait_thread exits at the next change", getName(), PROPERTY_WAKE_NAME);
+
+        if (property_waiting)
+            pthread_join(property_waiter, nullptr);
+        property_waiting = false;
+        trigger_wake.reset();
+    }
     close(writer_fd);
     event_writer->close();
 
@@ -182,23 +219,33 @@ void SaceEvent::onUninit () {
 }
 
 void SaceEvent::stop_event (pair<string, uint64_t> run_event, long sequence) {
-    mStopMsg->msgCmd->label = run_event.second;
+    /* a queued message can't be posted again, send a copy of the template */
+    sp<SaceReaderMessage> stopMsg = new SaceReaderMessage();
+    stopMsg->msgHandler = mStopMsg->msgHandler;
+    stopMsg->msgCmd     = new SaceCommand(*mStopMsg->msgCmd);
+    stopMsg->msgWriter  = mStopMsg->msgWriter;
+    stopMsg->msgCmd->label = run_event.second;
 
     if (sequence)
-        mStopMsg->msgCmd->sequence = sequence;
+        stopMsg->msgCmd->sequence = sequence;
 
-    post(static_cast<sp<SaceMessageHeader>>(mStopMsg));
+    post(static_cast<sp<SaceMessageHeader>>(stopMsg));
 }
 
 void* SaceEvent::event_monitor_thread (void *obj) {
-    fd_set fds;
-    char buf[SACE_RESULT_BUF_SIZE];
-    struct timeval timeout;
+    struct pollfd fds[2];
+    uint64_t count;
+    bool check = true;
+    SaceStreamBuffer rxbuf(SaceResultHeader::parcelSize());
     SaceEvent *self = static_cast<SaceEvent*>(obj);
 
     prctl(PR_SET_NAME, EVENT_THREAD_NAME);
-    set_sched_policy(0, SP_BACKGROUND);
-    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+    SaceConfig::applyThreadSched(SACE_THREAD_BACKGROUND);
+
+    fds[0].fd = self->writer_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = self->trigger_wake->fd;
+    fds[1].events = POLLIN;
 
     while (self->running.load()) {
         map<string, shared_ptr<Service>> cmds;
@@ -206,13 +253,14 @@ void* SaceEvent::event_monitor_thread (void *obj) {
 
         self->event_mutex.lock();
         cmds.insert(self->events.begin(), self->events.end());
+        self->trigger_wake->arm(!cmds.empty());
 
         restart.insert(self->failed_events.begin(), self->failed_events.end());
         self->failed_events.clear();
         self->event_mutex.unlock();
 
-        /* Start Trigger Service */
-        for (auto it = cmds.begin(); it != cmds.end(); it++) {
+        /* Start Trigger Service, after a property change only */
+        for (auto it = cmds.begin(); check && it != cmds.end(); it++) {
             if (it->second->triggered())
                 self->start_event(it->second);
         }
@@ -224,23 +272,25 @@ void* SaceEvent::event_monitor_thread (void *obj) {
                 self->start_event(it->second);
         }
 
-        /* Exception Occur */
-        FD_ZERO(&fds);
-        FD_SET(self->writer_fd, &fds);
-        int max_fd = self->writer_fd;
-
-        /* 300ms timeout */
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 300 * 1000;
-
-        int ret = select(max_fd + 1, &fds, nullptr, nullptr, &timeout);
+        /* Exception Occur, or a property changed */
+        check = false;
+        int ret = poll(fds, 2, -1);
+        SaceStats::wokeUp(SACE_WAKEUP_EVENT);
         if (ret <= 0) {
-            if (ret < 0)
+            if (ret < 0 && errno != EINTR)
                 SACE_LOGE("%s Listen Writer Fail errno=%d errstr=%s", self->getName(), errno, strerror(errno));
             continue;
         }
 
-        ret = TEMP_FAILURE_RETRY(read(self->writer_fd, buf, sizeof(buf)));
+        if (fds[1].revents & POLLIN) {
+            TEMP_FAILURE_RETRY(read(self->trigger_wake->fd, &count, sizeof(count)));
+            check = true;
+        }
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        ret = TEMP_FAILURE_RETRY(read(self->writer_fd, rxbuf.reserve(), rxbuf.writable()));
         if (ret == 0) {
             SACE_LOGE("%s Writer Peer Close. Exiting...", self->getName());
             break;
@@ -250,26 +300,82 @@ void* SaceEvent::event_monitor_thread (void *obj) {
             continue;
         }
 
-        Parcel parcel;
-        SaceResultHeader headerRslt;
-        parcel.setData((uint8_t*)buf, ret);
-        headerRslt.readFromParcel(&parcel);
+        rxbuf.commit(ret);
+
+        /* several results may be merged in one read */
+        const uint8_t *data;
+        uint32_t len;
+        enum SaceStreamBuffer::FrameState state;
+        while ((state = rxbuf.nextFrame(&data, &len)) == SaceStreamBuffer::FRAME_READY) {
+            Parcel parcel;
+            SaceResultHeader headerRslt;
+            parcel.setData(data, len);
+            headerRslt.readFromParcel(&parcel);
+
+            parcel.setDataPosition(0);
+            if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
+                SaceResult rslt;
+                if (rslt.readFromParcel(&parcel) == OK)
+                    self->handle_result(rslt);
+            }
+            else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
+                SaceStatusResponse response;
+                if (response.readFromParcel(&parcel) == OK)
+                    self->handle_result(response);
+            }
+            else
+                SACE_LOGD("%s unkown Response Type", self->getName());
+
+            rxbuf.consume(len);
+        }
 
-        parcel.setDataPosition(0);
-        if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
-            SaceResult rslt;
-            rslt.readFromParcel(&parcel);
-            self->handle_result(rslt);
+        if (state == SaceStreamBuffer::FRAME_INVALID) {
+            SACE_LOGE("%s invalid result frame, drop %d bytes", self->getName(), (uint32_t)rxbuf.pending());
+            rxbuf.clear();
         }
-        else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
-            SaceStatusResponse response;
-            response.readFromParcel(&parcel);
-            self->handle_result(response);
+    }
+
+    return nullptr;
+}
+
+void* SaceEvent::property_wait_thread (void *data) {
+    shared_ptr<TriggerWake> wake = *(shared_ptr<TriggerWake>*)data;
+    delete (shared_ptr<TriggerWake>*)data;
+
+    prctl(PR_SET_NAME, PROPERTY_THREAD_NAME);
+    SaceConfig::applyThreadSched(SACE_THREAD_BACKGROUND);
+
+    /* read before running is checked, a stop() after the check changes it */
+    uint32_t serial = __system_property_area_serial();
+    while (wake->running.load()) {
+        uint32_t new_serial;
+
+        /* nothing to trigger, don't wake on every property change */
+        {
+            unique_lock<mutex> _l(wake->lock);
+            while (!wake->armed.load() && wake->running.load()) {
+                wake->cond.wait(_l);
+                SaceStats::wokeUp(SACE_WAKEUP_PROPERTY);
+            }
         }
-        else
-            SACE_LOGD("%s unkown Response Type", self->getName());
 
-        usleep(100 * 1000);  //100ms
+        if (!wake->running.load())
+            break;
+
+        /* any property. A disarm is seen at the next change, which parks
+         * us above : ending the wait now would take a property write, and
+         * that wakes every property waiter of the system.
+         */
+        bool changed = __system_property_wait(nullptr, serial, &new_serial, nullptr);
+        SaceStats::wokeUp(SACE_WAKEUP_PROPERTY);
+        if (!changed)
+            continue;
+
+        serial = new_serial;
+        if (wake->running.load() && wake->armed.load()) {
+            uint64_t one = 1;
+            TEMP_FAILURE_RETRY(write(wake->fd, &one, sizeof(one)));
+        }
     }
 
     return nullptr;
@@ -404,10 +510,10 @@ void SaceEvent::start_event (shared_ptr<Service> service) {
     post(static_cast<sp<SaceMessageHeader>>(cmdMsg));
 }
 
-void SaceEvent::excuteNormal (sp<SaceMessageHeader> msg) {
-    sp<SaceReaderMessage> saceMsg = (SaceReaderMessage*)msg.get();
-    sp<SaceWriter>  writer  = saceMsg->msgWriter;
-    sp<SaceCommand> saceCmd = saceMsg->msgCmd;
+void SaceEvent::excuteNormal (const sp<SaceMessageHeader> &msg) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    const sp<SaceWriter> &writer = saceMsg->msgWriter;
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
 
     SaceResult result;
     result.sequence = saceCmd->sequence;
@@ -466,6 +572,7 @@ void SaceEvent::excuteNormal (sp<SaceMessageHeader> msg) {
 
         event_mutex.lock();
         events.insert(pair<string, shared_ptr<Service>>(saceCmd->name, service));
+        trigger_wake->arm(true);
         event_mutex.unlock();
 
         result.resultStatus = SACE_RESULT_STATUS_OK;
@@ -767,7 +874,7 @@ void SaceEvent::parse_service_attr (string line, sp<SaceCommand> cmd) {
 
         out_stream>>rlm_name>>rlm_hard>>rlm_soft;
         if (!out_stream.fail())
-            cmd_params->add_rlimits(parse_rlimits_name(rlm_name), rlm_hard, rlm_soft);
+            cmd_params->add_rlimits(parse_rlimits_name(rlm_name), rlm_soft, rlm_hard);
         else
             SACE_LOGE("Invalide Rlimits Format : %s", line.c_str());
     }
@@ -780,7 +887,7 @@ void SaceEvent::parse_service_attr (string line, sp<SaceCommand> cmd) {
 bool SaceEvent::write_ini_file () const {
     if (!access(DATA_INI_FILE, F_OK)) {
         /* create new config file */
-        int fd = open(DATA_INI_FILE, O_WRONLY, O_CREAT | S_IRUSR | S_IWUSR);
+        int fd = open(DATA_INI_FILE, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
         if (fd < 0) {
             SACE_LOGE("%s create %s fail errno=%d errstr=%s", getName(), DATA_INI_FILE, errno, strerror(errno));
             return false;
@@ -837,10 +944,16 @@ bool SaceEvent::write_ini_file () const {
         }
 
         // Rlimits
-        for (auto rlms : cmd_param->rlimits) {
-            service_str.append("  rlimits ").append(::to_string(rlms[0])).append(" ")
-                .append(::to_string(rlms[1])).append(" ")
-                .append(::to_string(rlms[2])).append(" ");
+        for (auto &rlms : cmd_param->rlimits) {
+            for (auto &rlm : rlimit_map) {
+                if (rlm.second != rlms.first)
+                    continue;
+
+                /* RLIM_INFINITY is read back as -1 */
+                service_str.append("  rlimits ").append(rlm.first).append(" ")
+                    .append(::to_string((int)rlms.second.rlim_max)).append(" ")
+                    .append(::to_string((int)rlms.second.rlim_cur)).append("\n");
+            }
         }
 
         // Triggers
@@ -19,6 +19,7 @@
 
 #include <vector>
 #include <mutex>
+#include <condition_variable>
 #include <string>
 
 #include <set>
@@ -62,6 +63,9 @@ class SaceEvent : public SaceExcutor, public MessageDistributable {
     static const char* EVENT_THREAD_NAME;
     static const char* NAME;
     static const char* THREAD_NAME;
+    static const char* PROPERTY_THREAD_NAME;
+    /* set on uninit to end the property wait */
+    static const char* PROPERTY_WAKE_NAME;
 
     struct Service {
         sp<EventParams> params;
@@ -83,6 +87,8 @@ class SaceEvent : public SaceExcutor, public MessageDistributable {
     };
 
     pthread_t event_monitor;
+    pthread_t property_waiter;
+    bool property_waiting;
     atomic_bool running;
 
     mutex event_mutex;
@@ -95,6 +101,37 @@ class SaceEvent : public SaceExcutor, public MessageDistributable {
 
     sp<SaceEventWriter> event_writer;
     int writer_fd;
+
+    /* shared with property_wait_thread : it sleeps on cond while no event is
+     * registered, otherwise until a property changes, then wakes event_monitor by fd.
+     */
+    struct TriggerWake {
+        atomic<bool> running;
+        /* some events are registered, property changes are worth a check */
+        atomic<bool> armed;
+        int fd;
+        mutex lock;
+        condition_variable cond;
+
+        TriggerWake ():running(true), armed(false), fd(-1) {}
+        ~TriggerWake () {
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        void arm (bool on) {
+            lock_guard<mutex> _l(lock);
+            armed = on;
+            cond.notify_one();
+        }
+
+        void stop () {
+            lock_guard<mutex> _l(lock);
+            running = false;
+            cond.notify_one();
+        }
+    };
+    shared_ptr<TriggerWake> trigger_wake;
     sp<SaceReaderMessage> mStopMsg;
 
     bool read_ini_file ();
@@ -114,13 +151,14 @@ class SaceEvent : public SaceExcutor, public MessageDistributable {
     void add_writers (string name, sp<SaceWriter> wr);
 
     static void* event_monitor_thread (void *);
+    static void* property_wait_thread (void *);
 
 public:
     SaceEvent ();
     virtual ~SaceEvent () {}
 
 protected:
-    virtual void excuteNormal (sp<SaceMessageHeader>) override;
+    virtual void excuteNormal (const sp<SaceMessageHeader>&) override;
     virtual bool onInit () override;
     virtual void onUninit () override;
 };
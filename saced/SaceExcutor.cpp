@@ -16,7 +16,12 @@
 
 #include <sys/wait.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <sys/capability.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
@@ -24,6 +29,7 @@
 #include <selinux/android.h>
 
 #include "SaceExcutor.h"
+#include "SaceSpawn.h"
 #include "SaceWriter.h"
 #include <sace/SaceLog.h>
 
@@ -41,71 +47,54 @@ void remove_vecotr_item (vector<T>& list, T& item) {
         list.erase(it);
 }
 
-void set_proc_capability (CapSet &to_keep) {
-    cap_t caps = cap_init();
-    auto deleter = [](cap_t* p) { cap_free(*p); };
-    unique_ptr<cap_t, decltype(deleter)> ptr_caps(&caps, deleter);
+/* argv is exec'd as is, cmd too when sh would do nothing but exec it */
+static pid_t spawn_command (SaceSpawn &spawn, const string &cmd, const vector<string> &argv) {
+    vector<string> words = argv;
+    string path;
+    pid_t pid;
 
-    cap_clear(caps);
-    cap_value_t value[1];
-    for (size_t cap = 0; cap < to_keep.size(); ++cap) {
-        if (to_keep.test(cap)) {
-            value[0] = cap;
-            if (cap_set_flag(caps, CAP_PERMITTED, sizeof(value)/sizeof(value[0]), value, CAP_SET) != 0 ||
-                cap_set_flag(caps, CAP_EFFECTIVE, sizeof(value)/sizeof(value[0]), value, CAP_SET) != 0) {
-                SACE_LOGE("cap_set_flag(PERMITED|EFFECTIVE, %d ) failed", CAP_SETPCAP);
-            }
+    if (words.empty() && !SaceSpawn::splitCommand(cmd, &words))
+        return spawn.spawn(BASH_PATH, {"sh", "-c", cmd});
+
+    if (!SaceSpawn::resolvePath(words[0], &path)) {
+        if (!argv.empty()) {
+            errno = ENOENT;
+            return -1;
         }
-    }
 
-    if (cap_set_proc(caps) != 0) {
-        SACE_LOGE("cap_set_proc(%ld) failed", to_keep.to_ulong());
+        return spawn.spawn(BASH_PATH, {"sh", "-c", cmd});
     }
-}
 
-void handle_child_params (sp<CommandParams> params) {
-    if (!params.get())
-        return;
-
-    /* drop rlimit */
-    for (auto rlt : params->rlimits) {
-        setrlimit(rlt.first, &rlt.second);
+    pid = spawn.spawn(path.c_str(), words);
+    /* moved since it was cached */
+    if (pid < 0 && errno == ENOENT && path != words[0]) {
+        SaceSpawn::forgetPath(words[0]);
+        if (SaceSpawn::resolvePath(words[0], &path))
+            pid = spawn.spawn(path.c_str(), words);
     }
 
-    /* drop capability */
-    if (params->capabilities.size() > 0)
-        set_proc_capability(params->capabilities);
-
-    /* drop gid */
-    if (params->gid > 0 && !setgid(params->gid))
-        SACE_LOGE("setgid[%d] failed", params->gid);
-
-    /* drop gids */
-    vector<gid_t>& supp_gids = params->supp_gids;
-    if (supp_gids.size() > 0 && !setgroups(supp_gids.size(), &supp_gids[0]))
-        SACE_LOGE("setgroups failed");
+    /* a script without #!, sh runs it as execvp would */
+    if (pid < 0 && errno == ENOEXEC && argv.empty())
+        pid = spawn.spawn(BASH_PATH, {"sh", "-c", cmd});
 
-    /* drop uid */
-    if (params->uid > 0 && !setuid(params->uid))
-        SACE_LOGE("setuid[%d] failed", params->uid);
-
-    /* drop seclabel */
-    if (!params->seclabel.empty()) {
-        if (setexeccon((params->seclabel.c_str())) < 0)
-            SACE_LOGE("setexeccon(%s) fail %s", params->seclabel.c_str(), strerror(errno));
-    }
+    return pid;
 }
 
-int sace_popen(const char *cmd, const char *xtype, sp<CommandParams> param, pid_t *out_pid) {
-    struct pid *cur = nullptr, *old = nullptr;
+/* script_fd >= 0 runs that sealed memfd with sh, cmd only names the child */
+int sace_popen(const char *cmd, const char *xtype, sp<CommandParams> param, pid_t *out_pid, int script_fd,
+        const vector<string> &argv) {
+    struct pid *cur = nullptr;
     int pdes[2], serrno;
     pid_t pid;
+    char script_path[32];
 
     if (cmd == nullptr || xtype == nullptr)
         SACE_LOGE("sace_popen failed cmd=%s, xtype=%s", cmd, xtype);
 
+    snprintf(script_path, sizeof(script_path), "/proc/self/fd/%d", script_fd);
+
     xtype = strchr(xtype, 'w')? "w" : "r";
-    if (pipe2(pdes, 0) < 0) {
+    if (pipe2(pdes, O_CLOEXEC) < 0) {
         SACE_LOGE("sace_popen new pipe fail, cmd=%s, err=%s(%d)", cmd, strerror(errno), errno);
         return -1;
     }
@@ -119,45 +108,32 @@ int sace_popen(const char *cmd, const char *xtype, sp<CommandParams> param, pid_
         return -1;
     }
 
-    pthread_rwlock_rdlock(&pidlist_lock);
-    switch (pid = vfork()) {
-    case -1:
+    SaceSpawn spawn(cmd);
+    spawn.setParams(param);
+
+    /* every daemon fd is CLOEXEC, the other commands' pipes included :
+     * only the child's end is dup2'd, a fd equal to its target is kept.
+     */
+    if (*xtype == 'r')
+        spawn.addDup2(pdes[1], STDOUT_FILENO);
+    else
+        spawn.addDup2(pdes[0], STDIN_FILENO);
+
+    if (script_fd >= 0) {
+        spawn.inheritFd(script_fd);
+        pid = spawn.spawn(BASH_PATH, {"sh", script_path});
+    }
+    else
+        pid = spawn_command(spawn, cmd, argv);
+
+    if (pid < 0) {
         serrno = errno;
-        pthread_rwlock_unlock(&pidlist_lock);
         free(cur);
         close(pdes[0]);
         close(pdes[1]);
         errno = serrno;
-        SACE_LOGE("sace_popen vfork fail, cmd=%s, err=%s(%d)", cmd, strerror(errno), errno);
+        SACE_LOGE("sace_popen spawn fail, cmd=%s, err=%s(%d)", cmd, strerror(errno), errno);
         return -1;
-    case 0:
-        for (old = pidlist; old; old = old->next)
-            close(old->fd);
-
-        if (*xtype == 'r') {
-            close(pdes[0]);
-            if (pdes[1] != STDOUT_FILENO) {
-                dup2(pdes[1], STDOUT_FILENO);
-                close(pdes[1]);
-            }
-        }
-        else {
-            close(pdes[1]);
-            if (pdes[0] != STDIN_FILENO) {
-                dup2(pdes[0], STDIN_FILENO);
-                close(pdes[0]);
-            }
-        }
-
-        handle_child_params(param);
-        prctl(PR_SET_NAME, cmd);
-        prctl(PR_SET_PDEATHSIG, SIGHUP);
-
-        execl(BASH_PATH, "sh", "-c", cmd, nullptr);
-
-        cout << strerror(errno);
-        _exit(127);
-        /* NOTRETACHED */
     }
 
     if (*xtype == 'r') {
@@ -170,6 +146,7 @@ int sace_popen(const char *cmd, const char *xtype, sp<CommandParams> param, pid_
     }
 
     cur->pid = pid;
+    pthread_rwlock_wrlock(&pidlist_lock);
     cur->next = pidlist;
     pidlist = cur;
     pthread_rwlock_unlock(&pidlist_lock);
@@ -178,7 +155,50 @@ int sace_popen(const char *cmd, const char *xtype, sp<CommandParams> param, pid_
     return cur->fd;
 }
 
-int sace_pclose (int fd) {
+static int sace_pidfd_open (pid_t pid) {
+#ifdef __NR_pidfd_open
+    return syscall(__NR_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* false if pid has not exited within timeout_ms, it stays unreaped */
+static bool wait_child_exit (pid_t pid, int timeout_ms) {
+    siginfo_t info;
+    int pidfd = sace_pidfd_open(pid);
+
+    if (pidfd >= 0) {
+        struct pollfd pfd = {pidfd, POLLIN, 0};
+        int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms));
+        close(pidfd);
+        return ret > 0;
+    }
+
+    /* no pidfd, check every 10ms */
+    for (int waited = 0; ; waited += 10) {
+        info.si_pid = 0;
+        if (TEMP_FAILURE_RETRY(waitid(P_PID, pid, &info, WEXITED | WNOWAIT | WNOHANG)) < 0 || info.si_pid != 0)
+            return true;
+
+        if (waited >= timeout_ms)
+            return false;
+        usleep(10 * 1000);
+    }
+}
+
+/* a child given up by sace_pclose, reaped once it leaves D state */
+static void reap_later (pid_t pid) {
+    SaceTimerWheel::getInstance()->schedule(milliseconds_to_nanoseconds(CLOSE_REAP_TIME), [pid] () {
+        if (TEMP_FAILURE_RETRY(waitpid(pid, nullptr, WNOHANG)) == 0)
+            reap_later(pid);
+        else
+            SACE_LOGI("sace_pclose reaped process=%d late", pid);
+    });
+}
+
+int sace_pclose (int fd, bool kill_now) {
     struct pid *cur = nullptr, *last = nullptr;
     pid_t pid;
     int pstat;
@@ -206,45 +226,76 @@ int sace_pclose (int fd) {
         last->next = cur->next;
     pthread_rwlock_unlock(&pidlist_lock);
 
-    int wait_time = 0;
-    do {
-        pid = waitpid(cur->pid, &pstat, WNOHANG);
-        if (pid < 0) {
-            SACE_LOGE("sace_pclose waitpid pid=%d fail: %s", cur->pid, strerror(errno));
-            break;
-        }
-        else if (pid == 0) {
-            this_thread::sleep_for(chrono::milliseconds(100));
-            wait_time += 100;
-        }
-        else
-            break;
+    if (kill_now) {
+        SACE_LOGI("sace_pclose kill process=%d now", cur->pid);
+        kill(cur->pid, SIGKILL);
+    }
 
-        if (wait_time >= CLOSE_WAIT_KILL_TIME) {
-            SACE_LOGW("sace_pclose kill process=%d", cur->pid);
-            kill(cur->pid, SIGKILL);
-        }
-        else if (wait_time >= CLOSE_WAIT_TOTAL_TIME) {
-            SACE_LOGW("sace_pclose wait timeout pid=%d", cur->pid);
-            pid = -1;
-            break;
-        }
-    }while (true);
+    /* the child isn't reaped before the timer is cancelled, its pid can't be reused under the kill */
+    pid_t child = cur->pid;
+    SaceTimerWheel::TimerId killer = SaceTimerWheel::getInstance()->schedule(
+            milliseconds_to_nanoseconds(CLOSE_WAIT_KILL_TIME), [child] () {
+        SACE_LOGW("sace_pclose kill process=%d", child);
+        kill(child, SIGKILL);
+    });
+
+    /* SIGKILL doesn't get a child out of D state, don't hang on it */
+    bool exited = wait_child_exit(child, CLOSE_WAIT_KILL_TIME + CLOSE_WAIT_GIVEUP_TIME);
+    SaceTimerWheel::getInstance()->cancel(killer);
+
+    if (!exited) {
+        SACE_LOGE("sace_pclose process=%d survived SIGKILL, give up", child);
+        reap_later(child);
+        pid = -1;
+    }
+    else
+        pid = TEMP_FAILURE_RETRY(waitpid(child, &pstat, 0));
 
     close(fd);
     free(cur);
-    SACE_LOGI("sace_pclose process=%d, fd=%d, waitpid=%d, exit", pid, fd, cur->pid);
+    SACE_LOGI("sace_pclose process=%d, fd=%d, waitpid=%d, exit", child, fd, pid);
 
     return (pid == -1)? -1 : pstat;
 }
 
+// ---------------------------------------------------------- {
+/* longer than any client waits for a start */
+const nsecs_t SaceCancelList::HOLD_TIME = seconds_to_nanoseconds(30);
+
+void SaceCancelList::add (pid_t pid, uint32_t sequence) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    lock_guard<mutex> _l(mLock);
+
+    /* a cancelled start that never came */
+    for (map<pair<pid_t, uint32_t>, nsecs_t>::iterator it = mCancelled.begin(); it != mCancelled.end();) {
+        if (it->second < now)
+            it = mCancelled.erase(it);
+        else
+            it++;
+    }
+
+    mCancelled[make_pair(pid, sequence)] = now + HOLD_TIME;
+    mSize = mCancelled.size();
+}
+
+bool SaceCancelList::take (pid_t pid, uint32_t sequence) {
+    if (mSize.load() == 0)
+        return false;
+
+    lock_guard<mutex> _l(mLock);
+    if (mCancelled.erase(make_pair(pid, sequence)) == 0)
+        return false;
+
+    mSize = mCancelled.size();
+    return true;
+}
+
 // ---------------------------------------------------------- {
 const int SaceExcutor::DEFAULT_EXCUTOR_TIMEOUT = -1;
+const int SaceExcutor::STRAND_BITS = 6;
 
 void SaceExcutor::destroy_excute_thread () {
-    pthread_mutex_lock(&mSyncMutex);
     mExit = true;
-    pthread_mutex_unlock(&mSyncMutex);
 
     /* wait excute_command_thread exit */
     sem_post(&mSyncSem);
@@ -254,10 +305,31 @@ void SaceExcutor::destroy_excute_thread () {
     }
 }
 
-bool SaceExcutor::init () {
-    if (pthread_mutex_init(&mSyncMutex, nullptr) < 0) {
-        SACE_LOGE("%s pthread_mutex_init errno=%d errstr=%s", getName(), errno, strerror(errno));
-        goto mutex;
+enum SaceThreadRole SaceExcutor::threadRole () const {
+    switch (mMsgType) {
+        case SACE_MESSAGE_HANDLER_SERVICE:
+            return SACE_THREAD_SERVICE;
+        case SACE_MESSAGE_HANDLER_EVENT:
+            return SACE_THREAD_EVENT;
+        default:
+            return SACE_THREAD_NORMAL;
+    }
+}
+
+void SaceExcutor::wakeTimeout () {
+    mTimedOut = true;
+    sem_post(&mSyncSem);
+}
+
+bool SaceExcutor::init (SaceWorkerPool *pool) {
+    mQueueLimit = SaceConfig::excutorQueueLimit();
+    mShedPolicy = SaceConfig::excutorShedPolicy();
+    mExpire     = milliseconds_to_nanoseconds(SaceConfig::excutorExpireMs());
+
+    if (mKeyed && pool != nullptr && pool->running()) {
+        mStrands = new SaceStrand[1 << STRAND_BITS];
+        for (int i = 0; i < (1 << STRAND_BITS); i++)
+            mStrands[i].attach(pool, this);
     }
 
     if (sem_init(&mSyncSem, 0, 0) < 0) {
@@ -270,49 +342,172 @@ bool SaceExcutor::init () {
         goto thread;
     }
 
+    if (receive_msg_timeout() > 0) {
+        mTimeoutTimer = SaceTimerWheel::getInstance()->schedulePeriodic(seconds_to_nanoseconds(receive_msg_timeout()),
+            [this] () {
+                wakeTimeout();
+            });
+
+        if (mTimeoutTimer == 0) {
+            SACE_LOGE("%s schedule timeout fail", getName());
+            goto timer;
+        }
+    }
+
     if (!onInit())
         goto init;
 
     return true;
 init:
+    SaceTimerWheel::getInstance()->cancel(mTimeoutTimer);
+    mTimeoutTimer = 0;
+timer:
     destroy_excute_thread();
 thread:
     sem_destroy(&mSyncSem);
 sem:
-    pthread_mutex_destroy(&mSyncMutex);
-mutex:
+    delete[] mStrands;
+    mStrands = nullptr;
     return false;
 }
 
 void SaceExcutor::uninit () {
+    SaceTimerWheel::getInstance()->cancel(mTimeoutTimer);
+    mTimeoutTimer = 0;
+
+    /* keyed work must be finished before onUninit walks the state */
+    if (mStrands != nullptr) {
+        mExit = true;
+        for (int i = 0; i < (1 << STRAND_BITS); i++)
+            mStrands[i].waitIdle();
+    }
+
     onUninit();
 
     SACE_LOGI("%s Stoping...", getName());
     destroy_excute_thread();
     sem_destroy(&mSyncSem);
-    pthread_mutex_destroy(&mSyncMutex);
+
+    delete[] mStrands;
+    mStrands = nullptr;
 }
 
-bool SaceExcutor::excute (sp<SaceMessageHeader> msg) {
+bool SaceExcutor::excute (const sp<SaceMessageHeader> &msg) {
     if (msg->msgHandler == mMsgType) {
-        sendCommandMessage(msg);
+        if (admitCommandMessage(msg))
+            sendCommandMessage(msg);
+        else {
+            mBusy++;
+            SACE_LOGW("%s queue full, busy %s", getName(), msg->to_string().c_str());
+            rejectMessage(msg, SACE_RESULT_STATUS_BUSY);
+        }
         return true;
     }
 
     return false;
 }
 
-void SaceExcutor::sendCommandMessage (sp<SaceMessageHeader> msg) {
-    if (mExit) return;
+/* control messages always get in, they are cheap and relieve the load */
+bool SaceExcutor::admitCommandMessage (const sp<SaceMessageHeader> &msg) {
+    int32_t queued = mQueued.fetch_add(1);
+    if (msg->msgPriority == SACE_MESSAGE_PRIORITY_CONTROL || mQueueLimit <= 0 || queued < mQueueLimit)
+        return true;
+
+    mQueued--;
+    return false;
+}
+
+void SaceExcutor::sendCommandMessage (const sp<SaceMessageHeader> &msg) {
+    /* admitted already, it won't run */
+    if (mExit) {
+        mQueued--;
+        return;
+    }
+
+    uint64_t key;
+    msg->msgQueued = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mStrands != nullptr && messageKey(msg, &key)) {
+        /* fibonacci hashing, labels differ mostly in their high bits */
+        mStrands[(key * 0x9E3779B97F4A7C15ULL) >> (64 - STRAND_BITS)].post(msg);
+        return;
+    }
 
-    pthread_mutex_lock(&mSyncMutex);
-    mCmdQueue.push(msg);
-    pthread_mutex_unlock(&mSyncMutex);
+    string target;
+    if (messageTarget(msg, &target)) {
+        /* pushed under the lock, a START and its STOP can't swap on the way */
+        lock_guard<mutex> _l(mTargetLock);
+        map<string, uint32_t>::iterator it = mNormalTargets.find(target);
+        if (msg->msgPriority == SACE_MESSAGE_PRIORITY_NORMAL || it != mNormalTargets.end()) {
+            mNormalTargets[target]++;
+            mMailbox[SACE_MESSAGE_PRIORITY_NORMAL].push(msg);
+        }
+        else
+            mMailbox[msg->msgPriority].push(msg);
+    }
+    else
+        mMailbox[msg->msgPriority].push(msg);
 
     sem_post(&mSyncSem);
 }
 
-void SaceExcutor::excuteCommand (sp<SaceMessageHeader> msg) {
+/* control lane first, a spawn only runs when no control message waits */
+sp<SaceMessageHeader> SaceExcutor::nextCommandMessage () {
+    for (int i = 0; i < SACE_MESSAGE_PRIORITY_MAX; i++) {
+        sp<SaceMessageHeader> msg = mMailbox[i].pop();
+        if (msg == nullptr)
+            continue;
+
+        string target;
+        if (i == SACE_MESSAGE_PRIORITY_NORMAL && messageTarget(msg, &target)) {
+            lock_guard<mutex> _l(mTargetLock);
+            map<string, uint32_t>::iterator it = mNormalTargets.find(target);
+            if (it != mNormalTargets.end() && --it->second == 0)
+                mNormalTargets.erase(it);
+        }
+
+        return msg;
+    }
+
+    return nullptr;
+}
+
+void SaceExcutor::dump (string &out) {
+    for (int i = 0; i < SACE_MESSAGE_PRIORITY_MAX; i++) {
+        out += string("  ") + getName() + " " + SaceMessageHeader::mapPriorityToName((enum SaceMessagePriority)i)
+            + " wait: " + mWait[i].to_string() + "\n";
+    }
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "  %s queued=%d busy=%llu expired=%llu\n", getName(), mQueued.load(),
+        (unsigned long long)mBusy.load(), (unsigned long long)mExpired.load());
+    out += buf;
+}
+
+void SaceExcutor::excuteCommand (const sp<SaceMessageHeader> &msg) {
+    nsecs_t wait = systemTime(SYSTEM_TIME_MONOTONIC) - msg->msgQueued;
+    mWait[msg->msgPriority].record(wait);
+    mQueued--;
+
+    /* last check before anything forks */
+    if (expiredMessage(msg)) {
+        SaceStats::deadlineMissed(SACE_STAGE_EXCUTOR);
+        rejectMessage(msg, SACE_RESULT_STATUS_TIMEOUT);
+        return;
+    }
+
+    /* its client gave up already, running it would only put us further behind.
+     * A command with a deadline was judged by it above, the expire time only
+     * guesses for clients which didn't set one.
+     */
+    SaceReaderMessage *saceMsg = msg->asReader();
+    bool timed = saceMsg != nullptr && saceMsg->msgCmd->deadline > 0;
+    if (mShedPolicy == SACE_SHED_EXPIRED && msg->msgPriority != SACE_MESSAGE_PRIORITY_CONTROL && !timed && wait > mExpire) {
+        mExpired++;
+        SACE_LOGW("%s expired %s", getName(), msg->to_string().c_str());
+        rejectMessage(msg, SACE_RESULT_STATUS_TIMEOUT);
+        return;
+    }
+
     switch (msg->msgType) {
         case SACE_MESSAGE_TYPE_NORMAL:
             excuteNormal(msg);
@@ -326,58 +521,40 @@ void SaceExcutor::excuteCommand (sp<SaceMessageHeader> msg) {
     }
 }
 
-void SaceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
+void SaceExcutor::excuteNormal (const sp<SaceMessageHeader> &msg) {
     SACE_LOGI("%s Ingore excuteNormal %s", getName(), msg->to_string().c_str());
 }
 
-void SaceExcutor::excuteEvent (sp<SaceMessageHeader> msg) {
+void SaceExcutor::excuteEvent (const sp<SaceMessageHeader> &msg) {
     SACE_LOGI("%s Ignore excuteEvent %s", getName(), msg->to_string().c_str());
 }
 
-void SaceExcutor::excuteOther (sp<SaceMessageHeader> msg) {
+void SaceExcutor::excuteOther (const sp<SaceMessageHeader> &msg) {
     SACE_LOGI("%s Ignore excuteOther %s", getName(), msg->to_string().c_str());
 }
 
 void *SaceExcutor::excute_command_thread (void *data) {
-    bool exit = false;
-    struct timespec timeout = {0, 0};
-
     SaceExcutor *self = (SaceNormalExcutor*)data;
     sp<SaceMessageHeader> saceMsg;
 
     SACE_LOGI("%s Starting %d:%d", self->getName(), getpid(), gettid());
     prctl(PR_SET_NAME, self->getThreadName());
+    SaceConfig::applyThreadSched(self->threadRole());
 
-    long out_time = self->receive_msg_timeout();
     while (true) {
-        if (out_time > 0) {
-            clock_gettime(CLOCK_REALTIME, &timeout);
-            timeout.tv_sec += out_time;
-
-            int ret = sem_timedwait(&self->mSyncSem, &timeout);
-            if (ret < 0 && errno == ETIMEDOUT) {
-                self->excuteTimeout();
-                continue;
-            }
-        }
-        else
-            sem_wait(&self->mSyncSem);
+        sem_wait(&self->mSyncSem);
+        SaceStats::wokeUp(SACE_WAKEUP_EXCUTOR);
 
         if (self->mExit) {
             SACE_LOGI("%s Stopping", self->getName());
             pthread_exit(0);
         }
 
-        pthread_mutex_lock(&self->mSyncMutex);
-        if (!self->mCmdQueue.empty()) {
-            saceMsg = self->mCmdQueue.front();
-            self->mCmdQueue.pop();
-        }
-        else
-            saceMsg = nullptr;
-        pthread_mutex_unlock(&self->mSyncMutex);
+        if (self->mTimedOut.exchange(false))
+            self->excuteTimeout();
 
-        if (saceMsg != nullptr)
+        /* take everything queued, surplus posts only wake an empty round */
+        while ((saceMsg = self->nextCommandMessage()) != nullptr)
             self->excuteCommand(saceMsg);
     }
 } // }
@@ -385,7 +562,23 @@ void *SaceExcutor::excute_command_thread (void *data) {
 // --------------------------------------------------------------------------- {
 const char *SaceServiceExcutor::THREAD_NAME = "SEService.MT";
 const char *SaceServiceExcutor::NAME   = "SEService";
+const char *SaceServiceExcutor::CHILD_THREAD_NAME = "SEService.CW";
 const int  SaceServiceExcutor::TIMEOUT = 1;
+const int  SaceServiceExcutor::MAX_CHILD_EVENTS = 16;
+
+/* pidfd needs linux 5.3 */
+static bool sace_pidfd_supported () {
+    static int supported = -1;
+
+    if (supported < 0) {
+        int fd = sace_pidfd_open(getpid());
+        supported = fd >= 0;
+        if (fd >= 0)
+            close(fd);
+    }
+
+    return supported;
+}
 
 void SaceServiceExcutor::ServiceInfo::add_writer (sp<SaceWriter> wr) {
     for (auto w : writer)
@@ -394,9 +587,12 @@ void SaceServiceExcutor::ServiceInfo::add_writer (sp<SaceWriter> wr) {
     writer.push_back(wr);
 }
 
-void SaceServiceExcutor::ServiceInfo::sendResponse (SaceStatusResponse& response) {
-    for (auto wr : writer)
+void SaceServiceExcutor::ServiceInfo::sendResponse (SaceStatusResponse& response, SaceWriterBatch *batch) {
+    for (auto wr : writer) {
+        if (batch != nullptr)
+            batch->add(wr);
         wr->sendResponse(response);
+    }
 }
 
 const string SaceServiceExcutor::ServiceInfo::to_string () {
@@ -416,6 +612,7 @@ const string SaceServiceExcutor::ServiceInfo::to_string () {
 
 SaceServiceExcutor::~SaceServiceExcutor () {
     ServiceInfo *sveInfo = nullptr;
+    SaceWriterBatch batch;
     SaceStatusResponse response;
     response.status = SACE_RESPONSE_STATUS_SIGNAL;
     response.type   = SACE_RESPONSE_TYPE_SERVICE;
@@ -429,8 +626,10 @@ SaceServiceExcutor::~SaceServiceExcutor () {
         response.name  = sveInfo->name;
 
         SACE_LOGI("%s Kill Running Service : %s", getName(), sveInfo->to_string().c_str());
-        sveInfo->sendResponse(response);
+        sveInfo->sendResponse(response, &batch);
 
+        if (sveInfo->pidfd >= 0)
+            close(sveInfo->pidfd);
         delete sveInfo;
     }
 
@@ -439,6 +638,49 @@ SaceServiceExcutor::~SaceServiceExcutor () {
     mNameService.clear();
 }
 
+bool SaceServiceExcutor::onInit () {
+    struct epoll_event ev;
+
+    if (!sace_pidfd_supported()) {
+        SACE_LOGW("%s no pidfd, poll services every %ds", getName(), TIMEOUT);
+        return true;
+    }
+
+    mChildEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (mChildEpoll < 0) {
+        SACE_LOGE("%s epoll_create1 errno=%d errstr=%s", getName(), errno, strerror(errno));
+        goto epoll;
+    }
+
+    mChildWake = eventfd(0, EFD_CLOEXEC);
+    if (mChildWake < 0) {
+        SACE_LOGE("%s eventfd errno=%d errstr=%s", getName(), errno, strerror(errno));
+        goto wake;
+    }
+
+    ev.events  = EPOLLIN;
+    ev.data.fd = mChildWake;
+    if (epoll_ctl(mChildEpoll, EPOLL_CTL_ADD, mChildWake, &ev) < 0) {
+        SACE_LOGE("%s watch eventfd errno=%d errstr=%s", getName(), errno, strerror(errno));
+        goto thread;
+    }
+
+    if (pthread_create(&mChildWatcher, nullptr, child_watch_thread, (void*)this) != 0) {
+        SACE_LOGE("%s create child_watch_thread errno=%d errstr=%s", getName(), errno, strerror(errno));
+        goto thread;
+    }
+
+    return true;
+thread:
+    close(mChildWake);
+    mChildWake = -1;
+wake:
+    close(mChildEpoll);
+    mChildEpoll = -1;
+epoll:
+    return false;
+}
+
 void SaceServiceExcutor::onUninit() {
     vector<ServiceInfo*>::iterator it;
     for (it = mRunningService.begin(); it != mRunningService.end(); it++) {
@@ -449,26 +691,94 @@ void SaceServiceExcutor::onUninit() {
     }
 
     monitor_service_status();
+
+    if (mChildEpoll >= 0) {
+        uint64_t one = 1;
+        TEMP_FAILURE_RETRY(write(mChildWake, &one, sizeof(one)));
+        pthread_join(mChildWatcher, nullptr);
+
+        close(mChildWake);
+        close(mChildEpoll);
+        mChildWake = mChildEpoll = -1;
+    }
 }
 
+/* runs before onInit, polling is only the fallback without pidfd */
 long SaceServiceExcutor::receive_msg_timeout () {
-    return TIMEOUT;
+    return sace_pidfd_supported()? DEFAULT_EXCUTOR_TIMEOUT : TIMEOUT;
+}
+
+/* -1 leaves the service to the next monitor_service_status */
+int SaceServiceExcutor::watch_child (pid_t pid) {
+    struct epoll_event ev;
+
+    if (mChildEpoll < 0)
+        return -1;
+
+    int pidfd = sace_pidfd_open(pid);
+    if (pidfd < 0) {
+        SACE_LOGE("%s pidfd_open pid=%d errno=%d errstr=%s", getName(), pid, errno, strerror(errno));
+        return -1;
+    }
+
+    /* one shot : readable until reaped, closing it on reap unwatches */
+    ev.events  = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = pidfd;
+    if (epoll_ctl(mChildEpoll, EPOLL_CTL_ADD, pidfd, &ev) < 0) {
+        SACE_LOGE("%s watch pid=%d errno=%d errstr=%s", getName(), pid, errno, strerror(errno));
+        close(pidfd);
+        return -1;
+    }
+
+    return pidfd;
+}
+
+void* SaceServiceExcutor::child_watch_thread (void *data) {
+    SaceServiceExcutor *self = (SaceServiceExcutor*)data;
+    struct epoll_event events[MAX_CHILD_EVENTS];
+
+    prctl(PR_SET_NAME, CHILD_THREAD_NAME);
+    SaceConfig::applyThreadSched(SACE_THREAD_SERVICE);
+
+    while (true) {
+        int ret = epoll_wait(self->mChildEpoll, events, MAX_CHILD_EVENTS, -1);
+        SaceStats::wokeUp(SACE_WAKEUP_CHILD);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+
+            SACE_LOGE("%s child watch errno=%d errstr=%s", self->getName(), errno, strerror(errno));
+            break;
+        }
+
+        bool exited = false;
+        for (int i = 0; i < ret; i++) {
+            if (events[i].data.fd == self->mChildWake)
+                return nullptr;
+            exited = true;
+        }
+
+        if (exited)
+            self->wakeTimeout();
+    }
+
+    return nullptr;
 }
 
 void SaceServiceExcutor::excuteTimeout () {
     monitor_service_status();
 }
 
-void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
-    if (msg->msgType != SACE_MESSAGE_TYPE_NORMAL)
+void SaceServiceExcutor::excuteNormal (const sp<SaceMessageHeader> &msg) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    if (saceMsg == nullptr)
         return;
 
-    sp<SaceReaderMessage> saceMsg = (SaceReaderMessage*)msg.get();
-    sp<SaceWriter> writer = saceMsg->msgWriter;
+    const sp<SaceWriter> &writer = saceMsg->msgWriter;
     map<uint64_t, ServiceInfo*>::iterator it;
 
     pid_t pid;
-    sp<SaceCommand> saceCmd = saceMsg->msgCmd;
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
 
     SaceResult result;
     result.sequence = saceCmd->sequence;
@@ -476,12 +786,18 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
     result.resultStatus = SACE_RESULT_STATUS_FAIL;
     result.resultType   = SACE_RESULT_TYPE_NONE;
 
-    char *argv[] = {(char*)"sh", (char*)"-c", NULL, NULL};
     ServiceInfo *sveInfo = nullptr;
 
-    char cmd[CMD_BUFFER_LEN] = {0};
     if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_START) {
         string name = saceCmd->name;
+        int script_fd = saceCmd->script? saceCmd->script->get() : -1;
+        char script_path[32];
+
+        if (mCancelList.take(saceMsg->msgClient.pid, saceCmd->sequence)) {
+            SACE_LOGI("%s drop cancelled Service %s", getName(), name.c_str());
+            result.resultStatus = SACE_RESULT_STATUS_CANCELLED;
+            goto end;
+        }
 
         /* exists */
         if (mNameService.find(name) != mNameService.end()) {
@@ -490,30 +806,40 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
             goto end;
         }
 
+        if (saceCmd->script && !SaceCommand::sealedScript(script_fd)) {
+            SACE_LOGE("%s Service %s script is not sealed", getName(), name.c_str());
+            result.resultStatus = SACE_RESULT_STATUS_SECURE;
+            goto end;
+        }
+        snprintf(script_path, sizeof(script_path), "/proc/self/fd/%d", script_fd);
+
         sveInfo = new ServiceInfo();
+        sveInfo->pidfd   = -1;
         sveInfo->state   = SaceServiceInfo::SERVICE_RUNNING;
         sveInfo->cmdLine = saceCmd->command;
         sveInfo->name = saceCmd->name;
         sveInfo->label = SEQUENCE_TO_LABEL(saceCmd->sequence, reinterpret_cast<uint64_t>(sveInfo));
         sveInfo->flags = saceCmd->serviceFlags;
+        sveInfo->owner = saceMsg->msgClient;
         sveInfo->add_writer(writer);
 
         sp<CommandParams> param;
         if (saceCmd->command_params)
             param = saceCmd->command_params->parseCommandParams();
 
-        memcpy(cmd, saceCmd->command.c_str(), saceCmd->command.size());
-        if ((pid = fork()) == 0) {
-            handle_child_params(param);
-            prctl(PR_SET_PDEATHSIG, SIGHUP);
-            prctl(PR_SET_NAME, sveInfo->name.c_str());
+        SaceSpawn spawn(sveInfo->name);
+        spawn.setParams(param);
 
-            argv[2] = cmd;
-            execv(BASH_PATH, argv);
-            _exit(errno);
+        if (script_fd >= 0) {
+            spawn.inheritFd(script_fd);
+            pid = spawn.spawn(BASH_PATH, {"sh", script_path});
         }
-        else if (pid > 0) {
+        else
+            pid = spawn_command(spawn, sveInfo->cmdLine, saceCmd->argv);
+
+        if (pid > 0) {
             sveInfo->pid = pid;
+            sveInfo->pidfd = watch_child(pid);
             mRunningService.push_back(sveInfo);
             mSeqService.insert(pair<uint64_t, ServiceInfo*>(sveInfo->label, sveInfo));
             mNameService.insert(pair<string, ServiceInfo*>(sveInfo->name, sveInfo));
@@ -532,8 +858,8 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
             result.resultExtraLen = sizeof(uint64_t);
             SACE_LOGI("Starting Service Name=%s Pid=%d", sveInfo->name.c_str(), sveInfo->pid);
         }
-        else if (pid < 0) {
-            SACE_LOGE("%s fork process %s fail %s", getName(), sveInfo->name.c_str(), saceMsg->to_string().c_str());
+        else {
+            SACE_LOGE("%s spawn process %s fail %s", getName(), sveInfo->name.c_str(), saceMsg->to_string().c_str());
             delete sveInfo;
             goto end;
         }
@@ -597,12 +923,48 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
     else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_INFO) {
         handleServiceInfo(saceCmd, writer, result);
     }
+    else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_CANCEL) {
+        uint32_t sequence = LABEL_TO_SEQUENCE(saceCmd->label);
+
+        /* sequences are per client, another client's service is never matched */
+        it = mSeqService.find(saceCmd->label);
+        if (it != mSeqService.end() && !(it->second->owner == saceMsg->msgClient))
+            it = mSeqService.end();
+
+        for (map<uint64_t, ServiceInfo*>::iterator sve = mSeqService.begin(); it == mSeqService.end() && sve != mSeqService.end(); sve++) {
+            if (LABEL_TO_SEQUENCE(sve->first) == sequence && sve->second->owner == saceMsg->msgClient)
+                it = sve;
+        }
+
+        result.resultStatus = SACE_RESULT_STATUS_OK;
+        if (it == mSeqService.end()) {
+            SACE_LOGI("%s cancel queued Service sequence=%u", getName(), sequence);
+            mCancelList.add(saceMsg->msgClient.pid, sequence);
+        }
+        else if (it->second->state == SaceServiceInfo::SERVICE_RUNNING || it->second->state == SaceServiceInfo::SERVICE_PAUSED) {
+            sveInfo = it->second;
+            SACE_LOGI("%s Cancel Service Name=%s Pid=%d", getName(), sveInfo->name.c_str(), sveInfo->pid);
+            kill(sveInfo->pid, SIGKILL);
+            sveInfo->state = SaceServiceInfo::SERVICE_FINISHING_USER;
+        }
+    }
 
 end:
     writer->sendResult(result);
     monitor_service_status();
 }
 
+/* CANCEL is left out, it is meant to get ahead of the START it cancels */
+bool SaceServiceExcutor::messageTarget (const sp<SaceMessageHeader> &msg, string *target) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    if (saceMsg == nullptr || saceMsg->msgCmd->type != SACE_TYPE_SERVICE ||
+        saceMsg->msgCmd->serviceCmdType == SACE_SERVICE_CMD_CANCEL)
+        return false;
+
+    *target = saceMsg->msgCmd->name;
+    return true;
+}
+
 void SaceServiceExcutor::handleServiceInfo (sp<SaceCommand> saceCmd, sp<SaceWriter> writer, SaceResult &result) {
     string &cmd = saceCmd->command;
 
@@ -640,6 +1002,8 @@ void SaceServiceExcutor::handleServiceInfo (sp<SaceCommand> saceCmd, sp<SaceWrit
 void SaceServiceExcutor::monitor_service_status () {
     vector<vector<SaceServiceExcutor::ServiceInfo*>::iterator> gcIterator;
     SaceServiceExcutor::ServiceInfo *sveInfo = nullptr;
+    /* services reaped in one round are reported together */
+    SaceWriterBatch batch;
     int status;
 
     for (vector<SaceServiceExcutor::ServiceInfo*>::iterator it = mRunningService.begin();
@@ -690,7 +1054,7 @@ void SaceServiceExcutor::monitor_service_status () {
             }
 
             gcIterator.push_back(it);
-            sveInfo->sendResponse(response);
+            sveInfo->sendResponse(response, &batch);
         }
         else if (ret < 0) {
             if (errno == ECHILD)
@@ -704,6 +1068,8 @@ void SaceServiceExcutor::monitor_service_status () {
         mSeqService.erase(sveInfo->label);
         mNameService.erase(sveInfo->name);
         mRunningService.erase(gcIterator[i]);
+        if (sveInfo->pidfd >= 0)
+            close(sveInfo->pidfd);
         delete sveInfo;
     }
 
@@ -713,8 +1079,10 @@ void SaceServiceExcutor::monitor_service_status () {
 // ------------------------------------------------------------------ {
 const char* SaceNormalExcutor::NAME = "SENormal";
 const char* SaceNormalExcutor::THREAD_NAME = "SENormal.MT";
+const nsecs_t SaceNormalExcutor::DESTROYED_KEEP = seconds_to_nanoseconds(60);
 
 SaceNormalExcutor::~SaceNormalExcutor () {
+    SaceWriterBatch batch;
     SaceStatusResponse response;
     response.type = SACE_RESPONSE_TYPE_NORMAL;
     response.status = SACE_RESPONSE_STATUS_SIGNAL;
@@ -725,6 +1093,7 @@ SaceNormalExcutor::~SaceNormalExcutor () {
 
         response.label = cmd->label;
         response.name  = cmd->cmdLine;
+        batch.add(cmd->writer);
         cmd->writer->sendResponse(response);
 
         SACE_LOGE("%s Stop Running Command commandInfo=%s", getName(), cmd->to_string().c_str());
@@ -735,6 +1104,7 @@ SaceNormalExcutor::~SaceNormalExcutor () {
 }
 
 void SaceNormalExcutor::onUninit() {
+    lock_guard<mutex> _l(mCmdLock);
     for (vector<CommandInfo*>::iterator it = mRunningCmd.begin(); it != mRunningCmd.end(); it++) {
         CommandInfo *cmd = *it;
 
@@ -751,9 +1121,29 @@ string SaceNormalExcutor::CommandInfo::to_string() {
     return description;
 }
 
-void SaceNormalExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
-    sp<SaceReaderMessage> saceMsg = (SaceReaderMessage*)msg.get();
-    sp<SaceCommand> saceCmd = saceMsg->msgCmd;
+bool SaceNormalExcutor::messageKey (const sp<SaceMessageHeader> &msg, uint64_t *key) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    if (saceMsg == nullptr)
+        return false;
+
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
+    /* a close follows its start result, so both see the same label */
+    if (saceCmd->normalCmdType == SACE_NORMAL_CMD_CLOSE)
+        *key = saceCmd->label;
+    /* behind or ahead of its start, never beside it */
+    else if (saceCmd->normalCmdType == SACE_NORMAL_CMD_CANCEL)
+        *key = LABEL_TO_SEQUENCE(saceCmd->label);
+    else if (saceCmd->normalCmdType == SACE_NORMAL_CMD_DESTROY)
+        *key = saceMsg->msgClient.pid;
+    else
+        *key = saceCmd->sequence;
+
+    return true;
+}
+
+void SaceNormalExcutor::excuteNormal (const sp<SaceMessageHeader> &msg) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
 
     if (saceCmd->normalCmdType == SACE_NORMAL_CMD_START)
         startNormalCmd(saceMsg);
@@ -761,68 +1151,114 @@ void SaceNormalExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
         closeNormalCmd(saceMsg);
     else if (saceCmd->normalCmdType == SACE_NORMAL_CMD_DESTROY)
         destroyNormalCmd(saceMsg);
+    else if (saceCmd->normalCmdType == SACE_NORMAL_CMD_CANCEL)
+        cancelNormalCmd(saceMsg);
     else
         SACE_LOGE("%s SaceNormalExcutor unkown Command Type %d", getName(), saceCmd->normalCmdType);
 }
 
-void SaceNormalExcutor::destroyNormalCmd (sp<SaceReaderMessage> saceMsg) {
+void SaceNormalExcutor::forgetNormalCmd (CommandInfo *cmdInfo, const SaceClientIdentifier &client) {
+    remove_vecotr_item(mRunningCmd, cmdInfo);
+    mSeqCmd.erase(cmdInfo->label);
+
+    map<SaceClientIdentifier, vector<uint64_t>>::iterator it = mClientCmd.find(client);
+    if (it != mClientCmd.end()) {
+        vector<uint64_t>& clientCmdLabels = it->second;
+        remove_vecotr_item(clientCmdLabels, cmdInfo->label);
+        if (clientCmdLabels.size() <= 0)
+            mClientCmd.erase(it);
+    }
+    else
+        SACE_LOGW("%s closeNormalCmd emtpy found in ClientCmd mapping", getName());
+}
+
+bool SaceNormalExcutor::destroyedClient (SaceReaderMessage *saceMsg) {
+    map<SaceClientIdentifier, nsecs_t>::iterator it = mDestroyedClient.find(saceMsg->msgClient);
+    if (it == mDestroyedClient.end())
+        return false;
+
+    if (saceMsg->msgQueued <= it->second)
+        return true;
+
+    /* handed over after the DESTROY, the pid came back with a new connection */
+    mDestroyedClient.erase(it);
+    return false;
+}
+
+void SaceNormalExcutor::destroyNormalCmd (SaceReaderMessage *saceMsg) {
+    vector<CommandInfo*> destroyed;
+
+    /* claim every command of the client, a racing close finds none of them */
+    mCmdLock.lock();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (map<SaceClientIdentifier, nsecs_t>::iterator it = mDestroyedClient.begin(); it != mDestroyedClient.end();) {
+        if (now - it->second > DESTROYED_KEEP)
+            it = mDestroyedClient.erase(it);
+        else
+            it++;
+    }
+    mDestroyedClient[saceMsg->msgClient] = saceMsg->msgQueued;
+
     map<SaceClientIdentifier, vector<uint64_t>>::iterator it = mClientCmd.find(saceMsg->msgClient);
-    if (it == mClientCmd.end()) {
+    if (it != mClientCmd.end()) {
+        vector<uint64_t> clientCmdLabels = it->second;
+        for (vector<uint64_t>::iterator label = clientCmdLabels.begin(); label != clientCmdLabels.end(); label++) {
+            map<uint64_t, CommandInfo*>::iterator info = mSeqCmd.find(*label);
+            if (info == mSeqCmd.end())
+                continue;
+
+            destroyed.push_back(info->second);
+            remove_vecotr_item(mRunningCmd, info->second);
+            mSeqCmd.erase(info);
+        }
+
+        mClientCmd.erase(it);
+    }
+    mCmdLock.unlock();
+
+    if (destroyed.empty()) {
         SACE_LOGI("%s destroyNormalCmd client[%d:%d] hava no running command", getName(), saceMsg->msgClient.uid, saceMsg->msgClient.pid);
         return;
     }
 
-    vector<uint64_t> clientCmdLabels = it->second;
-    SACE_LOGI("%s destroyNormalCmd client[%d:%d] clear %d commands", getName(), saceMsg->msgClient.uid, saceMsg->msgClient.pid, clientCmdLabels.size());
-
-    for (vector<uint64_t>::iterator label = clientCmdLabels.begin(); label != clientCmdLabels.end(); label++) {
-        map<uint64_t, CommandInfo*>::iterator info = mSeqCmd.find(*label);
-        if (info == mSeqCmd.end())
-            continue;
-
-        CommandInfo *cmdInfo = info->second;
+    SACE_LOGI("%s destroyNormalCmd client[%d:%d] clear %d commands", getName(), saceMsg->msgClient.uid, saceMsg->msgClient.pid, (int)destroyed.size());
+    for (CommandInfo *cmdInfo : destroyed) {
         SACE_LOGI("%s destroyNormalCmd commandInfo=%s", getName(), cmdInfo->to_string().c_str());
 
         sace_pclose(cmdInfo->fd);
-        remove_vecotr_item(mRunningCmd, cmdInfo);
-        mSeqCmd.erase(info);
+        delete cmdInfo;
     }
-
-    mClientCmd.erase(it);
 }
 
-void SaceNormalExcutor::closeNormalCmd (sp<SaceReaderMessage> saceMsg) {
-    sp<SaceCommand> saceCmd = saceMsg->msgCmd;
-    sp<SaceWriter> writer = saceMsg->msgWriter;
-    map<uint64_t, CommandInfo*>::iterator it = mSeqCmd.find(saceCmd->label);
+void SaceNormalExcutor::closeNormalCmd (SaceReaderMessage *saceMsg) {
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
+    const sp<SaceWriter> &writer = saceMsg->msgWriter;
+    CommandInfo *cmdInfo = nullptr;
 
     SaceResult result;
     result.sequence = saceCmd->sequence;
     result.name = saceCmd->name;
     result.resultFd = -1;
 
-    if (it == mSeqCmd.end()) {
+    mCmdLock.lock();
+    map<uint64_t, CommandInfo*>::iterator it = mSeqCmd.find(saceCmd->label);
+    if (it != mSeqCmd.end()) {
+        cmdInfo = it->second;
+        forgetNormalCmd(cmdInfo, saceMsg->msgClient);
+    }
+    mCmdLock.unlock();
+
+    if (cmdInfo == nullptr) {
         result.resultStatus = SACE_RESULT_STATUS_FAIL;
         result.resultType   = SACE_RESULT_TYPE_CLOSE;
         SACE_LOGE("%s %s Invalid SaceCommand Sequence OR Maybe Finished", getName(), saceMsg->to_string().c_str());
     }
     else {
-        CommandInfo *cmdInfo = it->second;
         SACE_LOGI("%s closeNormalCmd sequence=%d commandInfo=%s", getName(), saceCmd->sequence, cmdInfo->to_string().c_str());
 
+        /* may wait CLOSE_WAIT_KILL_TIME for the kill, other strands keep running */
         sace_pclose(cmdInfo->fd);
-        remove_vecotr_item(mRunningCmd, cmdInfo);
-        mSeqCmd.erase(it);
-
-        map<SaceClientIdentifier, vector<uint64_t>>::iterator it = mClientCmd.find(saceMsg->msgClient);
-        if (it != mClientCmd.end()) {
-            vector<uint64_t>& clientCmdLabels = it->second;
-            remove_vecotr_item(clientCmdLabels, cmdInfo->label);
-            if (clientCmdLabels.size() <= 0)
-                mClientCmd.erase(it);
-        }
-        else
-            SACE_LOGW("%s closeNormalCmd emtpy found in ClientCmd mapping", getName());
+        delete cmdInfo;
 
         result.resultStatus = SACE_RESULT_STATUS_OK;
         result.resultType   = SACE_RESULT_TYPE_CLOSE;
@@ -831,13 +1267,94 @@ void SaceNormalExcutor::closeNormalCmd (sp<SaceReaderMessage> saceMsg) {
     writer->sendResult(result);
 }
 
-void SaceNormalExcutor::startNormalCmd (sp<SaceReaderMessage> saceMsg) {
-    sp<SaceCommand> saceCmd = saceMsg->msgCmd;
-    sp<SaceWriter> writer = saceMsg->msgWriter;
+void SaceNormalExcutor::cancelNormalCmd (SaceReaderMessage *saceMsg) {
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
+    uint32_t sequence = LABEL_TO_SEQUENCE(saceCmd->label);
+    CommandInfo *cmdInfo = nullptr;
 
     SaceResult result;
     result.sequence = saceCmd->sequence;
     result.name = saceCmd->name;
+    result.resultFd = -1;
+    result.resultType   = SACE_RESULT_TYPE_CLOSE;
+    result.resultStatus = SACE_RESULT_STATUS_OK;
+
+    /* only among the commands of that client, by label or else by the
+     * sequence when its start result was lost.
+     */
+    mCmdLock.lock();
+    map<SaceClientIdentifier, vector<uint64_t>>::iterator client = mClientCmd.find(saceMsg->msgClient);
+    for (size_t i = 0; client != mClientCmd.end() && i < client->second.size(); i++) {
+        map<uint64_t, CommandInfo*>::iterator it = mSeqCmd.find(client->second[i]);
+        if (it == mSeqCmd.end())
+            continue;
+
+        if (client->second[i] == saceCmd->label) {
+            cmdInfo = it->second;
+            break;
+        }
+
+        if (cmdInfo == nullptr && LABEL_TO_SEQUENCE(client->second[i]) == sequence)
+            cmdInfo = it->second;
+    }
+
+    if (cmdInfo != nullptr)
+        forgetNormalCmd(cmdInfo, saceMsg->msgClient);
+    mCmdLock.unlock();
+
+    if (cmdInfo == nullptr) {
+        SACE_LOGI("%s cancel queued sequence=%u client[%d:%d]", getName(), sequence, saceMsg->msgClient.uid, saceMsg->msgClient.pid);
+        mCancelList.add(saceMsg->msgClient.pid, sequence);
+    }
+    else {
+        SACE_LOGI("%s cancel running commandInfo=%s", getName(), cmdInfo->to_string().c_str());
+        sace_pclose(cmdInfo->fd, true);
+        delete cmdInfo;
+    }
+
+    saceMsg->msgWriter->sendResult(result);
+}
+
+void SaceNormalExcutor::startNormalCmd (SaceReaderMessage *saceMsg) {
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
+    const sp<SaceWriter> &writer = saceMsg->msgWriter;
+
+    SaceResult result;
+    result.sequence = saceCmd->sequence;
+    result.name = saceCmd->name;
+
+    if (mCancelList.take(saceMsg->msgClient.pid, saceCmd->sequence)) {
+        SACE_LOGI("%s drop cancelled %s", getName(), saceCmd->to_string().c_str());
+        result.resultStatus = SACE_RESULT_STATUS_CANCELLED;
+        result.resultType   = SACE_RESULT_TYPE_START;
+        result.resultFd = -1;
+        writer->sendResult(result);
+        return;
+    }
+
+    int script_fd = saceCmd->script? saceCmd->script->get() : -1;
+    if (saceCmd->script && !SaceCommand::sealedScript(script_fd)) {
+        SACE_LOGE("%s: reject unsealed script %s", getName(), saceCmd->to_string().c_str());
+        result.resultStatus = SACE_RESULT_STATUS_SECURE;
+        result.resultType   = SACE_RESULT_TYPE_START;
+        writer->sendResult(result);
+        return;
+    }
+
+    mCmdLock.lock();
+    bool destroyed = destroyedClient(saceMsg);
+    mCmdLock.unlock();
+
+    if (destroyed) {
+        SACE_LOGI("%s drop %s of destroyed client[%d:%d]", getName(), saceCmd->to_string().c_str(),
+            saceMsg->msgClient.uid, saceMsg->msgClient.pid);
+        /* still answer, a batch waits for every sub result */
+        result.resultStatus = SACE_RESULT_STATUS_CANCELLED;
+        result.resultType   = SACE_RESULT_TYPE_START;
+        result.resultFd = -1;
+        writer->sendResult(result);
+        return;
+    }
 
     CommandInfo *cmdInfo = new CommandInfo();
     cmdInfo->fd = -1;
@@ -852,7 +1369,7 @@ void SaceNormalExcutor::startNormalCmd (sp<SaceReaderMessage> saceMsg) {
         param = nullptr;
 
     SACE_LOGI("%s startNormalCmd: %s, sequence=%d", getName(), cmdInfo->cmdLine.c_str(), saceCmd->sequence);
-    int fd = sace_popen(cmdInfo->cmdLine.c_str(), saceCmd->flags == SACE_CMD_FLAG_OUT? "w" : "r", param, &cmdInfo->pid);
+    int fd = sace_popen(cmdInfo->cmdLine.c_str(), saceCmd->flags == SACE_CMD_FLAG_OUT? "w" : "r", param, &cmdInfo->pid, script_fd, saceCmd->argv);
     if (fd < 0) {
         SACE_LOGE("%s: popen %s fail %s", getName(), cmdInfo->cmdLine.c_str(), strerror(errno));
         result.resultStatus = SACE_RESULT_STATUS_FAIL;
@@ -867,6 +1384,23 @@ void SaceNormalExcutor::startNormalCmd (sp<SaceReaderMessage> saceMsg) {
 
     cmdInfo->fd = fd;
 
+    /* the DESTROY may have run while we were spawning */
+    mCmdLock.lock();
+    if (destroyedClient(saceMsg)) {
+        mCmdLock.unlock();
+
+        SACE_LOGI("%s client[%d:%d] destroyed while starting %s", getName(), saceMsg->msgClient.uid,
+            saceMsg->msgClient.pid, cmdInfo->to_string().c_str());
+        sace_pclose(cmdInfo->fd, true);
+        delete cmdInfo;
+
+        result.resultStatus = SACE_RESULT_STATUS_CANCELLED;
+        result.resultType   = SACE_RESULT_TYPE_START;
+        result.resultFd = -1;
+        writer->sendResult(result);
+        return;
+    }
+
     mRunningCmd.push_back(cmdInfo);
     mSeqCmd.insert(pair<uint64_t, CommandInfo*>(cmdInfo->label, cmdInfo));
 
@@ -878,6 +1412,7 @@ void SaceNormalExcutor::startNormalCmd (sp<SaceReaderMessage> saceMsg) {
     }
     else
         it->second.push_back(cmdInfo->label);
+    mCmdLock.unlock();
 
     result.resultType = SACE_RESULT_TYPE_FD;
     result.resultStatus = SACE_RESULT_STATUS_OK;
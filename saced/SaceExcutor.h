@@ -19,7 +19,8 @@
 
 #include <semaphore.h>
 #include <vector>
-#include <queue>
+#include <map>
+#include <mutex>
 #include <pthread.h>
 
 #include <sace/SaceTypes.h>
@@ -29,38 +30,94 @@
 #include <sace/SaceParams.h>
 
 #include "SaceClient.h"
+#include "SaceWriter.h"
+#include "SaceWorkerPool.h"
+#include "SaceStats.h"
+#include "SaceConfig.h"
+#include "SaceTimerWheel.h"
 
 #define BASH_PATH "/system/bin/sh"
 
-#define CLOSE_WAIT_TOTAL_TIME    2000 //ms
 #define CLOSE_WAIT_KILL_TIME     1000 //ms
+#define CLOSE_WAIT_GIVEUP_TIME   3000 //ms after the kill
+#define CLOSE_REAP_TIME          5000 //ms
 
 namespace android {
 
-class SaceExcutor {
-    static const int DEFAULT_EXCUTOR_TIMEOUT;
+/* starts cancelled before they ran, keyed by client pid and sequence */
+class SaceCancelList {
+    static const nsecs_t HOLD_TIME;
+
+    mutex mLock;
+    /* lets take() skip the lock, nothing is cancelled most of the time */
+    atomic<uint32_t> mSize;
+    map<pair<pid_t, uint32_t>, nsecs_t> mCancelled;
+
+public:
+    SaceCancelList ():mSize(0) {}
+
+    void add (pid_t pid, uint32_t sequence);
+    /* true once for a cancelled start, which must not run */
+    bool take (pid_t pid, uint32_t sequence);
+};
+
+class SaceExcutor : public SaceStrandHandler {
+    static const int STRAND_BITS;
 
     enum SaceMessageHandlerType mMsgType;
     string mName;
     string mThreadName;
 
-    queue<sp<SaceMessageHeader>> mCmdQueue;
-    pthread_mutex_t mSyncMutex;
+    /* keyed excutors : messages of one key hash run in order on the pool */
+    bool mKeyed;
+    SaceStrand *mStrands;
+
+    /* one lane per SaceMessagePriority, filled by any poster, drained by excute_thread only */
+    SaceMailbox<SaceMessageHeader> mMailbox[SACE_MESSAGE_PRIORITY_MAX];
+    SaceWaitStats mWait[SACE_MESSAGE_PRIORITY_MAX];
+    /* targets with messages in the normal lane, a control message for
+     * one of them queues behind instead of overtaking.
+     */
+    mutex mTargetLock;
+    map<string, uint32_t> mNormalTargets;
+
+    /* admitted but not excuted yet, bounds the normal lane only */
+    atomic<int32_t> mQueued;
+    int mQueueLimit;
+    enum SaceShedPolicy mShedPolicy;
+    nsecs_t mExpire;
+    atomic<uint64_t> mBusy;
+    atomic<uint64_t> mExpired;
     sem_t mSyncSem;
-    bool mExit;
+    atomic<bool> mExit;
+    /* periodic receive_msg_timeout() on the timer wheel, handled by excute_thread */
+    SaceTimerWheel::TimerId mTimeoutTimer;
+    atomic<bool> mTimedOut;
     pthread_t excute_thread;
 
     static void* excute_command_thread (void*);
     void destroy_excute_thread();
 
-    void sendCommandMessage(sp<SaceMessageHeader>);
-    void excuteCommand (sp<SaceMessageHeader>);
+    void sendCommandMessage(const sp<SaceMessageHeader>&);
+    sp<SaceMessageHeader> nextCommandMessage ();
+    bool admitCommandMessage (const sp<SaceMessageHeader>&);
+    void excuteCommand (const sp<SaceMessageHeader>&);
 public:
-    SaceExcutor (enum SaceMessageHandlerType type, const char* name, const char* thread_name) {
+    SaceExcutor (enum SaceMessageHandlerType type, const char* name, const char* thread_name, bool keyed = false) {
         mExit = false;
+        mTimeoutTimer = 0;
+        mTimedOut = false;
         mMsgType = type;
         mName = string(name);
         mThreadName = string(thread_name);
+        mKeyed = keyed;
+        mStrands = nullptr;
+        mQueued = 0;
+        mQueueLimit = 0;
+        mShedPolicy = SACE_SHED_REJECT;
+        mExpire = 0;
+        mBusy = 0;
+        mExpired = 0;
     }
 
     const char* getName() const {
@@ -71,14 +128,43 @@ public:
         return mThreadName.c_str();
     }
 
-    bool init();
+    enum SaceMessageHandlerType handlerType() const {
+        return mMsgType;
+    }
+
+    /* scheduling config of excute_thread */
+    enum SaceThreadRole threadRole() const;
+
+    /* keyed excutors fall back to their own thread without a running pool */
+    bool init(SaceWorkerPool *pool = nullptr);
     void uninit();
-    bool excute (sp<SaceMessageHeader>);
+    bool excute (const sp<SaceMessageHeader>&);
     virtual ~SaceExcutor() {}
+
+    /* queue wait per lane, for dumpsys */
+    void dump (string &out);
+
+    virtual void handleStrandMessage (const sp<SaceMessageHeader> &msg) override {
+        excuteCommand(msg);
+    }
 protected:
-    virtual void excuteNormal (sp<SaceMessageHeader>);
-    virtual void excuteEvent (sp<SaceMessageHeader>);
-    virtual void excuteOther (sp<SaceMessageHeader>);
+    static const int DEFAULT_EXCUTOR_TIMEOUT;
+
+    SaceCancelList mCancelList;
+
+    /* keyed excutors only, false runs the message on the excutor thread */
+    virtual bool messageKey (const sp<SaceMessageHeader>&, uint64_t *key __unused) {
+        return false;
+    }
+
+    /* unkeyed excutors, what the message acts on : FIFO per target across lanes */
+    virtual bool messageTarget (const sp<SaceMessageHeader>&, string *target __unused) {
+        return false;
+    }
+
+    virtual void excuteNormal (const sp<SaceMessageHeader>&);
+    virtual void excuteEvent (const sp<SaceMessageHeader>&);
+    virtual void excuteOther (const sp<SaceMessageHeader>&);
 
     virtual bool onInit() { return true; }
     virtual void onUninit() {}
@@ -87,6 +173,8 @@ protected:
         return DEFAULT_EXCUTOR_TIMEOUT; // waiting
     }
     virtual void excuteTimeout(){}
+    /* runs excuteTimeout() on the excutor thread, callable from any thread */
+    void wakeTimeout ();
 };
 
 // ----------------------------------------------------------------
@@ -94,22 +182,38 @@ class SaceServiceExcutor : public SaceExcutor {
 class ServiceInfo;
     static const char* THREAD_NAME;
     static const char* NAME;
+    static const char* CHILD_THREAD_NAME;
     static const int   TIMEOUT;
+    static const int   MAX_CHILD_EVENTS;
 
     vector<ServiceInfo*> mRunningService;
     map<uint64_t, ServiceInfo*> mSeqService;
     map<string, ServiceInfo*> mNameService;
 
+    /* pidfd of every running service, child_watch_thread wakes the
+     * excutor when one exits. -1 polls on TIMEOUT without pidfd support.
+     */
+    int mChildEpoll;
+    int mChildWake;
+    pthread_t mChildWatcher;
+
     void monitor_service_status();
     void handleServiceInfo (sp<SaceCommand>, sp<SaceWriter>, SaceResult &);
+    virtual bool messageTarget (const sp<SaceMessageHeader>&, string *target) override;
+    int watch_child (pid_t pid);
+    static void* child_watch_thread (void*);
 
 public:
-    SaceServiceExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_SERVICE, NAME, THREAD_NAME) {}
+    SaceServiceExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_SERVICE, NAME, THREAD_NAME) {
+        mChildEpoll = -1;
+        mChildWake  = -1;
+    }
     ~SaceServiceExcutor();
 protected:
-    virtual void excuteNormal (sp<SaceMessageHeader>) override;
+    virtual void excuteNormal (const sp<SaceMessageHeader>&) override;
     virtual long receive_msg_timeout();
     virtual void excuteTimeout();
+    virtual bool onInit();
     virtual void onUninit();
 
 private:
@@ -124,11 +228,15 @@ private:
         uint64_t label;
         bool request_stop;
         enum SaceServiceFlags flags;
+        int pidfd;
+        /* the only client its CANCEL is taken from */
+        SaceClientIdentifier owner;
 
         const string to_string();
 
         void add_writer (sp<SaceWriter> wr);
-        void sendResponse (SaceStatusResponse& response);
+        /* writers are corked in batch when it is given */
+        void sendResponse (SaceStatusResponse& response, SaceWriterBatch *batch = nullptr);
     private:
         string sveDescriptor;
     };
@@ -141,21 +249,33 @@ struct CommandInfo;
 
     static const char* THREAD_NAME;
     static const char* NAME;
+    static const nsecs_t DESTROYED_KEEP;
 
+    /* commands run on pool strands, the slow popen/pclose stay outside */
+    mutex mCmdLock;
     vector<CommandInfo*> mRunningCmd;
     map<SaceClientIdentifier, vector<uint64_t>> mClientCmd;
     map<uint64_t, CommandInfo*> mSeqCmd;
+    /* DESTROY and START are on different strands : a START handed over
+     * before its client's DESTROY is refused, whenever it runs.
+     */
+    map<SaceClientIdentifier, nsecs_t> mDestroyedClient;
 public:
-    SaceNormalExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_NORMAL, NAME, THREAD_NAME) {}
+    SaceNormalExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_NORMAL, NAME, THREAD_NAME, true) {}
     ~SaceNormalExcutor();
 protected:
-    virtual void excuteNormal (sp<SaceMessageHeader>) override;
+    virtual void excuteNormal (const sp<SaceMessageHeader>&) override;
+    virtual bool messageKey (const sp<SaceMessageHeader>&, uint64_t *key) override;
     virtual void onUninit();
 
 private:
-    void startNormalCmd (sp<SaceReaderMessage>);
-    void closeNormalCmd (sp<SaceReaderMessage>);
-    void destroyNormalCmd (sp<SaceReaderMessage>);
+    void startNormalCmd (SaceReaderMessage*);
+    void closeNormalCmd (SaceReaderMessage*);
+    void destroyNormalCmd (SaceReaderMessage*);
+    void cancelNormalCmd (SaceReaderMessage*);
+    /* mCmdLock must be held */
+    void forgetNormalCmd (CommandInfo*, const SaceClientIdentifier&);
+    bool destroyedClient (SaceReaderMessage*);
 
     struct CommandInfo {
         int fd;
@@ -168,7 +288,6 @@ private:
     };
 };
 
-void set_proc_capability (CapSet &);
 void handle_command_params (sp<SaceCommandParams>);
 
 static pthread_rwlock_t pidlist_lock = PTHREAD_RWLOCK_INITIALIZER;
@@ -178,8 +297,13 @@ static struct pid {
     pid_t pid;
 } *pidlist;
 
-int sace_popen(const char *, const char *, sp<SaceCommandParams>);
-int sace_pclose (int fd);
+/* script_fd >= 0 runs that sealed memfd with sh, a non empty argv is exec'd without sh,
+ * cmd only names the child in both cases.
+ */
+int sace_popen(const char *cmd, const char *xtype, sp<CommandParams> param, pid_t *out_pid, int script_fd,
+        const vector<string> &argv = vector<string>());
+/* kill_now : SIGKILL right away instead of waiting for it to exit */
+int sace_pclose (int fd, bool kill_now = false);
 
 }; //namespace android
 #endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_MAILBOX_H
+#define _SACE_MAILBOX_H
+
+#include <utils/RefBase.h>
+#include <atomic>
+
+using namespace std;
+
+namespace android {
+
+/* link embedded in everything queued to a SaceMailbox */
+struct SaceMailboxNode {
+    atomic<SaceMailboxNode*> mboxNext;
+
+    SaceMailboxNode ():mboxNext(nullptr) {}
+};
+
+/* intrusive MPSC queue (Vyukov) : push is wait-free from any thread, only
+ * the owner thread pops. A queued T holds the strong reference taken by
+ * push, so a T must not sit in two mailboxes at once.
+ */
+template <typename T>
+class SaceMailbox {
+    atomic<SaceMailboxNode*> mHead;
+    SaceMailboxNode *mTail;
+    SaceMailboxNode mStub;
+
+    void link (SaceMailboxNode *node) {
+        node->mboxNext.store(nullptr, memory_order_relaxed);
+        SaceMailboxNode *prev = mHead.exchange(node, memory_order_acq_rel);
+        prev->mboxNext.store(node, memory_order_release);
+    }
+
+    sp<T> take (SaceMailboxNode *node) {
+        sp<T> msg = static_cast<T*>(node);
+        msg->decStrong(this);
+        return msg;
+    }
+
+public:
+    SaceMailbox () {
+        mHead.store(&mStub);
+        mTail = &mStub;
+    }
+
+    ~SaceMailbox () {
+        while (pop() != nullptr);
+    }
+
+    void push (const sp<T> &msg) {
+        msg->incStrong(this);
+        link(msg.get());
+    }
+
+    /* nullptr when empty or a producer is half way, whose wakeup follows */
+    sp<T> pop () {
+        SaceMailboxNode *tail = mTail;
+        SaceMailboxNode *next = tail->mboxNext.load(memory_order_acquire);
+
+        if (tail == &mStub) {
+            if (next == nullptr)
+                return nullptr;
+
+            mTail = tail = next;
+            next = next->mboxNext.load(memory_order_acquire);
+        }
+
+        if (next == nullptr) {
+            if (tail != mHead.load(memory_order_acquire))
+                return nullptr;
+
+            /* tail is the last one, park the stub behind it */
+            link(&mStub);
+            next = tail->mboxNext.load(memory_order_acquire);
+            if (next == nullptr)
+                return nullptr;
+        }
+
+        mTail = next;
+        return take(tail);
+    }
+};
+
+}; //namespace android
+
+#endif
@@ -29,6 +29,8 @@ string SaceMessageHeader::mapIdToName (enum SaceMessageHandlerType handler) {
             return string("SACE_MESSAGE_HANDLER_SERVICE");
         case SACE_MESSAGE_HANDLER_EVENT:
             return string("SACE_MESSAGE_HANDLER_EVENT");
+        case SACE_MESSAGE_HANDLER_BATCH:
+            return string("SACE_MESSAGE_HANDLER_BATCH");
         default:
             return string("UNKNOWN");
     }
@@ -45,6 +47,69 @@ string SaceMessageHeader::mapTypeToName (enum SaceMessageType type) {
     }
 }
 
+string SaceMessageHeader::mapPriorityToName (enum SaceMessagePriority priority) {
+    switch (priority) {
+        case SACE_MESSAGE_PRIORITY_CONTROL:
+            return string("control");
+        case SACE_MESSAGE_PRIORITY_NORMAL:
+            return string("normal");
+        default:
+            return string("UNKNOWN");
+    }
+}
+
+void rejectMessage (const sp<SaceMessageHeader> &msg, enum SaceResultStatus status) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    if (saceMsg == nullptr)
+        return;
+
+    SaceResult result = resultByFailure();
+    result.sequence = saceMsg->msgCmd->sequence;
+    result.name = saceMsg->msgCmd->name;
+    result.resultStatus = status;
+    saceMsg->msgWriter->sendResult(result);
+}
+
+bool expiredMessage (const sp<SaceMessageHeader> &msg) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    if (saceMsg == nullptr || saceMsg->msgCmd->type == SACE_TYPE_BATCH)
+        return false;
+
+    return saceMsg->msgCmd->expired() && priorityOfMsg(msg) == SACE_MESSAGE_PRIORITY_NORMAL;
+}
+
+/* cheap requests must not wait behind queued spawns */
+enum SaceMessagePriority priorityOfMsg (const sp<SaceMessageHeader> &msg) {
+    SaceReaderMessage *saceMsg = msg->asReader();
+    if (saceMsg == nullptr)
+        return SACE_MESSAGE_PRIORITY_CONTROL;
+
+    const sp<SaceCommand> &saceCmd = saceMsg->msgCmd;
+    if (saceCmd->type == SACE_TYPE_SERVICE) {
+        switch (saceCmd->serviceCmdType) {
+            case SACE_SERVICE_CMD_STOP:
+            case SACE_SERVICE_CMD_PAUSE:
+            case SACE_SERVICE_CMD_INFO:
+            case SACE_SERVICE_CMD_CANCEL:
+                return SACE_MESSAGE_PRIORITY_CONTROL;
+            default:
+                return SACE_MESSAGE_PRIORITY_NORMAL;
+        }
+    }
+    else if (saceCmd->type == SACE_TYPE_NORMAL) {
+        switch (saceCmd->normalCmdType) {
+            case SACE_NORMAL_CMD_CLOSE:
+            case SACE_NORMAL_CMD_DESTROY:
+            case SACE_NORMAL_CMD_CANCEL:
+                return SACE_MESSAGE_PRIORITY_CONTROL;
+            default:
+                return SACE_MESSAGE_PRIORITY_NORMAL;
+        }
+    }
+
+    return SACE_MESSAGE_PRIORITY_NORMAL;
+}
+
 const string SaceMessageHeader::to_string () {
     if (!msgDescriptor.empty())
         return msgDescriptor;
@@ -58,6 +123,17 @@ const string SaceMessageHeader::to_string () {
     return msgDescriptor;
 }
 
+SaceReaderMessage* SaceMessageHeader::asReader () {
+    return msgType == SACE_MESSAGE_TYPE_NORMAL? static_cast<SaceReaderMessage*>(this) : nullptr;
+}
+
+SaceEventMessage* SaceMessageHeader::asEvent () {
+    return msgType == SACE_MESSAGE_TYPE_EVENT? static_cast<SaceEventMessage*>(this) : nullptr;
+}
+
+static_assert(sizeof(SaceReaderMessage) <= SACE_MESSAGE_BLOCK_SIZE, "SaceReaderMessage outgrows the pool block");
+static_assert(sizeof(SaceEventMessage) <= SACE_MESSAGE_BLOCK_SIZE, "SaceEventMessage outgrows the pool block");
+
 // ----------------- SaceReaderMessage ----------------
 const string SaceReaderMessage::to_string () {
     if (!msgDescriptor.empty())
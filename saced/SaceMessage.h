@@ -20,13 +20,19 @@
 #include <utils/Looper.h>
 #include <cutils/list.h>
 #include <utils/RefBase.h>
+#include <utils/Timers.h>
 
 #include <sace/SaceTypes.h>
 
 #include "SaceClient.h"
+#include "SaceMailbox.h"
+#include "SaceMessagePool.h"
 
 namespace android {
 class SaceWriter;
+class SaceMessageHeader;
+class SaceReaderMessage;
+class SaceEventMessage;
 
 // ------------------------------------------------------------
 enum SaceMessageHandlerType {
@@ -34,26 +40,80 @@ enum SaceMessageHandlerType {
     SACE_MESSAGE_HANDLER_NORMAL,
     SACE_MESSAGE_HANDLER_SERVICE,
     SACE_MESSAGE_HANDLER_EVENT,
+    SACE_MESSAGE_HANDLER_BATCH,
+    /* routing table size, keep last */
+    SACE_MESSAGE_HANDLER_MAX,
 };
 
+enum SaceMessageHandlerType typeCmdToMsg (enum SaceCommandType type);
+SaceResult resultByFailure ();
+/* answer a reader message without running it */
+void rejectMessage (const sp<SaceMessageHeader> &msg, enum SaceResultStatus status);
+/* a spawn whose client stopped waiting, control messages always run */
+bool expiredMessage (const sp<SaceMessageHeader> &msg);
+
+/* lanes of every excutor queue, a lower one is always taken first */
+enum SaceMessagePriority {
+    SACE_MESSAGE_PRIORITY_CONTROL,  /* stop/pause/info/close/destroy, events */
+    SACE_MESSAGE_PRIORITY_NORMAL,   /* spawns */
+    SACE_MESSAGE_PRIORITY_MAX,
+};
+
+enum SaceMessagePriority priorityOfMsg (const sp<SaceMessageHeader> &msg);
+
 enum SaceMessageType {
     SACE_MESSAGE_TYPE_NORMAL,
     SACE_MESSAGE_TYPE_EVENT,
 };
 
-class SaceMessageHeader : public RefBase {
+/* not RefBase : sp<> only needs incStrong/decStrong, a plain count keeps
+ * the weakref_impl allocation and its indirection off every message.
+ */
+class SaceMessageHeader : public SaceMailboxNode {
+    mutable atomic<int32_t> msgRefs;
 public:
     enum SaceMessageHandlerType msgHandler;
     enum SaceMessageType msgType;
+    enum SaceMessagePriority msgPriority;
+    /* systemTime when handed to the excutor, for queue wait */
+    nsecs_t msgQueued;
 
-    SaceMessageHeader (enum SaceMessageType type) {
+    SaceMessageHeader (enum SaceMessageType type):msgRefs(0) {
         msgType = type;
+        msgPriority = SACE_MESSAGE_PRIORITY_NORMAL;
+        msgQueued = 0;
+    }
+
+    virtual ~SaceMessageHeader () {}
+
+    void incStrong (const void *id __unused) const {
+        msgRefs.fetch_add(1, memory_order_relaxed);
     }
 
+    /* the last reference gives the block back to its pool */
+    void decStrong (const void *id __unused) const {
+        if (msgRefs.fetch_sub(1, memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    /* every message kind comes from the per-thread SaceMessagePool */
+    static void* operator new (size_t size) {
+        return SaceMessagePool::alloc(size);
+    }
+
+    static void operator delete (void *ptr) {
+        SaceMessagePool::release(ptr);
+    }
+
+    /* checked by msgType, nullptr for another kind */
+    SaceReaderMessage* asReader ();
+    SaceEventMessage* asEvent ();
+
     const string to_string ();
 
     static string mapIdToName (enum SaceMessageHandlerType handler);
     static string mapTypeToName (enum SaceMessageType type);
+    static string mapPriorityToName (enum SaceMessagePriority priority);
 private:
     string msgDescriptor;
 };
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <new>
+
+#include "SaceMessagePool.h"
+
+namespace android {
+
+const size_t SaceMessagePool::MAX_CACHED = 1024;
+SaceMessagePool::Block* const SaceMessagePool::ORPHAN = reinterpret_cast<SaceMessagePool::Block*>(1);
+
+SaceMessagePool::Local::~Local () {
+    if (pool != nullptr)
+        pool->drain();
+}
+
+SaceMessagePool* SaceMessagePool::local () {
+    static thread_local Local local;
+    if (local.pool == nullptr)
+        local.pool = new SaceMessagePool();
+
+    return local.pool;
+}
+
+void SaceMessagePool::reclaim () {
+    Block *block = mReturned.exchange(nullptr, memory_order_acquire);
+    while (block != nullptr) {
+        Block *next = block->next;
+        block->next = mFree;
+        mFree = block;
+        mCached++;
+        mOut--;
+        block = next;
+    }
+}
+
+/* owner thread exit, the pool must not be touched after it is orphaned */
+void SaceMessagePool::drain () {
+    while (true) {
+        reclaim();
+        while (mFree != nullptr) {
+            Block *next = mFree->next;
+            free(mFree);
+            mFree = next;
+        }
+        mCached = 0;
+
+        if (mOut == 0)
+            break;
+
+        /* counted before published, a release may free us right after */
+        mOrphans.store(mOut, memory_order_relaxed);
+        Block *empty = nullptr;
+        if (mReturned.compare_exchange_strong(empty, ORPHAN, memory_order_acq_rel))
+            return;
+    }
+
+    delete this;
+}
+
+void* SaceMessagePool::alloc (size_t size) {
+    SaceMessagePool *pool = local();
+    Block *block;
+
+    if (size > SACE_MESSAGE_BLOCK_SIZE) {
+        block = (Block*)malloc(sizeof(Block) + size);
+        if (block == nullptr)
+            throw bad_alloc();
+
+        block->owner = nullptr;
+        return block + 1;
+    }
+
+    if (pool->mFree == nullptr)
+        pool->reclaim();
+
+    if ((block = pool->mFree) != nullptr) {
+        pool->mFree = block->next;
+        pool->mCached--;
+    }
+    else if ((block = (Block*)malloc(sizeof(Block) + SACE_MESSAGE_BLOCK_SIZE)) == nullptr)
+        throw bad_alloc();
+
+    block->owner = pool;
+    pool->mOut++;
+    return block + 1;
+}
+
+void SaceMessagePool::release (void *ptr) {
+    if (ptr == nullptr)
+        return;
+
+    Block *block = (Block*)ptr - 1;
+    SaceMessagePool *owner = block->owner;
+
+    if (owner == nullptr) {
+        free(block);
+        return;
+    }
+
+    if (owner == local()) {
+        owner->mOut--;
+        if (owner->mCached >= MAX_CACHED) {
+            free(block);
+            return;
+        }
+
+        block->next = owner->mFree;
+        owner->mFree = block;
+        owner->mCached++;
+        return;
+    }
+
+    /* single consumer takes the whole list, so a plain push is ABA free */
+    Block *head = owner->mReturned.load(memory_order_acquire);
+    do {
+        if (head == ORPHAN) {
+            free(block);
+            if (owner->mOrphans.fetch_sub(1, memory_order_acq_rel) == 1)
+                delete owner;
+            return;
+        }
+
+        block->next = head;
+    } while (!owner->mReturned.compare_exchange_weak(head, block, memory_order_release, memory_order_acquire));
+}
+
+}; //namespace android
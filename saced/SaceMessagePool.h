@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_MESSAGE_POOL_H
+#define _SACE_MESSAGE_POOL_H
+
+#include <stddef.h>
+#include <atomic>
+
+using namespace std;
+
+/* every message kind fits one block, larger requests fall back to malloc */
+#define SACE_MESSAGE_BLOCK_SIZE 256
+
+namespace android {
+
+/* per-thread free lists of message blocks. Messages are built by readers
+ * and released by excutors, so a block freed on another thread is pushed
+ * back to the pool of the thread which allocated it.
+ *
+ * A pool is drained when its thread exits. Blocks still out then orphan
+ * it : their release frees them, and the last one frees the pool.
+ *
+ * Messages count their own references, SaceCommand stays a RefBase on the
+ * heap since it is a libsace type kept by ServiceInfo past its message.
+ */
+class SaceMessagePool {
+    struct Block {
+        Block *next;
+        SaceMessagePool *owner;
+    };
+
+    /* frees the pool of its thread on exit */
+    struct Local {
+        SaceMessagePool *pool;
+
+        Local ():pool(nullptr) {}
+        ~Local ();
+    };
+
+    static const size_t MAX_CACHED;
+    /* mReturned once the owner thread is gone */
+    static Block* const ORPHAN;
+
+    /* owner thread only */
+    Block *mFree;
+    size_t mCached;
+    /* handed out and not back on mFree */
+    size_t mOut;
+    /* freed by other threads, taken back in one exchange */
+    atomic<Block*> mReturned;
+    /* blocks still out once orphaned */
+    atomic<size_t> mOrphans;
+
+    SaceMessagePool ():mFree(nullptr), mCached(0), mOut(0), mReturned(nullptr), mOrphans(0) {}
+
+    static SaceMessagePool* local ();
+    void reclaim ();
+    void drain ();
+public:
+    static void* alloc (size_t size);
+    static void  release (void *ptr);
+};
+
+}; //namespace android
+
+#endif
@@ -17,6 +17,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <binder/IServiceManager.h>
@@ -29,6 +32,10 @@
 
 namespace android {
 #define MAX_SOCKET_BUF 1024
+#define URING_ENTRIES   256
+#define URING_BUF_COUNT 256
+#define URING_BUF_SIZE  4096
+#define RECV_CONTROL_LEN CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)
 
 enum SaceMessageHandlerType typeCmdToMsg (enum SaceCommandType type) {
     switch (type) {
@@ -38,11 +45,71 @@ enum SaceMessageHandlerType typeCmdToMsg (enum SaceCommandType type) {
             return SACE_MESSAGE_HANDLER_SERVICE;
         case SACE_TYPE_EVENT:
             return SACE_MESSAGE_HANDLER_EVENT;
+        case SACE_TYPE_BATCH:
+            return SACE_MESSAGE_HANDLER_BATCH;
         default:
             return SACE_MESSAGE_HANDLER_UNKOWN;
     }
 }
 
+/* queue the SCM_RIGHTS fds carried by msg */
+static void take_rights (struct msghdr *msg, deque<int> &fds) {
+    for (struct cmsghdr *pcmsg = CMSG_FIRSTHDR(msg); pcmsg != nullptr; pcmsg = CMSG_NXTHDR(msg, pcmsg)) {
+        if (pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int *pfds = (int*)CMSG_DATA(pcmsg);
+        size_t fd_num = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < fd_num; i++)
+            fds.push_back(pfds[i]);
+    }
+}
+
+static int recv_with_fds (int sockfd, uint8_t *buf, size_t len, deque<int> &fds) {
+    struct msghdr msg;
+    struct iovec iov[1];
+
+    union {
+        struct cmsghdr cm;
+        char control[RECV_CONTROL_LEN];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    iov[0].iov_base = buf;
+    iov[0].iov_len  = len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = sizeof(control_un.control);
+
+    int ret = TEMP_FAILURE_RETRY(recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT));
+    if (ret > 0)
+        take_rights(&msg, fds);
+
+    return ret;
+}
+
+static size_t count_scripts (const SaceCommand &cmd) {
+    size_t count = cmd.script? 1 : 0;
+    for (auto &sub : cmd.batch)
+        count += count_scripts(sub);
+
+    return count;
+}
+
+/* stream transports carry scripts in the order the sender collected them */
+static void assign_script_fds (SaceCommand &cmd, deque<int> &fds) {
+    if (cmd.script && cmd.script->get() < 0 && !fds.empty()) {
+        cmd.script = make_shared<SaceFd>(fds.front());
+        fds.pop_front();
+    }
+
+    for (auto &sub : cmd.batch)
+        assign_script_fds(sub, fds);
+}
+
 bool secured_by_uid_pid (uid_t uid, pid_t pid __unused) {
     if (uid == AID_SYSTEM || uid == AID_ROOT)
         return true;
@@ -72,22 +139,547 @@ SaceResult resultByFailure () {
 const char* SaceSocketReader::NAME        = "SRSocket";
 const char* SaceSocketReader::THREAD_NAME = "SRSocket.MT";
 const char* SaceSocketReader::WRITER_NAME = "SRSocket.SaceWriter";
-const int   SaceSocketReader::MONITOR_TIMEOUT = 10; //10s
+const int   SaceSocketReader::MONITOR_TIMEOUT = -1; //woken by fds only
+const int   SaceSocketReader::MAX_EPOLL_EVENTS = 64;
+
+SaceSocketReader::SaceSocketReader (const char *sock_name, const int sock_type):SaceReader(NAME) {
+    mSockName = string(sock_name);
+    mSockType = sock_type;
+
+    mSockFd    = -1;
+    mAcceptor  = nullptr;
+    mPolicy    = SACE_SHARD_POLICY_ROUND_ROBIN;
+    mNextShard = 0;
+    mOutQueueBytes = 0;
+    mOverflow  = SACE_OVERFLOW_DISCONNECT;
+}
+
+SaceSocketReader::~SaceSocketReader () {
+    for (size_t i = 0; i < mShards.size(); i++) {
+        if (mShards[i] != mAcceptor)
+            delete mShards[i];
+    }
+
+    mShards.clear();
+    delete mAcceptor;
+}
 
 status_t SaceSocketReader::MonitorThread::readyToRun () {
-    SACE_LOGI("%s Starting %d:%d", mReader->getName(), getpid(), gettid());
+    SACE_LOGI("%s Starting %d:%d", mName, getpid(), gettid());
+    SaceConfig::applyThreadSched(SACE_THREAD_READER);
     return NO_ERROR;
 }
 
 bool SaceSocketReader::MonitorThread::threadLoop () {
     bool ret;
     do {
-        ret = mReader->recv_data_or_connection();
+        ret = mShard->recv_data_or_connection();
     } while(!exitPending() || ret);
 
     return false;
 }
 
+// --------------------------------------------------------------------------------
+SaceSocketReader::ReaderShard::ReaderShard (SaceSocketReader *reader, const string &thread_name) {
+    mReader     = reader;
+    mThreadName = thread_name;
+    mEpollFd    = -1;
+    mWakeFd     = -1;
+    mThread     = nullptr;
+    mUring      = nullptr;
+    mWakeValue  = 0;
+    mConnections.store(0);
+
+    memset(&mRecvMsg, 0, sizeof(mRecvMsg));
+    mRecvMsg.msg_controllen = RECV_CONTROL_LEN;
+}
+
+SaceSocketReader::ReaderShard::~ReaderShard () {
+    for (size_t i = 0; i < mClients.size(); i++) {
+        ClientSocket *climsg = mClients[i];
+        if (climsg == nullptr)
+            continue;
+
+        SACE_LOGI("%s destroy release client uid=%d, pid=%d", mThreadName.c_str(), climsg->client.uid, climsg->client.pid);
+        close(climsg->fd);
+        delete climsg;
+    }
+    mClients.clear();
+
+    for (ClientSocket *climsg : mPending) {
+        close(climsg->fd);
+        delete climsg;
+    }
+    mPending.clear();
+
+    if (mWakeFd >= 0)
+        close(mWakeFd);
+    if (mEpollFd >= 0)
+        close(mEpollFd);
+    delete mUring;
+}
+
+bool SaceSocketReader::ReaderShard::setup_uring () {
+    if (!SaceConfig::socketUring() || !SaceUring::supported())
+        return false;
+
+    mUring = new SaceUring();
+    if (!mUring->init(URING_ENTRIES) || !mUring->setupBuffers(0, URING_BUF_COUNT, URING_BUF_SIZE)) {
+        SACE_LOGW("%s io_uring unavailable, use epoll", mThreadName.c_str());
+        delete mUring;
+        mUring = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool SaceSocketReader::ReaderShard::setup () {
+    if (mEpollFd >= 0 || mUring != nullptr)
+        return true;
+
+    if (setup_uring()) {
+        mWakeFd = eventfd(0, EFD_CLOEXEC);
+        if (mWakeFd < 0) {
+            SACE_LOGE("%s eventfd fail %s", mThreadName.c_str(), strerror(errno));
+            delete mUring;
+            mUring = nullptr;
+            return false;
+        }
+
+        mUring->prepRead(mWakeFd, &mWakeValue, sizeof(mWakeValue), SACE_URING_DATA(nullptr, SACE_URING_TAG_WAKE));
+        return true;
+    }
+
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        SACE_LOGE("%s epoll_create1 fail %s", mThreadName.c_str(), strerror(errno));
+        return false;
+    }
+
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mWakeFd < 0) {
+        SACE_LOGE("%s eventfd fail %s", mThreadName.c_str(), strerror(errno));
+        goto err;
+    }
+
+    /* data.ptr : nullptr for listen socket, &mWakeFd for handover */
+    if (!monitor(mWakeFd, &mWakeFd))
+        goto err;
+
+    return true;
+
+err:
+    if (mWakeFd >= 0)
+        close(mWakeFd);
+    close(mEpollFd);
+    mWakeFd  = -1;
+    mEpollFd = -1;
+    return false;
+}
+
+bool SaceSocketReader::ReaderShard::start () {
+    if (mThread == nullptr)
+        mThread = new MonitorThread(this, mThreadName.c_str());
+
+    if (mThread == nullptr) {
+        SACE_LOGE("%s initialize MonitorThread failed", mThreadName.c_str());
+        return false;
+    }
+
+    mThread->run(mThreadName.c_str());
+    return true;
+}
+
+void SaceSocketReader::ReaderShard::stop () {
+    shutdown_clients();
+
+    /* a multishot accept holds the listen socket open */
+    if (mUring != nullptr) {
+        mUring->prepCancel(SACE_URING_DATA(nullptr, SACE_URING_TAG_ACCEPT), SACE_URING_DATA(nullptr, SACE_URING_TAG_CANCEL));
+        mUring->submit();
+    }
+
+    if (mThread != nullptr) {
+        if (mThread->isRunning())
+            mThread->requestExit();
+    }
+}
+
+bool SaceSocketReader::ReaderShard::monitor (int fd, void *ptr) {
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.ptr = ptr;
+
+    /* clients also report peer half-close */
+    if (ptr != nullptr && ptr != &mWakeFd)
+        ev.events |= EPOLLRDHUP;
+
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        SACE_LOGE("%s Monitor fd=%d fail %s", mThreadName.c_str(), fd, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void SaceSocketReader::ReaderShard::unmonitor (int fd) {
+    if (mEpollFd >= 0)
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+bool SaceSocketReader::ReaderShard::watch_listen (int fd) {
+    if (mUring == nullptr)
+        return monitor(fd, nullptr);
+
+    /* blocking client sockets, io_uring waits for them */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return mUring->prepMultishotAccept(fd, SOCK_CLOEXEC, SACE_URING_DATA(nullptr, SACE_URING_TAG_ACCEPT));
+}
+
+/* called in the acceptor thread */
+void SaceSocketReader::ReaderShard::adopt (ClientSocket *climsg) {
+    uint64_t val = 1;
+
+    mConnections++;
+
+    mPendingLock.lock();
+    mPending.push_back(climsg);
+    mPendingLock.unlock();
+
+    if (TEMP_FAILURE_RETRY(write(mWakeFd, &val, sizeof(val))) < 0)
+        SACE_LOGE("%s wake shard fail %s", mThreadName.c_str(), strerror(errno));
+}
+
+void SaceSocketReader::ReaderShard::adopt_pending () {
+    uint64_t val;
+    vector<ClientSocket*> pending;
+
+    /* io_uring already consumed the counter */
+    if (mUring == nullptr)
+        TEMP_FAILURE_RETRY(read(mWakeFd, &val, sizeof(val)));
+
+    mPendingLock.lock();
+    pending.swap(mPending);
+    mPendingLock.unlock();
+
+    for (ClientSocket *climsg : pending) {
+        mConnections--;
+        add_client(climsg);
+    }
+}
+
+/* called in the shard thread */
+void SaceSocketReader::ReaderShard::add_client (ClientSocket *climsg) {
+    /* the acceptor and this shard may run different backends */
+    int fl = fcntl(climsg->fd, F_GETFL);
+    fcntl(climsg->fd, F_SETFL, mUring != nullptr? (fl & ~O_NONBLOCK) : (fl | O_NONBLOCK));
+
+    if (mUring != nullptr) {
+        if (!arm_recv(climsg)) {
+            SACE_LOGE("%s io_uring recv fd=%d fail", mThreadName.c_str(), climsg->fd);
+            close(climsg->fd);
+            delete climsg;
+            return;
+        }
+
+        if ((size_t)climsg->fd >= mClients.size())
+            mClients.resize(climsg->fd + 1, nullptr);
+        mClients[climsg->fd] = climsg;
+        mConnections++;
+
+        climsg->writer->attachUring(mUring);
+        return;
+    }
+
+    climsg->writer->attachEpoll(mEpollFd, climsg);
+    if (!monitor(climsg->fd, climsg)) {
+        close(climsg->fd);
+        delete climsg;
+        return;
+    }
+
+    if ((size_t)climsg->fd >= mClients.size())
+        mClients.resize(climsg->fd + 1, nullptr);
+    mClients[climsg->fd] = climsg;
+    mConnections++;
+
+    /* data may arrive before the shard watches the fd */
+    recv_client_data(climsg);
+}
+
+void SaceSocketReader::ReaderShard::remove_client (ClientSocket *climsg, bool recv_armed) {
+    if ((size_t)climsg->fd < mClients.size())
+        mClients[climsg->fd] = nullptr;
+    mConnections--;
+
+    mReader->handle_socket_close(*climsg);
+
+    /* queued results are dropped, executors may still hold the writer */
+    climsg->writer->close();
+
+    /* io_uring : the fd and climsg live until the multishot recv is gone */
+    if (mUring != nullptr) {
+        if (recv_armed) {
+            climsg->closing = true;
+            mUring->prepCancel(SACE_URING_DATA(climsg, SACE_URING_TAG_RECV), SACE_URING_DATA(nullptr, SACE_URING_TAG_CANCEL));
+            return;
+        }
+    }
+
+    unmonitor(climsg->fd);
+    close(climsg->fd);
+    climsg->fd = -1;
+    delete climsg;
+}
+
+void SaceSocketReader::ReaderShard::shutdown_clients () {
+    for (size_t i = 0; i < mClients.size(); i++)
+        if (mClients[i] != nullptr) shutdown(mClients[i]->fd, SHUT_WR);
+}
+
+/* handle every complete command in rxbuf, false if the stream is corrupted */
+bool SaceSocketReader::ReaderShard::parse_client_frames (ClientSocket *climsg) {
+    const uint8_t *data;
+    uint32_t len;
+
+    while (true) {
+        enum SaceStreamBuffer::FrameState state = climsg->rxbuf.nextFrame(&data, &len);
+        /* left fds only belong to the partial frame */
+        if (state == SaceStreamBuffer::FRAME_NONE && climsg->rxfds.size() <= SACE_MAX_RECV_FDS)
+            return true;
+
+        if (state != SaceStreamBuffer::FRAME_READY) {
+            SACE_LOGE("%s - %d Invalide SaceCommand Frame uid=%d, pid=%d", mThreadName.c_str(), climsg->fd,
+                climsg->client.uid, climsg->client.pid);
+            return false;
+        }
+
+        Parcel parcel;
+        parcel.setData(data, len);
+        climsg->rxbuf.consume(len);
+
+        sp<SaceCommand> saceCmd = new SaceCommand();
+        if (saceCmd->readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s - %d drop malformed SaceCommand uid=%d, pid=%d", mThreadName.c_str(), climsg->fd,
+                climsg->client.uid, climsg->client.pid);
+
+            SaceResult rslt = resultByFailure();
+            rslt.sequence = saceCmd->sequence;
+            climsg->writer->sendResult(rslt);
+            continue;
+        }
+        assign_script_fds(*saceCmd, climsg->rxfds);
+
+        mReader->handle_socket_msg(*climsg, saceCmd);
+    }
+}
+
+void SaceSocketReader::ReaderShard::recv_client_data (ClientSocket *climsg) {
+    int fd = climsg->fd;
+
+    /* edge-triggered : drain the socket until EAGAIN */
+    while (true) {
+        uint8_t *buf = climsg->rxbuf.reserve(MAX_SOCKET_BUF);
+        int ret = recv_with_fds(fd, buf, climsg->rxbuf.writable(), climsg->rxfds);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        if (ret <= 0) {
+            if (ret < 0)
+                SACE_LOGE("%s Receive Incomming Command fail uid=%d, pid=%d, fd=%d : %s", mThreadName.c_str(), climsg->client.uid, climsg->client.pid, fd, strerror(errno));
+            else
+                SACE_LOGE("%s Close Socket uid=%d, pid=%d, fd=%d", mThreadName.c_str(), climsg->client.uid, climsg->client.pid, fd);
+
+            remove_client(climsg);
+            return;
+        }
+
+        climsg->rxbuf.commit(ret);
+        if (!parse_client_frames(climsg)) {
+            remove_client(climsg);
+            return;
+        }
+    }
+}
+
+bool SaceSocketReader::ReaderShard::arm_recv (ClientSocket *climsg) {
+    return mUring->prepMultishotRecvmsg(climsg->fd, &mRecvMsg, SACE_URING_DATA(climsg, SACE_URING_TAG_RECV));
+}
+
+/* buffer holds io_uring_recvmsg_out, control then payload, return the payload size */
+uint32_t SaceSocketReader::ReaderShard::take_recvmsg (ClientSocket *climsg, uint8_t *buf, int res) {
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out*)buf;
+    size_t head = sizeof(*out) + mRecvMsg.msg_namelen + mRecvMsg.msg_controllen;
+    if ((size_t)res < head)
+        return 0;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = buf + sizeof(*out) + mRecvMsg.msg_namelen;
+    msg.msg_controllen = out->controllen;
+    take_rights(&msg, climsg->rxfds);
+
+    uint32_t len = min<uint32_t>(out->payloadlen, res - head);
+    if (len > 0) {
+        memcpy(climsg->rxbuf.reserve(len), buf + head, len);
+        climsg->rxbuf.commit(len);
+    }
+
+    return len;
+}
+
+void SaceSocketReader::ReaderShard::handle_recv_cqe (ClientSocket *climsg, int res, uint32_t flags) {
+    bool more = flags & IORING_CQE_F_MORE;
+    uint32_t payload = 0;
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0 && !climsg->closing)
+            payload = take_recvmsg(climsg, mUring->buffer(bid), res);
+        mUring->recycleBuffer(bid);
+    }
+
+    if (climsg->closing) {
+        if (!more) {
+            close(climsg->fd);
+            delete climsg;
+        }
+        return;
+    }
+
+    /* an empty payload is the peer closing */
+    if (res > 0 && payload > 0) {
+        if (!parse_client_frames(climsg)) {
+            remove_client(climsg, more);
+            return;
+        }
+    }
+    else if (res != -ENOBUFS) {
+        if (res < 0)
+            SACE_LOGE("%s Receive Incomming Command fail uid=%d, pid=%d, fd=%d : %s", mThreadName.c_str(), climsg->client.uid, climsg->client.pid, climsg->fd, strerror(-res));
+        else
+            SACE_LOGE("%s Close Socket uid=%d, pid=%d, fd=%d", mThreadName.c_str(), climsg->client.uid, climsg->client.pid, climsg->fd);
+
+        remove_client(climsg, more);
+        return;
+    }
+
+    /* multishot ended (buffers ran out or kernel limit), arm it again */
+    if (!more && !arm_recv(climsg))
+        remove_client(climsg, false);
+}
+
+bool SaceSocketReader::ReaderShard::recv_data_or_connection_uring () {
+    int ret = mUring->submitAndWait(MONITOR_TIMEOUT);
+    SaceStats::wokeUp(SACE_WAKEUP_READER);
+    if (ret < 0) {
+        SACE_LOGE("%s io_uring wait fail %s", mThreadName.c_str(), strerror(errno));
+        return errno != EBADF;
+    }
+
+    struct io_uring_cqe *cqe;
+    while (mUring->peekCqe(&cqe)) {
+        uint64_t data  = cqe->user_data;
+        int      res   = cqe->res;
+        uint32_t flags = cqe->flags;
+        mUring->cqeSeen();
+
+        switch (SACE_URING_TAG(data)) {
+            case SACE_URING_TAG_ACCEPT:
+                if (res >= 0)
+                    mReader->new_client(res);
+                else if (res != -EBADF && res != -EINVAL && res != -ECANCELED)
+                    SACE_LOGE("%s Accept Client fail %s", mThreadName.c_str(), strerror(-res));
+
+                /* listen socket closed by stopRead */
+                if (!(flags & IORING_CQE_F_MORE) && mReader->mSockFd >= 0)
+                    watch_listen(mReader->mSockFd);
+                break;
+            case SACE_URING_TAG_WAKE:
+                adopt_pending();
+                mUring->prepRead(mWakeFd, &mWakeValue, sizeof(mWakeValue), SACE_URING_DATA(nullptr, SACE_URING_TAG_WAKE));
+                break;
+            case SACE_URING_TAG_RECV:
+                handle_recv_cqe(static_cast<ClientSocket*>(SACE_URING_PTR(data)), res, flags);
+                break;
+            case SACE_URING_TAG_SEND: {
+                SaceSocketWriter::SendRequest *req = static_cast<SaceSocketWriter::SendRequest*>(SACE_URING_PTR(data));
+                /* dropping inflight may release the last reference, keep it until done */
+                sp<SaceSocketWriter> writer = req->inflight;
+                writer->onSendComplete(req, res);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool SaceSocketReader::ReaderShard::recv_data_or_connection () {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    if (mUring != nullptr)
+        return recv_data_or_connection_uring();
+
+    /* no Valide fd */
+    if (mEpollFd < 0)
+        return false;
+
+    int ret = epoll_wait(mEpollFd, events, MAX_EPOLL_EVENTS, MONITOR_TIMEOUT);
+    SaceStats::wokeUp(SACE_WAKEUP_READER);
+    if (ret == 0) {
+        return true;
+    }
+    else if (ret < 0) {
+        if (errno == EINTR)
+            return true;
+
+        SACE_LOGE("%s Monitor Clients fail %s", mThreadName.c_str(), strerror(errno));
+        return errno != EBADF;
+    }
+
+    for (int i = 0; i < ret; i++) {
+        void *ptr = events[i].data.ptr;
+
+        /* original socket monitor connection */
+        if (ptr == nullptr) {
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                SACE_LOGE("%s Listen-Socket err, reopen...", mThreadName.c_str());
+                unmonitor(mReader->mSockFd);
+                close(mReader->mSockFd);
+                mReader->mSockFd = -1;
+                mReader->setup_socket();
+            }
+            else
+                mReader->accept_clients();
+            continue;
+        }
+
+        /* connections handed over by the acceptor */
+        if (ptr == &mWakeFd) {
+            adopt_pending();
+            continue;
+        }
+
+        /* connected clients, flush queued results before reading, the read may remove it */
+        ClientSocket *climsg = static_cast<ClientSocket*>(ptr);
+        if (events[i].events & EPOLLOUT)
+            climsg->writer->onWritable();
+
+        /* read pending data before handling hangup */
+        if (events[i].events & EPOLLIN)
+            recv_client_data(climsg);
+        else if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            remove_client(climsg);
+    }
+
+    return true;
+}
+
+// --------------------------------------------------------------------------------
 void SaceSocketReader::handle_socket_msg (ClientSocket& climsg, sp<SaceCommand>& saceCmd) {
     SACE_LOGI("%s handle command : %s", getName(), saceCmd->to_string().c_str());
     if (secured_by_uid_pid(climsg.client.uid, climsg.client.pid)) {
@@ -96,7 +688,7 @@ void SaceSocketReader::handle_socket_msg (ClientSocket& climsg, sp<SaceCommand>&
         saceMsg->msgCmd     = saceCmd;
         saceMsg->msgWriter  = climsg.writer;
         saceMsg->msgClient  = climsg.client;
-        post(saceMsg);
+        postUnlessExpired(saceMsg);
     }
     else {
         SaceResult rslt = resultBySecure();
@@ -121,165 +713,524 @@ void SaceSocketReader::handle_socket_close (ClientSocket& climsg) {
     post(saceMsg);
 }
 
-bool SaceSocketReader::recv_data_or_connection () {
-    fd_set fds_read;
-    struct stat fd_stat;
-    int max_sockfd = -1;
-    int i, ret;
+SaceSocketReader::ReaderShard* SaceSocketReader::select_shard (const SaceClientIdentifier &client) {
+    size_t num = mShards.size();
+    if (num == 1)
+        return mShards[0];
+
+    switch (mPolicy) {
+        case SACE_SHARD_POLICY_LEAST_CONN: {
+            ReaderShard *least = mShards[0];
+            for (size_t i = 1; i < num; i++) {
+                if (mShards[i]->connections() < least->connections())
+                    least = mShards[i];
+            }
+            return least;
+        }
+        case SACE_SHARD_POLICY_HASH:
+            return mShards[(uint32_t)client.pid % num];
+        default:
+            return mShards[mNextShard++ % num];
+    }
+}
 
-    FD_ZERO(&fds_read);
-    /* original socket monitor connection */
-    if (mSockFd >= 0) {
-        FD_SET(mSockFd, &fds_read);
-        max_sockfd = mSockFd;
+/* called in the acceptor thread */
+void SaceSocketReader::new_client (int client_fd) {
+    struct ucred cred;
+    socklen_t len = sizeof(struct ucred);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        SACE_LOGE("%s SO_PEERCRED fd=%d fail %s", getName(), client_fd, strerror(errno));
+        close(client_fd);
+        return;
     }
 
-    /* connected clients */
-    for(i = 0; i < MAX_CLIENT_NUM; i++) {
-        if (mClients[i].fd > 0) {
-            FD_SET(mClients[i].fd, &fds_read);
-            max_sockfd = max(max_sockfd, mClients[i].fd);
+    //record clients
+    ClientSocket *climsg = new ClientSocket();
+    climsg->fd = client_fd;
+    climsg->client = SaceClientIdentifier(cred.uid, cred.pid);
+    climsg->writer = new SaceSocketWriter(NAME, cred.pid, client_fd);
+    climsg->writer->setOutQueue(mOutQueueBytes, mOverflow);
+
+    ReaderShard *shard = select_shard(climsg->client);
+    if (shard == mAcceptor)
+        shard->add_client(climsg);
+    else
+        shard->adopt(climsg);
+}
+
+void SaceSocketReader::accept_clients () {
+    /* edge-triggered : accept until the backlog is empty */
+    while (true) {
+        struct sockaddr addr;
+        socklen_t slen = sizeof(addr);
+
+        int client_fd = accept4(mSockFd, &addr, &slen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                SACE_LOGE("%s Accept Client %d fail %s", getName(), mSockFd, strerror(errno));
+            return;
         }
+
+        new_client(client_fd);
     }
+}
 
-    /* no Valide fd */
-    if (max_sockfd < 0)
-        return false;
+int SaceSocketReader::setup_socket () {
+    int socket_id;
 
-    struct timeval timeout = {MONITOR_TIMEOUT, 0};
-    ret = select(max_sockfd + 1, &fds_read, nullptr, nullptr, &timeout);
-    if (ret == 0) {
-        return true;
+    socket_id = socket_local_server(mSockName.c_str(), ANDROID_SOCKET_NAMESPACE_ABSTRACT, mSockType);
+    if (socket_id < 0) {
+        SACE_LOGE("%s create socket %s fail %s", getName(), mSockName.c_str(), strerror(errno));
+        return 1;
     }
-    else if (ret < 0) {
-        SACE_LOGE("%s Monitor Clients fail %s", getName(), strerror(errno));
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            if (mClients[i].fd > 0 && fstat(mClients[i].fd, &fd_stat) < 0) {
-                close(mClients[i].fd);
-                mClients[i].fd = -1;
-                handle_socket_close(mClients[i]);
-            }
+
+    if (listen(socket_id, SOCKET_LISTEN_BACKLOG) < 0) {
+        SACE_LOGE("%s initialize socket client number fail %s", getName(), strerror(errno));
+        close(socket_id);
+        return 1;
+    }
+
+    fcntl(socket_id, F_SETFL, fcntl(socket_id, F_GETFL) | O_NONBLOCK);
+    /* socket_local_server doesn't set it */
+    fcntl(socket_id, F_SETFD, FD_CLOEXEC);
+
+    if (!mAcceptor->watch_listen(socket_id)) {
+        close(socket_id);
+        return 1;
+    }
+
+    mSockFd = socket_id;
+    return 0;
+}
+
+bool SaceSocketReader::startRead () {
+    if (mAcceptor == nullptr) {
+        int shards = SaceConfig::socketShards();
+        mPolicy = SaceConfig::socketShardPolicy();
+        mOutQueueBytes = SaceConfig::socketOutQueueBytes();
+        mOverflow = SaceConfig::socketOverflowPolicy();
+
+        mAcceptor = new ReaderShard(this, THREAD_NAME);
+        if (shards == 1)
+            mShards.push_back(mAcceptor);
+        else {
+            for (int i = 0; i < shards; i++)
+                mShards.push_back(new ReaderShard(this, string(NAME).append(".S").append(::to_string(i))));
         }
 
-        if (fstat(mSockFd, &fd_stat) < 0) {
-            SACE_LOGE("%s Listen-Socket err=%s, reopen...", getName(), strerror(errno));
-            setup_socket();
+        SACE_LOGI("%s %d shards policy=%s", getName(), shards, SaceConfig::mapShardPolicyToName(mPolicy));
+    }
+
+    if (!mAcceptor->setup()) {
+        SACE_LOGE("%s setup acceptor failed", getName());
+        return false;
+    }
+
+    for (ReaderShard *shard : mShards) {
+        if (!shard->setup()) {
+            SACE_LOGE("%s setup shard failed", getName());
+            return false;
         }
+    }
 
-        return true;
+    if (mSockFd < 0 && setup_socket()) {
+        SACE_LOGE("%s setup_socket failed", getName());
+        return false;
+    }
+
+    /* shards must be running before the acceptor hands connections over */
+    for (ReaderShard *shard : mShards) {
+        if (shard != mAcceptor && !shard->start())
+            goto err;
+    }
+
+    if (!mAcceptor->start())
+        goto err;
+
+    return true;
+
+err:
+    mAcceptor->unmonitor(mSockFd);
+    close(mSockFd);
+    mSockFd = -1;
+    return false;
+}
+
+void SaceSocketReader::stopRead () {
+    int sockfd = mSockFd;
+    mSockFd = -1;
+    close(sockfd);
+
+    SACE_LOGI("%s Stoping... ", getName());
+    for (ReaderShard *shard : mShards) {
+        if (shard != mAcceptor)
+            shard->stop();
     }
 
-    if (FD_ISSET(mSockFd, &fds_read)) {
+    if (mAcceptor != nullptr)
+        mAcceptor->stop();
+}
+
+// ------------------------------------------------------------------
+const char* SaceShmReader::NAME        = "SRShm";
+const char* SaceShmReader::THREAD_NAME = "SRShm.MT";
+const int   SaceShmReader::MONITOR_TIMEOUT  = -1; //woken by fds and doorbells only
+const int   SaceShmReader::MAX_EPOLL_EVENTS = 64;
+const int   SaceShmReader::MAX_DRAIN_FRAMES = 64;
+
+SaceShmReader::~SaceShmReader () {
+    for (ShmClient *shm : mClients)
+        delete shm;
+
+    mClients.clear();
+    if (mEpollFd >= 0)
+        close(mEpollFd);
+}
+
+status_t SaceShmReader::MonitorThread::readyToRun () {
+    SACE_LOGI("%s Starting %d:%d", mReader->getName(), getpid(), gettid());
+    SaceConfig::applyThreadSched(SACE_THREAD_READER);
+    return NO_ERROR;
+}
+
+bool SaceShmReader::MonitorThread::threadLoop () {
+    bool ret;
+    do {
+        ret = mReader->recv_data_or_connection();
+    } while(!exitPending() || ret);
+
+    return false;
+}
+
+void SaceShmReader::handle_shm_msg (ShmClient& shm, sp<SaceCommand>& saceCmd) {
+    SACE_LOGI("%s handle command : %s", getName(), saceCmd->to_string().c_str());
+    if (secured_by_uid_pid(shm.client.uid, shm.client.pid)) {
+        sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
+        saceMsg->msgHandler = typeCmdToMsg(saceCmd->type);
+        saceMsg->msgCmd     = saceCmd;
+        saceMsg->msgWriter  = shm.writer;
+        saceMsg->msgClient  = shm.client;
+        postUnlessExpired(saceMsg);
+    }
+    else {
+        SaceResult rslt = resultBySecure();
+        rslt.sequence = saceCmd->sequence;
+        shm.writer->sendResult(rslt);
+    }
+}
+
+void SaceShmReader::handle_shm_close (ShmClient& shm) {
+    sp<SaceCommand> saceCmd = new SaceCommand();
+    SACE_LOGI("%s client[%d:%d] close command", getName(), shm.client.uid, shm.client.pid);
+
+    saceCmd->init();
+    saceCmd->sequence = 0;
+    saceCmd->normalCmdType = SACE_NORMAL_CMD_DESTROY;
+    saceCmd->name = ::to_string(shm.client.pid).append(":0");
+
+    sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
+    saceMsg->msgHandler = SACE_MESSAGE_HANDLER_NORMAL;
+    saceMsg->msgCmd     = saceCmd;
+    saceMsg->msgWriter  = shm.writer;
+    saceMsg->msgClient  = shm.client;
+    post(saceMsg);
+}
+
+void SaceShmReader::accept_clients () {
+    while (true) {
         struct sockaddr addr;
         socklen_t slen = sizeof(addr);
 
-        int client_fd = accept(mSockFd, &addr, &slen);
+        int client_fd = accept4(mSockFd, &addr, &slen, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_fd < 0) {
-            SACE_LOGE("%s Accept Client %d fail %s", getName(), mSockFd, strerror(errno));
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                SACE_LOGE("%s Accept Client %d fail %s", getName(), mSockFd, strerror(errno));
+            return;
+        }
+
+        struct ucred cred;
+        socklen_t len = sizeof(struct ucred);
+        if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+            SACE_LOGE("%s SO_PEERCRED fd=%d fail %s", getName(), client_fd, strerror(errno));
+            close(client_fd);
+            continue;
+        }
+
+        ShmClient *shm = new ShmClient();
+        shm->client   = SaceClientIdentifier(cred.uid, cred.pid);
+        shm->channel  = new SaceShmChannel();
+        shm->channel->sockfd = client_fd;
+        shm->attached = false;
+        shm->sockEvent = {shm, false};
+        shm->bellEvent = {shm, true};
+
+        /* the handshake comes first on the socket, then only hangup */
+        struct epoll_event ev;
+        ev.events   = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = &shm->sockEvent;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            SACE_LOGE("%s Monitor Client fd=%d fail %s", getName(), client_fd, strerror(errno));
+            delete shm;
+            continue;
+        }
+
+        mClients.push_back(shm);
+    }
+}
+
+/* receive the ring memfd and both doorbells */
+bool SaceShmReader::attach_client (ShmClient *shm) {
+    struct msghdr msg;
+    uint32_t magic = 0;
+
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_SHM_FD_NUM)];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    struct iovec iov[1];
+    iov[0].iov_base = &magic;
+    iov[0].iov_len  = sizeof(magic);
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = sizeof(control_un.control);
+
+    int ret = TEMP_FAILURE_RETRY(recvmsg(shm->channel->sockfd, &msg, MSG_CMSG_CLOEXEC));
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+
+    struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg);
+    if (ret != sizeof(magic) || magic != SACE_SHM_MAGIC || pcmsg == nullptr ||
+        pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS) {
+        SACE_LOGE("%s invalid handshake uid=%d, pid=%d", getName(), shm->client.uid, shm->client.pid);
+        return false;
+    }
+
+    int *fds = (int*)CMSG_DATA(pcmsg);
+    size_t fd_num = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (fd_num != SACE_SHM_FD_NUM) {
+        SACE_LOGE("%s handshake carry %d fds uid=%d, pid=%d", getName(), (int)fd_num, shm->client.uid, shm->client.pid);
+        for (size_t i = 0; i < fd_num; i++)
+            close(fds[i]);
+        return false;
+    }
+
+    shm->channel->submit_bell   = fds[SACE_SHM_FD_SUBMIT_BELL];
+    shm->channel->complete_bell = fds[SACE_SHM_FD_COMPLETE_BELL];
+
+    bool mapped = shm->channel->region.map(fds[SACE_SHM_FD_MEMORY]);
+    close(fds[SACE_SHM_FD_MEMORY]);
+    if (!mapped)
+        return false;
+
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.ptr = &shm->bellEvent;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, shm->channel->submit_bell, &ev) < 0) {
+        SACE_LOGE("%s Monitor doorbell fail %s", getName(), strerror(errno));
+        return false;
+    }
+
+    shm->writer   = new SaceShmWriter(NAME, shm->client.pid, shm->channel);
+    shm->attached = true;
+
+    /* only hangup is interesting from now on */
+    ev.events   = EPOLLRDHUP;
+    ev.data.ptr = &shm->sockEvent;
+    epoll_ctl(mEpollFd, EPOLL_CTL_MOD, shm->channel->sockfd, &ev);
+
+    SACE_LOGI("%s client[%d:%d] attached", getName(), shm->client.uid, shm->client.pid);
+    return true;
+}
+
+void SaceShmReader::remove_client (ShmClient *shm) {
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, shm->channel->sockfd, nullptr);
+    if (shm->channel->submit_bell >= 0)
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, shm->channel->submit_bell, nullptr);
+
+    for (vector<ShmClient*>::iterator it = mClients.begin(); it != mClients.end(); it++) {
+        if (*it == shm) {
+            mClients.erase(it);
+            break;
+        }
+    }
+
+    /* writers in flight keep the channel mapped */
+    if (shm->attached)
+        handle_shm_close(*shm);
+    delete shm;
+}
+
+/* false if the ring is corrupted, *more if frames are left for the next round */
+bool SaceShmReader::drain_client (ShmClient *shm, bool *more) {
+    SaceRing &ring = shm->channel->region.submit;
+
+    for (int i = 0; i < MAX_DRAIN_FRAMES; i++) {
+        enum SaceStreamBuffer::FrameState state = ring.pop(mFrame, SaceCommandHeader::parcelSize());
+        if (state == SaceStreamBuffer::FRAME_NONE)
             return true;
+
+        if (state == SaceStreamBuffer::FRAME_INVALID) {
+            SACE_LOGE("%s Invalide SaceCommand Frame uid=%d, pid=%d", getName(), shm->client.uid, shm->client.pid);
+            return false;
         }
 
-        int i;
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            if (mClients[i].fd < 0) {
-                mClients[i].fd = client_fd;
+        Parcel parcel;
+        parcel.setData(mFrame.data(), mFrame.size());
 
-                struct ucred cred;
-                socklen_t len = sizeof(struct ucred);
-                getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len);
+        sp<SaceCommand> saceCmd = new SaceCommand();
+        if (saceCmd->readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s drop malformed SaceCommand uid=%d, pid=%d", getName(), shm->client.uid, shm->client.pid);
 
-                //record clients
-                mClients[i].client = SaceClientIdentifier(cred.uid, cred.pid);
-                mClients[i].writer = new SaceSocketWriter(NAME, cred.pid, client_fd);
-                break;
-            }
+            SaceResult rslt = resultByFailure();
+            rslt.sequence = saceCmd->sequence;
+            shm->writer->sendResult(rslt);
+            continue;
         }
 
-        if (i >= MAX_CLIENT_NUM) {
-            SACE_LOGW("%s Over MAX Client Number[%d], Reject...", getName(), MAX_CLIENT_NUM);
-            close(client_fd);
+        /* the sender queued the script fds on the socket before the frame */
+        size_t scripts = count_scripts(*saceCmd);
+        if (scripts > 0) {
+            deque<int> fds;
+            uint8_t byte;
+            if (recv_with_fds(shm->channel->sockfd, &byte, sizeof(byte), fds) <= 0 || fds.size() != scripts)
+                SACE_LOGE("%s missing script fds uid=%d, pid=%d", getName(), shm->client.uid, shm->client.pid);
+
+            assign_script_fds(*saceCmd, fds);
+            for (int fd : fds)
+                close(fd);
         }
+
+        handle_shm_msg(*shm, saceCmd);
     }
-    else {
-        struct msghdr msg;
-        struct iovec iov[1];
-        char temp[MAX_SOCKET_BUF] = {0};
-
-        iov[0].iov_base = temp;
-        iov[0].iov_len  = MAX_SOCKET_BUF;
-
-        msg.msg_name    = nullptr;
-        msg.msg_namelen = 0;
-        msg.msg_iov    = iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control    = nullptr;
-        msg.msg_controllen = 0;
-
-        for (i = 0; i < MAX_CLIENT_NUM; i++) {
-            int fd = mClients[i].fd;
-            if (fd < 0 || !FD_ISSET(fd, &fds_read))
-                continue;
 
-            ret = TEMP_FAILURE_RETRY(read(fd, temp, MAX_SOCKET_BUF));
-            if (ret <= 0) {
-                if (ret < 0)
-                    SACE_LOGE("%s Receive Incomming Command fail uid=%d, pid=%d, fd=%d : %s", getName(), mClients[i].client.uid, mClients[i].client.pid, fd, strerror(errno));
-                else
-                    SACE_LOGE("%s Close Socket uid=%d, pid=%d, fd=%d", getName(), mClients[i].client.uid, mClients[i].client.pid, fd);
+    *more = !ring.empty();
+    return true;
+}
 
-                close(mClients[i].fd);
-                mClients[i].fd = -1;
+bool SaceShmReader::recv_data_or_connection () {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    bool busy = false;
 
-                handle_socket_close(mClients[i]);
+    /* no Valide fd */
+    if (mEpollFd < 0)
+        return false;
 
-                continue;
-            }
+    /* drain every ring, arm its doorbell only if it is really empty */
+    for (size_t i = 0; i < mClients.size();) {
+        ShmClient *shm = mClients[i];
+        bool more = false;
 
-            if ((size_t)ret < SaceCommandHeader::parcelSize()) {
-                SACE_LOGE("%s - %d Invalide SaceCommandHeader. Size %d, Required %d", getName(), fd, ret, SaceCommandHeader::parcelSize());
-                continue;
-            }
+        if (!shm->attached) {
+            i++;
+            continue;
+        }
 
-            Parcel parcel;
-            parcel.setData((uint8_t*)temp, ret);
+        if (!drain_client(shm, &more)) {
+            remove_client(shm);
+            continue;
+        }
 
-            SaceCommandHeader header;
-            header.readFromParcel(&parcel);
-            if (parcel.dataSize() < header.len) {
-                SACE_LOGE("%s - %d Invalide SaceCommand. Size %d, Required %d", getName(), fd, (uint32_t)parcel.dataSize(), header.len);
-                continue;
-            }
+        if (more || !shm->channel->region.submit.prepareWait())
+            busy = true;
+        i++;
+    }
 
-            sp<SaceCommand> saceCmd = new SaceCommand();
-            parcel.setDataPosition(0);
-            saceCmd->readFromParcel(&parcel);
+    int ret = epoll_wait(mEpollFd, events, MAX_EPOLL_EVENTS, busy? 0 : MONITOR_TIMEOUT);
+    if (!busy)
+        SaceStats::wokeUp(SACE_WAKEUP_READER);
 
-            handle_socket_msg(mClients[i], saceCmd);
+    /* producers don't need doorbells while we are draining */
+    for (ShmClient *shm : mClients) {
+        if (shm->attached)
+            shm->channel->region.submit.finishWait();
+    }
+
+    if (ret == 0) {
+        return true;
+    }
+    else if (ret < 0) {
+        if (errno == EINTR)
+            return true;
+
+        SACE_LOGE("%s Monitor Clients fail %s", getName(), strerror(errno));
+        return errno != EBADF;
+    }
+
+    /* hangups are handled last, events may still point to them */
+    vector<ShmClient*> closed;
+    for (int i = 0; i < ret; i++) {
+        ShmEvent *shmev = static_cast<ShmEvent*>(events[i].data.ptr);
+
+        if (shmev == nullptr) {
+            accept_clients();
+            continue;
+        }
+
+        ShmClient *shm = shmev->owner;
+        if (shmev->bell) {
+            uint64_t value;
+            TEMP_FAILURE_RETRY(read(shm->channel->submit_bell, &value, sizeof(value)));
+            /* also rung when the client made room in the completion ring */
+            shm->writer->flush();
+            continue;
         }
+
+        if (!shm->attached && (events[i].events & EPOLLIN)) {
+            if (!attach_client(shm))
+                closed.push_back(shm);
+        }
+        else if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            closed.push_back(shm);
+    }
+
+    for (ShmClient *shm : closed) {
+        SACE_LOGI("%s Close client uid=%d, pid=%d", getName(), shm->client.uid, shm->client.pid);
+        remove_client(shm);
     }
 
     return true;
 }
 
-void SaceSocketReader::close_socket () {
-    for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-        if (mClients[i].fd > 0)
-            close(mClients[i].fd);
-        mClients[i].fd = -1;
+int SaceShmReader::setup_socket () {
+    if (mEpollFd < 0 && (mEpollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        SACE_LOGE("%s epoll_create1 fail %s", getName(), strerror(errno));
+        return 1;
     }
-}
 
-int SaceSocketReader::setup_socket () {
-    int socket_id;
-
-    socket_id = socket_local_server(mSockName.c_str(), ANDROID_SOCKET_NAMESPACE_ABSTRACT, mSockType);
+    int socket_id = socket_local_server(mSockName.c_str(), ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
     if (socket_id < 0) {
         SACE_LOGE("%s create socket %s fail %s", getName(), mSockName.c_str(), strerror(errno));
         return 1;
     }
 
-    if (listen(socket_id, MAX_CLIENT_NUM) < 0) {
+    if (listen(socket_id, SOCKET_LISTEN_BACKLOG) < 0) {
         SACE_LOGE("%s initialize socket client number fail %s", getName(), strerror(errno));
+        close(socket_id);
+        return 1;
+    }
+
+    fcntl(socket_id, F_SETFL, fcntl(socket_id, F_GETFL) | O_NONBLOCK);
+    /* socket_local_server doesn't set it */
+    fcntl(socket_id, F_SETFD, FD_CLOEXEC);
+
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, socket_id, &ev) < 0) {
+        SACE_LOGE("%s Monitor Listen-Socket fail %s", getName(), strerror(errno));
+        close(socket_id);
         return 1;
     }
 
@@ -287,7 +1238,7 @@ int SaceSocketReader::setup_socket () {
     return 0;
 }
 
-bool SaceSocketReader::startRead () {
+bool SaceShmReader::startRead () {
     if (mSockFd < 0 && setup_socket()) {
         SACE_LOGE("%s setup_socket failed", getName());
         return false;
@@ -306,12 +1257,12 @@ bool SaceSocketReader::startRead () {
     return true;
 }
 
-void SaceSocketReader::stopRead () {
+void SaceShmReader::stopRead () {
     close(mSockFd);
 
     SACE_LOGI("%s Stoping... ", getName());
-    for (int i = 0; i < MAX_CLIENT_NUM; i++)
-        if (mClients[i].fd > 0) shutdown(mClients[i].fd, SHUT_WR);
+    for (ShmClient *shm : mClients)
+        shutdown(shm->channel->sockfd, SHUT_WR);
 
     if (mThread != nullptr) {
         if (mThread->isRunning())
@@ -352,38 +1303,71 @@ void SaceBinderReader::SaceManagerService::destroyClient (SaceClientIdentifier&
     mLock.unlock();
 }
 
-android::binder::Status SaceBinderReader::SaceManagerService::sendCommand (const SaceCommand& command, SaceResult* rslt) {
+/* post the command, rslt is null for submitCommand */
+bool SaceBinderReader::SaceManagerService::submit (const SaceCommand& command, SaceResult* rslt, sp<SaceBinderWriter>& writer) {
+    SaceClientIdentifier client = SaceClientIdentifier(IPCThreadState::self()->getCallingUid(), IPCThreadState::self()->getCallingPid());
+    sp<ISaceListener> listener;
+    SaceResult result;
+
+    mLock.lock();
+    map<SaceClientIdentifier, sp<ISaceListener>>::iterator it = mListener.find(client);
+    if (it != mListener.end())
+        listener = it->second;
+    mLock.unlock();
+
+    if (rslt == nullptr && listener == nullptr) {
+        SACE_LOGE("%s client[%d:%d] submit without listener %s", NAME, client.uid, client.pid, command.to_string().c_str());
+        return false;
+    }
+
+    writer = new SaceBinderWriter(NAME, client.pid, listener, rslt);
     if (mExit) {
         SACE_LOGI("%s handle command : %s Ignored For Exited", NAME, command.to_string().c_str());
-        rslt = new SaceResult(resultByFailure());
-        return android::binder::Status::ok();
+        result = resultByFailure();
+        goto reject;
     }
     else
         SACE_LOGI("%s handle command : %s", NAME, command.to_string().c_str());
 
-    if (!secured_by_uid_pid(IPCThreadState::self()->getCallingUid(), IPCThreadState::self()->getCallingPid())) {
-        rslt = new SaceResult(resultBySecure());
-        return android::binder::Status::ok();
+    if (!secured_by_uid_pid(client.uid, client.pid)) {
+        result = resultBySecure();
+        goto reject;
     }
 
-    rslt = new SaceResult();
-    SaceClientIdentifier client = SaceClientIdentifier(IPCThreadState::self()->getCallingUid(), IPCThreadState::self()->getCallingPid());
+    {
+        sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
+        saceMsg->msgHandler = typeCmdToMsg(command.type);
+        saceMsg->msgCmd  = new SaceCommand(command);
+        saceMsg->msgWriter = writer;
+        saceMsg->msgClient = client;
+        postUnlessExpired(saceMsg);
+    }
+    return true;
 
-    map<SaceClientIdentifier, sp<ISaceListener>>::iterator it = mListener.find(client);
-    sp<SaceBinderWriter> writer = new SaceBinderWriter(NAME, IPCThreadState::self()->getCallingPid(), it->second, rslt);
+reject:
+    result.sequence = command.sequence;
+    result.name = command.name;
+    writer->sendResult(result);
+    return true;
+}
 
-    sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
-    saceMsg->msgHandler = typeCmdToMsg(command.type);
-    saceMsg->msgCmd  = new SaceCommand(command);
-    saceMsg->msgWriter = writer;
-    saceMsg->msgClient = client;
+/* synchronous wrapper on submit, parks the binder thread until an excutor answers */
+android::binder::Status SaceBinderReader::SaceManagerService::sendCommand (const SaceCommand& command, SaceResult* rslt) {
+    sp<SaceBinderWriter> writer;
 
-    post(saceMsg);
-    writer->waitResult();
+    if (submit(command, rslt, writer))
+        writer->waitResult();
 
     return android::binder::Status::ok();
 }
 
+android::binder::Status SaceBinderReader::SaceManagerService::submitCommand (const SaceCommand& command) {
+    sp<SaceBinderWriter> writer;
+
+    submit(command, nullptr, writer);
+    return android::binder::Status::ok();
+}
+
 android::binder::Status SaceBinderReader::SaceManagerService::unregisterListener () {
     if (mExit) {
         SACE_LOGI("SaceManagerService %d:%d unregisterListener Ignored For Exited", IPCThreadState::self()->getCallingUid(),
@@ -410,6 +1394,16 @@ android::binder::Status SaceBinderReader::SaceManagerService::unregisterListener
     return android::binder::Status::ok();
 }
 
+status_t SaceBinderReader::SaceManagerService::dump (int fd, const Vector<String16>& args __unused) {
+    string out = "SaceService queue wait:\n";
+    SaceCommandDispatcher::getInstance()->dump(out);
+
+    if (write(fd, out.c_str(), out.size()) < 0)
+        return -errno;
+
+    return NO_ERROR;
+}
+
 android::binder::Status SaceBinderReader::SaceManagerService::registerListener (const sp<ISaceListener>& listener) {
     if (mExit) {
         SACE_LOGI("SaceManagerService %d:%d registerListener Ignored For Exited", IPCThreadState::self()->getCallingUid(),
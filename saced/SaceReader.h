@@ -20,9 +20,18 @@
 #include <string>
 #include <utils/Thread.h>
 #include <map>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
 
 #include <binder/IBinder.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+#include <sace/SaceStream.h>
 
+#include "SaceConfig.h"
+#include "SaceUring.h"
 #include "SaceMessage.h"
 #include "SaceClient.h"
 #include "SaceWriter.h"
@@ -31,7 +40,7 @@
 #include "android/BnSaceListener.h"
 #include "android/BnSaceManager.h"
 
-#define MAX_CLIENT_NUM 32
+#define SOCKET_LISTEN_BACKLOG 128
 
 namespace android {
 
@@ -58,66 +67,194 @@ class SaceSocketReader : public SaceReader, public MessageDistributable {
     static const char *THREAD_NAME;
     static const char *WRITER_NAME;
     static const int  MONITOR_TIMEOUT;
+    static const int  MAX_EPOLL_EVENTS;
+
+    class ReaderShard;
 
     int mSockFd;
     int mSockType;
-    Thread *mThread;
     string mSockName;
 
-public:
-    SaceSocketReader (const char *sock_name, const int sock_type):SaceReader(NAME) {
-        mSockName = string(sock_name);
-        mSockType = sock_type;
+    /* mAcceptor owns the listen socket, it is also the only shard when unsharded */
+    ReaderShard *mAcceptor;
+    vector<ReaderShard*> mShards;
+    enum SaceShardPolicy mPolicy;
+    uint32_t mNextShard;
 
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            mClients[i].client = SaceClientIdentifier(-1, -1);
-            mClients[i].writer = nullptr;
-            mClients[i].fd = -1;
-        }
+    /* outbound queue of every client writer */
+    size_t mOutQueueBytes;
+    enum SaceOverflowPolicy mOverflow;
 
-        mSockFd = -1;
-    }
+public:
+    SaceSocketReader (const char *sock_name, const int sock_type);
 
     virtual bool startRead();
     virtual void stopRead();
 
-    ~SaceSocketReader() {
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            if (mClients[i].fd > 0) {
-                SACE_LOGI("%s destroy release client uid=%d, pid=%d", getName(), mClients[i].client.uid, mClients[i].client.pid);
-                close(mClients[i].fd);
-            }
+    ~SaceSocketReader();
+private:
+    /* epoll_event.data.ptr of every connected client */
+    struct ClientSocket {
+        int fd;
+        SaceClientIdentifier client;
+        sp<SaceSocketWriter> writer;
+        /* reassemble pipelined/partial commands */
+        SaceStreamBuffer rxbuf;
+        /* script fds arrive ahead of the frames that carry them */
+        deque<int> rxfds;
+        /* io_uring : removed, waiting for the last recv completion */
+        bool closing;
+
+        ClientSocket ():rxbuf(SaceCommandHeader::parcelSize()) {
+            closing = false;
+        }
 
-            mClients[i].client = SaceClientIdentifier(-1, -1);
-            mClients[i].writer = nullptr;
+        ~ClientSocket () {
+            for (int fd : rxfds)
+                close(fd);
         }
-    }
-private:
+    };
+
+    /* one event loop with its own clients, decoding and security checks */
+    class ReaderShard {
+        SaceSocketReader *mReader;
+        string mThreadName;
+        int mEpollFd;
+        int mWakeFd;
+        Thread *mThread;
+
+        /* io_uring backend, nullptr runs the epoll loop */
+        SaceUring *mUring;
+        uint64_t mWakeValue;
+        /* multishot recvmsg layout, shared by every client */
+        struct msghdr mRecvMsg;
+
+        /* indexed by client fd, grows with the largest accepted fd */
+        vector<ClientSocket*> mClients;
+
+        /* handed over by the acceptor, adopted in the shard thread */
+        mutex mPendingLock;
+        vector<ClientSocket*> mPending;
+        atomic<uint32_t> mConnections;
+
+    public:
+        ReaderShard (SaceSocketReader *reader, const string &thread_name);
+        ~ReaderShard ();
+
+        bool setup ();
+        bool start ();
+        void stop ();
+
+        bool monitor (int fd, void *ptr);
+        void unmonitor (int fd);
+        bool watch_listen (int fd);
+        void adopt (ClientSocket *climsg);
+        void add_client (ClientSocket *climsg);
+        void shutdown_clients ();
+
+        uint32_t connections () const {
+            return mConnections.load();
+        }
+
+        bool recv_data_or_connection ();
+    private:
+        bool setup_uring ();
+        bool recv_data_or_connection_uring ();
+        void handle_recv_cqe (ClientSocket*, int res, uint32_t flags);
+        bool arm_recv (ClientSocket*);
+        uint32_t take_recvmsg (ClientSocket*, uint8_t *buf, int res);
+        void adopt_pending ();
+        void recv_client_data (ClientSocket*);
+        bool parse_client_frames (ClientSocket*);
+        void remove_client (ClientSocket*, bool recv_armed = true);
+    };
+
     /* listen client message */
     class MonitorThread : public Thread {
-        SaceSocketReader *mReader;
+        ReaderShard *mShard;
+        const char *mName;
     public:
-        MonitorThread (SaceSocketReader *reader) {
-            mReader = reader;
+        MonitorThread (ReaderShard *shard, const char *name) {
+            mShard = shard;
+            mName  = name;
         }
     protected:
         status_t readyToRun();
         bool threadLoop();
     };
 
-    struct ClientSocket {
-        int fd;
+    int setup_socket();
+    void accept_clients();
+    void new_client(int client_fd);
+    ReaderShard* select_shard(const SaceClientIdentifier &client);
+    void handle_socket_msg(ClientSocket&, sp<SaceCommand>&);
+    void handle_socket_close(ClientSocket &);
+};
+
+// --------------------------------------
+/* commands from the submission ring of each shared-memory client */
+class SaceShmReader : public SaceReader, public MessageDistributable {
+    static const char *NAME;
+    static const char *THREAD_NAME;
+    static const int  MONITOR_TIMEOUT;
+    static const int  MAX_EPOLL_EVENTS;
+    static const int  MAX_DRAIN_FRAMES;
+
+    struct ShmClient;
+
+    /* epoll_event.data.ptr, nullptr for the listen socket */
+    struct ShmEvent {
+        ShmClient *owner;
+        bool bell;
+    };
+
+    struct ShmClient {
         SaceClientIdentifier client;
-        sp<SaceSocketWriter> writer;
+        sp<SaceShmChannel> channel;
+        sp<SaceShmWriter>  writer;
+        ShmEvent sockEvent;
+        ShmEvent bellEvent;
+        bool attached;
     };
 
-    /* child thread */
-    ClientSocket mClients[MAX_CLIENT_NUM];
+    int mSockFd;
+    int mEpollFd;
+    Thread *mThread;
+    string mSockName;
+    vector<ShmClient*> mClients;
+    vector<uint8_t> mFrame;
+
+public:
+    explicit SaceShmReader (const char *sock_name):SaceReader(NAME) {
+        mSockName = string(sock_name);
+        mSockFd  = -1;
+        mEpollFd = -1;
+        mThread  = nullptr;
+    }
+
+    virtual bool startRead();
+    virtual void stopRead();
+
+    ~SaceShmReader();
+private:
+    class MonitorThread : public Thread {
+        SaceShmReader *mReader;
+    public:
+        MonitorThread (SaceShmReader *reader) {
+            mReader = reader;
+        }
+    protected:
+        status_t readyToRun();
+        bool threadLoop();
+    };
 
     int setup_socket();
-    void close_socket();
-    void handle_socket_msg(ClientSocket&, sp<SaceCommand>&);
-    void handle_socket_close(ClientSocket &);
+    void accept_clients();
+    bool attach_client(ShmClient*);
+    bool drain_client(ShmClient*, bool *more);
+    void remove_client(ShmClient*);
+    void handle_shm_msg(ShmClient&, sp<SaceCommand>&);
+    void handle_shm_close(ShmClient&);
     bool recv_data_or_connection();
 };
 
@@ -154,10 +291,16 @@ private:
 
     public:
         virtual android::binder::Status sendCommand (const SaceCommand& command, SaceResult* rslt) override;
+        virtual android::binder::Status submitCommand (const SaceCommand& command) override;
         virtual android::binder::Status registerListener (const sp<ISaceListener>& listener) override;
         virtual android::binder::Status unregisterListener () override;
+        /* dumpsys SaceService */
+        virtual status_t dump (int fd, const Vector<String16>& args) override;
 
         void destroyClient (SaceClientIdentifier& client);
+    private:
+        bool submit (const SaceCommand& command, SaceResult* rslt, sp<SaceBinderWriter>& writer);
+    public:
 
 		void stop () {
             mExit = true;
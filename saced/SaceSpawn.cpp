@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <sace/SaceLog.h>
+#include "SaceSpawn.h"
+#include "SaceSpawner.h"
+#include "SaceConfig.h"
+
+extern char **environ;
+
+namespace android {
+
+const size_t SaceSpawn::STACK_SIZE = 64 * 1024;
+const char *SaceSpawn::DEFAULT_PATH = "/product/bin:/apex/com.android.runtime/bin:/system/bin:/system/xbin:/odm/bin:/vendor/bin:/vendor/xbin";
+const char *SaceSpawn::SHELL_CHARS  = "|&;<>()$`\\\"'*?[]{}~#\n";
+
+mutex SaceSpawn::mPathLock;
+unordered_map<string, string> SaceSpawn::mPathCache;
+
+bool SaceSpawn::mHasProcessCpus = false;
+cpu_set_t SaceSpawn::mProcessCpus;
+vector<string> SaceSpawn::mProcessGroups;
+
+SaceSpawn::SaceSpawn (const string &name):mName(name) {
+    mHasParams = false;
+    memset(&mCapHeader, 0, sizeof(mCapHeader));
+    memset(mCapData, 0, sizeof(mCapData));
+    mGid = 0;
+    mUid = 0;
+    mFailed = nullptr;
+    mFailedErrno = 0;
+    mExecErrno = 0;
+    mResetSched = false;
+    sigemptyset(&mSigMask);
+}
+
+/* the cgroups SaceSchedConfig moves threads between : 3:cpuset:/foreground */
+void SaceSpawn::saveProcessSched () {
+    static const pair<const char*, const char*> mounts[] = {
+        {"cpuset", "/dev/cpuset"}, {"schedtune", "/dev/stune"}, {"cpu", "/dev/cpuctl"},
+    };
+
+    mHasProcessCpus = sched_getaffinity(0, sizeof(mProcessCpus), &mProcessCpus) == 0;
+
+    ifstream cgroups("/proc/self/cgroup");
+    string line;
+    while (getline(cgroups, line)) {
+        size_t first = line.find(':');
+        size_t second = first == string::npos? string::npos : line.find(':', first + 1);
+        if (second == string::npos)
+            continue;
+
+        stringstream controllers(line.substr(first + 1, second - first - 1));
+        string controller;
+        while (getline(controllers, controller, ',')) {
+            for (const pair<const char*, const char*> &mount : mounts) {
+                string tasks = string(mount.second) + line.substr(second + 1) + "/tasks";
+                if (controller == mount.first && access(tasks.c_str(), W_OK) == 0)
+                    mProcessGroups.push_back(tasks);
+            }
+        }
+    }
+}
+
+void SaceSpawn::addDup2 (int fd, int target) {
+    mActions.push_back({fd, target});
+}
+
+void SaceSpawn::addClose (int fd) {
+    mActions.push_back({fd, -1});
+}
+
+void SaceSpawn::inheritFd (int fd) {
+    mActions.push_back({fd, fd});
+}
+
+void SaceSpawn::setParams (const sp<CommandParams> &params) {
+    if (!params.get())
+        return;
+
+    mHasParams = true;
+    mRlimits   = params->rlimits;
+    mGid       = params->gid;
+    mGroups    = params->supp_gids;
+    mUid       = params->uid;
+    mSeclabel  = params->seclabel;
+
+    /* exactly the listed caps, none at all for an empty set. inheritable
+     * too, the child raises them ambient to keep them across exec.
+     */
+    mCapHeader.version = _LINUX_CAPABILITY_VERSION_3;
+    mCapHeader.pid     = 0;
+
+    for (size_t cap = 0; cap < params->capabilities.size(); cap++) {
+        if (!params->capabilities.test(cap) || CAP_TO_INDEX(cap) >= _LINUX_CAPABILITY_U32S_3)
+            continue;
+
+        mCapData[CAP_TO_INDEX(cap)].permitted   |= CAP_TO_MASK(cap);
+        mCapData[CAP_TO_INDEX(cap)].effective   |= CAP_TO_MASK(cap);
+        mCapData[CAP_TO_INDEX(cap)].inheritable |= CAP_TO_MASK(cap);
+    }
+}
+
+static int sace_close_range (unsigned int first, unsigned int last) {
+#ifdef __NR_close_range
+    return syscall(__NR_close_range, first, last, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* the first failed step is logged by the parent, the child goes on
+ * unless it is about credentials.
+ */
+void SaceSpawn::childFailed (const char *step) {
+    if (mFailed == nullptr) {
+        mFailedErrno = errno;
+        mFailed = step;
+    }
+}
+
+void SaceSpawn::childAbort (const char *step) {
+    mFailedErrno = errno;
+    mFailed = step;
+    mExecErrno = mFailedErrno != 0? mFailedErrno : EPERM;
+    _exit(127);
+}
+
+int SaceSpawn::child (void *data) {
+    SaceSpawn *self = (SaceSpawn*)data;
+    struct sigaction sa;
+
+    /* daemon handlers must not run on the shared memory, blocked until exec */
+    for (int sig = 1; sig < _NSIG; sig++) {
+        if (sigaction(sig, nullptr, &sa) < 0 || sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL)
+            continue;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = SIG_DFL;
+        sigaction(sig, &sa, nullptr);
+    }
+
+    for (const FileAction &action : self->mActions) {
+        if (action.target < 0)
+            close(action.fd);
+        else if (action.fd == action.target)
+            fcntl(action.fd, F_SETFD, 0);
+        else if (dup2(action.fd, action.target) < 0)
+            self->childFailed("dup2");
+    }
+
+    /* before 5.9 CLOEXEC alone does it */
+    unsigned int first = STDERR_FILENO + 1;
+    for (int keep : self->mKeepFds) {
+        if ((unsigned int)keep > first)
+            sace_close_range(first, keep - 1);
+        first = keep + 1;
+    }
+    sace_close_range(first, ~0U);
+
+    for (const pair<int, struct rlimit> &rlt : self->mRlimits) {
+        if (setrlimit(rlt.first, &rlt.second) < 0)
+            self->childFailed("setrlimit");
+    }
+
+    /* SCHED_RESET_ON_FORK only covers FIFO and negative nice */
+    if (self->mResetSched) {
+        struct sched_param param;
+        param.sched_priority = 0;
+        if (sched_setscheduler(0, SCHED_OTHER, &param) < 0 || setpriority(PRIO_PROCESS, 0, 0) < 0)
+            self->childFailed("sched");
+
+        if (mHasProcessCpus && sched_setaffinity(0, sizeof(mProcessCpus), &mProcessCpus) < 0)
+            self->childFailed("affinity");
+
+        /* 0 is the writer itself */
+        for (const string &tasks : mProcessGroups) {
+            int fd = open(tasks.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd < 0 || write(fd, "0", 1) < 0)
+                self->childFailed("cgroup");
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    /* bionic set*id are plain syscalls, they don't signal the daemon threads.
+     * ids first with the caps kept, then trimmed to the listed ones.
+     */
+    if (self->mHasParams) {
+        if (setgroups(self->mGroups.size(), self->mGroups.empty()? nullptr : &self->mGroups[0]) < 0)
+            self->childAbort("setgroups");
+
+        if (self->mGid > 0 && setgid(self->mGid) < 0)
+            self->childAbort("setgid");
+
+        if (prctl(PR_SET_KEEPCAPS, 1) < 0)
+            self->childAbort("keepcaps");
+
+        if (self->mUid > 0 && setuid(self->mUid) < 0)
+            self->childAbort("setuid");
+
+        if (syscall(__NR_capset, &self->mCapHeader, self->mCapData) < 0)
+            self->childAbort("capset");
+
+        for (int cap = 0; cap <= CAP_LAST_CAP; cap++) {
+            if (CAP_TO_INDEX(cap) < _LINUX_CAPABILITY_U32S_3 &&
+                (self->mCapData[CAP_TO_INDEX(cap)].permitted & CAP_TO_MASK(cap)) &&
+                prctl(PR_CAP_AMBIENT, PR_CAP_AMBIENT_RAISE, cap, 0, 0) < 0)
+                self->childFailed("ambient");
+        }
+    }
+
+    /* setexeccon without its allocations */
+    if (!self->mSeclabel.empty()) {
+        int fd = open("/proc/thread-self/attr/exec", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, self->mSeclabel.c_str(), self->mSeclabel.size() + 1) < 0)
+            self->childAbort("setexeccon");
+        close(fd);
+    }
+
+    prctl(PR_SET_NAME, self->mName.c_str());
+    prctl(PR_SET_PDEATHSIG, SIGHUP);
+
+    sigprocmask(SIG_SETMASK, &self->mSigMask, nullptr);
+    execve(self->mPath.c_str(), &self->mArgv[0], environ);
+
+    self->mExecErrno = errno;
+    _exit(127);
+}
+
+bool SaceSpawn::splitCommand (const string &cmd, vector<string> *argv) {
+    if (cmd.find_first_of(SHELL_CHARS) != string::npos)
+        return false;
+
+    argv->clear();
+    for (size_t pos = 0; (pos = cmd.find_first_not_of(" \t", pos)) != string::npos;) {
+        size_t end = cmd.find_first_of(" \t", pos);
+        argv->push_back(cmd.substr(pos, end == string::npos? string::npos : end - pos));
+        pos = end;
+    }
+
+    /* VAR=value cmd sets the environment */
+    return !argv->empty() && argv->front().find('=') == string::npos;
+}
+
+bool SaceSpawn::resolvePath (const string &name, string *path) {
+    if (name.find('/') != string::npos) {
+        *path = name;
+        return true;
+    }
+
+    {
+        lock_guard<mutex> lock(mPathLock);
+        auto it = mPathCache.find(name);
+        if (it != mPathCache.end()) {
+            *path = it->second;
+            return true;
+        }
+    }
+
+    /* builtins such as cd are never found, they are left to sh */
+    const char *env = getenv("PATH");
+    string dirs = env? env : DEFAULT_PATH;
+    for (size_t pos = 0; pos <= dirs.size();) {
+        size_t end = dirs.find(':', pos);
+        if (end == string::npos)
+            end = dirs.size();
+
+        string candidate = dirs.substr(pos, end - pos).append("/").append(name);
+        if (end > pos && access(candidate.c_str(), X_OK) == 0) {
+            lock_guard<mutex> lock(mPathLock);
+            mPathCache[name] = candidate;
+            *path = candidate;
+            return true;
+        }
+
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+void SaceSpawn::forgetPath (const string &name) {
+    lock_guard<mutex> lock(mPathLock);
+    mPathCache.erase(name);
+}
+
+status_t SaceSpawn::writeToParcel (Parcel *data, vector<int> &fds) const {
+    data->writeUtf8AsUtf16(mName);
+    data->writeUtf8AsUtf16(mPath);
+    data->writeUtf8VectorAsUtf16Vector(mArgs);
+
+    uint32_t dups = 0;
+    for (const FileAction &action : mActions)
+        dups += action.target >= 0? 1 : 0;
+
+    data->writeUint32(dups);
+    for (const FileAction &action : mActions) {
+        if (action.target < 0)
+            continue;
+
+        data->writeInt32(fds.size());
+        data->writeInt32(action.target);
+        fds.push_back(action.fd);
+    }
+
+    data->writeUint32(mRlimits.size());
+    for (const pair<int, struct rlimit> &rlt : mRlimits) {
+        data->writeInt32(rlt.first);
+        data->writeUint64(rlt.second.rlim_cur);
+        data->writeUint64(rlt.second.rlim_max);
+    }
+
+    data->writeBool(mHasParams);
+    if (mHasParams) {
+        data->writeUint32(mCapHeader.version);
+        data->write(mCapData, sizeof(mCapData));
+    }
+
+    data->writeUint32(mGid);
+    data->writeInt32Vector(vector<int32_t>(mGroups.begin(), mGroups.end()));
+    data->writeUint32(mUid);
+    data->writeUtf8AsUtf16(mSeclabel);
+    return OK;
+}
+
+status_t SaceSpawn::readFromParcel (const Parcel *data, const vector<int> &fds) {
+    data->readUtf8FromUtf16(&mName);
+    data->readUtf8FromUtf16(&mPath);
+    data->readUtf8VectorFromUtf16Vector(&mArgs);
+
+    /* inherited fds come back as dup2 onto their number in the daemon */
+    uint32_t dups = data->readUint32();
+    for (uint32_t i = 0; i < dups; i++) {
+        int32_t index  = data->readInt32();
+        int32_t target = data->readInt32();
+        if (index < 0 || (size_t)index >= fds.size() || target < 0)
+            return BAD_VALUE;
+
+        mActions.push_back({fds[index], target});
+    }
+
+    uint32_t rlimits = data->readUint32();
+    if (rlimits > RLIM_NLIMITS)
+        return BAD_VALUE;
+
+    for (uint32_t i = 0; i < rlimits; i++) {
+        struct rlimit rlt;
+        int resource = data->readInt32();
+        rlt.rlim_cur = data->readUint64();
+        rlt.rlim_max = data->readUint64();
+        mRlimits.push_back(pair<int, struct rlimit>(resource, rlt));
+    }
+
+    mHasParams = data->readBool();
+    if (mHasParams) {
+        mCapHeader.version = data->readUint32();
+        mCapHeader.pid     = 0;
+        if (data->read(mCapData, sizeof(mCapData)) != OK)
+            return BAD_VALUE;
+    }
+
+    vector<int32_t> groups;
+    mGid = data->readUint32();
+    data->readInt32Vector(&groups);
+    mGroups.assign(groups.begin(), groups.end());
+    mUid = data->readUint32();
+    return data->readUtf8FromUtf16(&mSeclabel);
+}
+
+pid_t SaceSpawn::cloneChild (int flags) {
+    sigset_t all;
+    int serrno;
+
+    mArgv.clear();
+    for (string &arg : mArgs)
+        mArgv.push_back((char*)arg.c_str());
+    mArgv.push_back(nullptr);
+
+    mKeepFds.clear();
+    for (const FileAction &action : mActions) {
+        if (action.target > STDERR_FILENO)
+            mKeepFds.push_back(action.target);
+    }
+    sort(mKeepFds.begin(), mKeepFds.end());
+    mKeepFds.erase(unique(mKeepFds.begin(), mKeepFds.end()), mKeepFds.end());
+
+    void *stack = mmap(nullptr, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        SACE_LOGE("SaceSpawn %s stack errno=%d errstr=%s", mName.c_str(), errno, strerror(errno));
+        return -1;
+    }
+
+    mFailed = nullptr;
+    mExecErrno = 0;
+    mResetSched = SaceConfig::threadSchedApplied();
+
+    /* no signal until the child has reset the handlers */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &mSigMask);
+
+    pid_t pid = clone(child, (uint8_t*)stack + STACK_SIZE, flags | CLONE_VM | CLONE_VFORK | SIGCHLD, this);
+    serrno = errno;
+
+    pthread_sigmask(SIG_SETMASK, &mSigMask, nullptr);
+    munmap(stack, STACK_SIZE);
+
+    if (pid < 0) {
+        SACE_LOGE("SaceSpawn %s clone errno=%d errstr=%s", mName.c_str(), serrno, strerror(serrno));
+        errno = serrno;
+        return -1;
+    }
+
+    if (mFailed != nullptr)
+        SACE_LOGE("SaceSpawn %s %s failed : %s", mName.c_str(), mFailed, strerror(mFailedErrno));
+
+    if (mExecErrno != 0) {
+        SACE_LOGE("SaceSpawn %s did not exec %s : %s", mName.c_str(), mPath.c_str(), strerror(mExecErrno));
+        /* the child is gone already, don't leave it to the excutors */
+        if (!(flags & CLONE_PARENT)) {
+            TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+            errno = mExecErrno;
+            return -1;
+        }
+    }
+
+    return pid;
+}
+
+pid_t SaceSpawn::spawn (const char *path, const vector<string> &args) {
+    pid_t pid;
+
+    mPath = path;
+    mArgs = args;
+
+    if (SaceSpawner::getInstance()->spawn(*this, &pid))
+        return pid;
+
+    return cloneChild(0);
+}
+
+}; //namespace android
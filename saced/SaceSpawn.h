@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_SPAWN_H
+#define _SACE_SPAWN_H
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <linux/capability.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <binder/Parcel.h>
+#include <sace/SaceParams.h>
+
+using namespace std;
+
+namespace android {
+
+/* fork-free child start shared by services and popen : clone(CLONE_VM |
+ * CLONE_VFORK) on a private stack, the calling thread is suspended until
+ * the child execs, no page table is copied whatever the daemon size.
+ * Daemon fds are all CLOEXEC, the child still closes whatever it was not
+ * given with close_range, in a few syscalls whatever is open.
+ * Everything the child does is prepared by the parent, the child only
+ * issues syscalls : it shares our memory and must not allocate, lock or log.
+ */
+class SaceSpawn {
+    static const size_t STACK_SIZE;
+    static const char *DEFAULT_PATH;
+    static const char *SHELL_CHARS;
+
+    /* argv[0] -> where PATH found it, entries are dropped when exec misses */
+    static mutex mPathLock;
+    static unordered_map<string, string> mPathCache;
+
+    /* scheduling of the process before any thread config, children of
+     * reconfigured threads get it back.
+     */
+    static bool mHasProcessCpus;
+    static cpu_set_t mProcessCpus;
+    static vector<string> mProcessGroups;
+
+    /* target < 0 closes fd, fd == target clears its CLOEXEC */
+    struct FileAction {
+        int fd;
+        int target;
+    };
+
+    string mName;
+    string mPath;
+    vector<string> mArgs;
+    vector<char*> mArgv;
+    vector<FileAction> mActions;
+    /* dup2 targets above stderr, sorted, all the rest is closed by range */
+    vector<int> mKeepFds;
+
+    /* CommandParams, flattened */
+    vector<pair<int, struct rlimit>> mRlimits;
+    bool mHasParams;
+    struct __user_cap_header_struct mCapHeader;
+    struct __user_cap_data_struct mCapData[_LINUX_CAPABILITY_U32S_3];
+    gid_t mGid;
+    vector<gid_t> mGroups;
+    uid_t mUid;
+    string mSeclabel;
+
+    bool mResetSched;
+    sigset_t mSigMask;
+    /* written by the child, read once it has exec'd or exited */
+    const char *volatile mFailed;
+    volatile int mFailedErrno;
+    volatile int mExecErrno;
+
+    static int child (void *data);
+    void childFailed (const char *step);
+    /* credentials fail closed : the child exits instead of exec'ing */
+    void childAbort (const char *step);
+    /* the child is reaped on exec failure, unless it is someone else's */
+    pid_t cloneChild (int flags);
+
+    /* SaceSpawner request, fds to pass are appended to fds and referenced
+     * by index, closes are dropped : the spawner has nothing else open.
+     */
+    status_t writeToParcel (Parcel *data, vector<int> &fds) const;
+    status_t readFromParcel (const Parcel *data, const vector<int> &fds);
+
+    friend class SaceSpawner;
+
+public:
+    explicit SaceSpawn (const string &name);
+
+    void addDup2 (int fd, int target);
+    void addClose (int fd);
+    /* keep a CLOEXEC fd open across exec */
+    void inheritFd (int fd);
+    void setParams (const sp<CommandParams> &params);
+
+    /* at startup, before SaceConfig::applyThreadSched runs anywhere */
+    static void saveProcessSched ();
+
+    /* argv of cmd if it is plain words sh would exec as is, no quote,
+     * expansion, redirection or assignment.
+     */
+    static bool splitCommand (const string &cmd, vector<string> *argv);
+    /* PATH lookup, names with a '/' are kept as they are */
+    static bool resolvePath (const string &name, string *path);
+    static void forgetPath (const string &name);
+
+    /* through SaceSpawner when it runs, -1 with errno set if clone or exec failed */
+    pid_t spawn (const char *path, const vector<string> &args);
+};
+
+}; //namespace android
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <sace/SaceLog.h>
+#include <sace/SaceStream.h>
+#include "SaceSpawner.h"
+#include "SaceConfig.h"
+
+namespace android {
+
+const char *SaceSpawner::NAME = "saced-spawner";
+const size_t SaceSpawner::MAX_FDS = 8;
+const int SaceSpawner::MAX_HELPERS;
+
+SaceSpawner *SaceSpawner::mInstance = new SaceSpawner();
+
+SaceSpawner::SaceSpawner () {
+    for (int i = 0; i < MAX_HELPERS; i++) {
+        mHelpers[i].sock = -1;
+        mHelpers[i].pid  = -1;
+    }
+    mHelperCount = 0;
+    mNext = 0;
+}
+
+SaceSpawner* SaceSpawner::getInstance () {
+    return mInstance;
+}
+
+bool SaceSpawner::startHelper (int index) {
+    Helper &helper = mHelpers[index];
+    int sv[2];
+    pid_t parent = getpid();
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        SACE_LOGE("SaceSpawner socketpair errno=%d errstr=%s", errno, strerror(errno));
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        SACE_LOGE("SaceSpawner fork errno=%d errstr=%s", errno, strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(sv[0]);
+        /* the other helpers must see EOF when the daemon goes */
+        for (int i = 0; i < index; i++)
+            close(mHelpers[i].sock);
+
+        prctl(PR_SET_NAME, NAME);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent)
+            _exit(0);
+
+        serve(sv[1]);
+        _exit(0);
+    }
+
+    close(sv[1]);
+
+    lock_guard<mutex> lock(helper.lock);
+    helper.sock = sv[0];
+    helper.pid  = pid;
+    SACE_LOGI("SaceSpawner %s started pid=%d", NAME, pid);
+    return true;
+}
+
+bool SaceSpawner::start () {
+    int count = min(SaceConfig::spawnerHelpers(), MAX_HELPERS);
+
+    for (int i = 0; i < count && startHelper(i); i++)
+        mHelperCount = i + 1;
+
+    return mHelperCount > 0;
+}
+
+void SaceSpawner::shutdown (Helper &helper) {
+    close(helper.sock);
+    helper.sock = -1;
+
+    /* a closed socket is all it takes, unless it is stuck */
+    if (TEMP_FAILURE_RETRY(waitpid(helper.pid, nullptr, WNOHANG)) == 0) {
+        kill(helper.pid, SIGKILL);
+        TEMP_FAILURE_RETRY(waitpid(helper.pid, nullptr, 0));
+    }
+
+    helper.pid = -1;
+}
+
+void SaceSpawner::stop () {
+    for (int i = 0; i < mHelperCount; i++) {
+        lock_guard<mutex> lock(mHelpers[i].lock);
+        if (mHelpers[i].sock >= 0)
+            shutdown(mHelpers[i]);
+    }
+}
+
+/* the helper : one request, one child, one reply, until the daemon is gone */
+void SaceSpawner::serve (int sock) {
+    vector<uint8_t> buf(SACE_MAX_FRAME_SIZE);
+
+    while (true) {
+        struct msghdr msg;
+        struct iovec iov;
+        union {
+            struct cmsghdr cm;
+            char control[CMSG_SPACE(MAX_FDS * sizeof(int))];
+        } control_un;
+
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = &buf[0];
+        iov.iov_len  = buf.size();
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control_un.control;
+        msg.msg_controllen = sizeof(control_un.control);
+
+        ssize_t len = TEMP_FAILURE_RETRY(recvmsg(sock, &msg, MSG_CMSG_CLOEXEC));
+        if (len <= 0)
+            break;
+
+        vector<int> fds;
+        for (struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg); pcmsg != nullptr; pcmsg = CMSG_NXTHDR(&msg, pcmsg)) {
+            if (pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            int *pfds = (int*)CMSG_DATA(pcmsg);
+            for (size_t i = 0; i < (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++)
+                fds.push_back(pfds[i]);
+        }
+
+        int32_t reply[2] = {-1, EINVAL};
+        Parcel data;
+        data.setData(&buf[0], len);
+
+        SaceSpawn spawn("");
+        if (!(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) && spawn.readFromParcel(&data, fds) == OK) {
+            /* out of the way of every dup2 target, so none is clobbered
+             * before its turn and inherited fds really lose CLOEXEC.
+             */
+            int low = STDERR_FILENO + 1;
+            for (const SaceSpawn::FileAction &action : spawn.mActions)
+                low = max(low, action.target + 1);
+
+            for (int &fd : fds) {
+                int moved = fd < low? fcntl(fd, F_DUPFD_CLOEXEC, low) : -1;
+                if (moved < 0)
+                    continue;
+
+                for (SaceSpawn::FileAction &action : spawn.mActions) {
+                    if (action.fd == fd)
+                        action.fd = moved;
+                }
+
+                close(fd);
+                fd = moved;
+            }
+
+            pid_t pid = spawn.cloneChild(CLONE_PARENT);
+            reply[0] = pid;
+            reply[1] = pid < 0? errno : spawn.mExecErrno;
+        }
+
+        for (int fd : fds)
+            close(fd);
+
+        if (TEMP_FAILURE_RETRY(send(sock, reply, sizeof(reply), MSG_NOSIGNAL)) < 0)
+            break;
+    }
+
+    close(sock);
+}
+
+bool SaceSpawner::spawn (SaceSpawn &spawn, pid_t *pid) {
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(MAX_FDS * sizeof(int))];
+    } control_un;
+    vector<int> fds;
+    Parcel data;
+
+    spawn.writeToParcel(&data, fds);
+    if (fds.size() > MAX_FDS || data.dataSize() > SACE_MAX_FRAME_SIZE)
+        return false;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base   = (void*)data.data();
+    iov.iov_len    = data.dataSize();
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+
+    if (!fds.empty()) {
+        msg.msg_control    = control_un.control;
+        msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+
+        struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg);
+        pcmsg->cmsg_level = SOL_SOCKET;
+        pcmsg->cmsg_type  = SCM_RIGHTS;
+        pcmsg->cmsg_len   = CMSG_LEN(fds.size() * sizeof(int));
+        memcpy(CMSG_DATA(pcmsg), &fds[0], fds.size() * sizeof(int));
+    }
+
+    /* an idle helper first, else wait for the one in turn */
+    uint32_t first = mNext++;
+    for (int i = 0; i < mHelperCount; i++) {
+        Helper &helper = mHelpers[(first + i) % mHelperCount];
+        unique_lock<mutex> lock(helper.lock, try_to_lock);
+        if (lock.owns_lock() && helper.sock >= 0 && request(helper, &msg, pid))
+            return true;
+    }
+
+    for (int i = 0; i < mHelperCount; i++) {
+        Helper &helper = mHelpers[(first + i) % mHelperCount];
+        lock_guard<mutex> lock(helper.lock);
+        if (helper.sock >= 0 && request(helper, &msg, pid))
+            return true;
+    }
+
+    return false;
+}
+
+/* helper.lock must be held, false if the helper is lost */
+bool SaceSpawner::request (Helper &helper, struct msghdr *msg, pid_t *pid) {
+    int32_t reply[2];
+
+    if (TEMP_FAILURE_RETRY(sendmsg(helper.sock, msg, MSG_NOSIGNAL)) < 0 ||
+        TEMP_FAILURE_RETRY(recv(helper.sock, reply, sizeof(reply), 0)) != sizeof(reply)) {
+        SACE_LOGE("SaceSpawner %s pid=%d lost errno=%d errstr=%s", NAME, helper.pid, errno, strerror(errno));
+        shutdown(helper);
+        return false;
+    }
+
+    *pid = reply[0];
+    if (reply[1] != 0) {
+        /* exec failed, the child is ours to reap */
+        if (reply[0] > 0)
+            TEMP_FAILURE_RETRY(waitpid(reply[0], nullptr, 0));
+
+        *pid  = -1;
+        errno = reply[1];
+    }
+
+    return true;
+}
+
+}; //namespace android
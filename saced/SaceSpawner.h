@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef _SACE_SPAWNER_H
+#define _SACE_SPAWNER_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <mutex>
+#include <atomic>
+
+#include "SaceSpawn.h"
+
+using namespace std;
+
+namespace android {
+
+/* optional spawn server (persist.sace.spawner) : a helper forked before the
+ * daemon has any thread, lock or heap to speak of. SaceSpawn requests and
+ * their fds go over a socketpair, the helper clones the child with
+ * CLONE_PARENT so it is still ours to wait for, pidfd and pclose included.
+ * Several helpers take requests side by side, a spawn goes to the first
+ * idle one. If every helper is gone, spawns fall back to the daemon itself.
+ */
+class SaceSpawner {
+    static const char *NAME;
+    static const size_t MAX_FDS;
+    static const int MAX_HELPERS = 8;
+
+    static SaceSpawner *mInstance;
+
+    /* a round trip holds lock, so one request per helper at a time */
+    struct Helper {
+        mutex lock;
+        int sock;
+        pid_t pid;
+    };
+
+    Helper mHelpers[MAX_HELPERS];
+    int mHelperCount;
+    atomic<uint32_t> mNext;
+
+    void serve (int sock);
+    void shutdown (Helper &helper);
+    bool startHelper (int index);
+    bool request (Helper &helper, struct msghdr *msg, pid_t *pid);
+
+public:
+    SaceSpawner ();
+
+    static SaceSpawner* getInstance ();
+
+    /* must be called while the daemon is still single threaded */
+    bool start ();
+    void stop ();
+
+    /* false if the helper is not running, spawn locally then */
+    bool spawn (SaceSpawn &spawn, pid_t *pid);
+};
+
+}; //namespace android
+
+#endif
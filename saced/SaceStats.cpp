@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdio.h>
+
+#include "SaceStats.h"
+
+namespace android {
+
+void SaceWaitStats::record (nsecs_t wait) {
+    uint64_t us = wait > 0? (uint64_t)wait / 1000 : 0;
+
+    mCount++;
+    mTotal += us;
+
+    uint64_t max = mMax.load(memory_order_relaxed);
+    while (us > max && !mMax.compare_exchange_weak(max, us, memory_order_relaxed));
+}
+
+const string SaceWaitStats::to_string () const {
+    uint64_t count = mCount.load();
+    uint64_t total = mTotal.load();
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "count=%llu avg=%lluus max=%lluus",
+        (unsigned long long)count,
+        (unsigned long long)(count > 0? total / count : 0),
+        (unsigned long long)mMax.load());
+
+    return string(buf);
+}
+
+// ----------------------------------------------------------------------------
+atomic<uint64_t> SaceStats::mDeadlineMiss[SACE_STAGE_MAX];
+atomic<uint64_t> SaceStats::mWakeup[SACE_WAKEUP_MAX];
+
+void SaceStats::dump (string &out) {
+    out += "SaceService deadline miss:\n";
+    for (int i = 0; i < SACE_STAGE_MAX; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "  %s=%llu\n", mapStageToName((enum SaceStage)i),
+            (unsigned long long)mDeadlineMiss[i].load());
+        out += buf;
+    }
+
+    out += "SaceService wakeups:\n";
+    for (int i = 0; i < SACE_WAKEUP_MAX; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "  %s=%llu\n", mapWakeupToName((enum SaceWakeup)i),
+            (unsigned long long)mWakeup[i].load());
+        out += buf;
+    }
+}
+
+const char* SaceStats::mapStageToName (enum SaceStage stage) {
+    switch (stage) {
+        case SACE_STAGE_READER:
+            return "reader";
+        case SACE_STAGE_DISPATCHER:
+            return "dispatcher";
+        case SACE_STAGE_EXCUTOR:
+            return "excutor";
+        default:
+            return "unknown";
+    }
+}
+
+const char* SaceStats::mapWakeupToName (enum SaceWakeup wakeup) {
+    switch (wakeup) {
+        case SACE_WAKEUP_TIMER:
+            return "timer";
+        case SACE_WAKEUP_EXCUTOR:
+            return "excutor";
+        case SACE_WAKEUP_WORKER:
+            return "worker";
+        case SACE_WAKEUP_CHILD:
+            return "child";
+        case SACE_WAKEUP_EVENT:
+            return "event";
+        case SACE_WAKEUP_PROPERTY:
+            return "property";
+        case SACE_WAKEUP_READER:
+            return "reader";
+        default:
+            return "unknown";
+    }
+}
+
+}; //namespace android
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_STATS_H
+#define _SACE_STATS_H
+
+#include <utils/Timers.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+namespace android {
+
+/* where a request was found past its deadline */
+enum SaceStage {
+    SACE_STAGE_READER,
+    SACE_STAGE_DISPATCHER,
+    SACE_STAGE_EXCUTOR,
+    SACE_STAGE_MAX,
+};
+
+/* blocking waits of daemon threads, an idle daemon counts none */
+enum SaceWakeup {
+    SACE_WAKEUP_TIMER,
+    SACE_WAKEUP_EXCUTOR,
+    SACE_WAKEUP_WORKER,
+    SACE_WAKEUP_CHILD,
+    SACE_WAKEUP_EVENT,
+    SACE_WAKEUP_PROPERTY,
+    SACE_WAKEUP_READER,
+    SACE_WAKEUP_MAX,
+};
+
+/* latency counters of one queue lane, recorded lock-free by any thread */
+class SaceWaitStats {
+    atomic<uint64_t> mCount;
+    atomic<uint64_t> mTotal; //us
+    atomic<uint64_t> mMax;   //us
+
+public:
+    SaceWaitStats ():mCount(0), mTotal(0), mMax(0) {}
+
+    void record (nsecs_t wait);
+    const string to_string () const;
+};
+
+/* daemon wide counters */
+class SaceStats {
+    static atomic<uint64_t> mDeadlineMiss[SACE_STAGE_MAX];
+    static atomic<uint64_t> mWakeup[SACE_WAKEUP_MAX];
+public:
+    static void deadlineMissed (enum SaceStage stage) {
+        mDeadlineMiss[stage]++;
+    }
+
+    static void wokeUp (enum SaceWakeup wakeup) {
+        mWakeup[wakeup].fetch_add(1, memory_order_relaxed);
+    }
+
+    static uint64_t wakeups (enum SaceWakeup wakeup) {
+        return mWakeup[wakeup].load(memory_order_relaxed);
+    }
+
+    static void dump (string &out);
+    static const char* mapStageToName (enum SaceStage stage);
+    static const char* mapWakeupToName (enum SaceWakeup wakeup);
+};
+
+}; //namespace android
+
+#endif
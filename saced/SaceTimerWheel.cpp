@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <sace/SaceLog.h>
+#include "SaceTimerWheel.h"
+#include "SaceStats.h"
+#include "SaceConfig.h"
+
+namespace android {
+
+const char *SaceTimerWheel::NAME = "SaceTimerWheel";
+const char *SaceTimerWheel::THREAD_NAME = "SETimer";
+const nsecs_t SaceTimerWheel::TICK = milliseconds_to_nanoseconds(10);
+
+SaceTimerWheel *SaceTimerWheel::mInstance = new SaceTimerWheel();
+
+SaceTimerWheel::SaceTimerWheel () {
+    for (int i = 0; i < SACE_TIMER_LEVELS; i++)
+        mLevelCount[i] = 0;
+
+    mNextId  = 1;
+    mFiring  = 0;
+    mBase    = 0;
+    mNow     = 0;
+    mArmed   = 0;
+    mTimerFd = -1;
+    mWakeFd  = -1;
+    mExit    = false;
+    mStarted = false;
+}
+
+SaceTimerWheel* SaceTimerWheel::getInstance () {
+    return mInstance;
+}
+
+bool SaceTimerWheel::start () {
+    if (mStarted)
+        return true;
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (mTimerFd < 0) {
+        SACE_LOGE("%s timerfd_create errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto timerfd;
+    }
+
+    mWakeFd = eventfd(0, EFD_CLOEXEC);
+    if (mWakeFd < 0) {
+        SACE_LOGE("%s eventfd errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto wakefd;
+    }
+
+    mBase  = systemTime(SYSTEM_TIME_MONOTONIC);
+    mNow   = 0;
+    mArmed = 0;
+    mExit  = false;
+
+    if (pthread_create(&mThread, nullptr, timer_thread, (void*)this) != 0) {
+        SACE_LOGE("%s create timer_thread errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto thread;
+    }
+
+    mLock.lock();
+    mStarted = true;
+    mLock.unlock();
+    return true;
+thread:
+    close(mWakeFd);
+    mWakeFd = -1;
+wakefd:
+    close(mTimerFd);
+    mTimerFd = -1;
+timerfd:
+    return false;
+}
+
+void SaceTimerWheel::stop () {
+    if (!mStarted)
+        return;
+
+    uint64_t one = 1;
+    mExit = true;
+    TEMP_FAILURE_RETRY(write(mWakeFd, &one, sizeof(one)));
+    pthread_join(mThread, nullptr);
+
+    mLock.lock();
+    mStarted = false;
+    for (auto &it : mTimers)
+        delete it.second;
+    mTimers.clear();
+
+    for (int level = 0; level < SACE_TIMER_LEVELS; level++) {
+        for (int slot = 0; slot < SACE_TIMER_SLOTS; slot++)
+            mWheel[level][slot].clear();
+        mLevelCount[level] = 0;
+    }
+    mLock.unlock();
+
+    close(mWakeFd);
+    close(mTimerFd);
+    mWakeFd = mTimerFd = -1;
+}
+
+/* first tick not earlier than when */
+uint64_t SaceTimerWheel::tickOf (nsecs_t when) const {
+    if (when <= mBase)
+        return 0;
+
+    return (when - mBase + TICK - 1) / TICK;
+}
+
+uint64_t SaceTimerWheel::currentTick () const {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    return now <= mBase? 0 : (now - mBase) / TICK;
+}
+
+/* level by distance, slot by the expire bits of that level : a slot is
+ * cascaded down right when the wheel reaches its range.
+ */
+void SaceTimerWheel::place (Timer *timer) {
+    uint64_t expire = timer->expire > mNow? timer->expire : mNow;
+    uint64_t delta  = expire - mNow;
+    int level = 0;
+
+    while (level < SACE_TIMER_LEVELS - 1 && delta >= (1ULL << (SACE_TIMER_SLOT_BITS * (level + 1))))
+        level++;
+
+    /* beyond the top level, parked on its last slot and placed again later */
+    if (delta >= (1ULL << (SACE_TIMER_SLOT_BITS * SACE_TIMER_LEVELS)))
+        expire = mNow + (1ULL << (SACE_TIMER_SLOT_BITS * SACE_TIMER_LEVELS)) - 1;
+
+    timer->level = level;
+    timer->slot  = (expire >> (SACE_TIMER_SLOT_BITS * level)) & (SACE_TIMER_SLOTS - 1);
+
+    list<Timer*> &slot = mWheel[level][timer->slot];
+    timer->pos = slot.insert(slot.end(), timer);
+    mLevelCount[level]++;
+}
+
+void SaceTimerWheel::unplace (Timer *timer) {
+    if (timer->level < 0)
+        return;
+
+    mWheel[timer->level][timer->slot].erase(timer->pos);
+    mLevelCount[timer->level]--;
+    timer->level = -1;
+}
+
+void SaceTimerWheel::advance (uint64_t tick, list<TimerId> &due) {
+    while (mNow < tick) {
+        /* nothing in level 0, jump to the next cascade of the lowest occupied level */
+        if (mLevelCount[0] == 0) {
+            int level = 1;
+            while (level < SACE_TIMER_LEVELS && mLevelCount[level] == 0)
+                level++;
+
+            if (level == SACE_TIMER_LEVELS) {
+                mNow = tick;
+                break;
+            }
+
+            int shift = SACE_TIMER_SLOT_BITS * level;
+            uint64_t boundary = ((mNow >> shift) + 1) << shift;
+            if (boundary > tick) {
+                mNow = tick;
+                break;
+            }
+            mNow = boundary - 1;
+        }
+
+        mNow++;
+
+        for (int level = 1; level < SACE_TIMER_LEVELS; level++) {
+            int shift = SACE_TIMER_SLOT_BITS * level;
+            if ((mNow & ((1ULL << shift) - 1)) != 0)
+                break;
+
+            list<Timer*> cascade;
+            cascade.swap(mWheel[level][(mNow >> shift) & (SACE_TIMER_SLOTS - 1)]);
+            mLevelCount[level] -= cascade.size();
+
+            for (Timer *timer : cascade)
+                place(timer);
+        }
+
+        list<Timer*> &slot = mWheel[0][mNow & (SACE_TIMER_SLOTS - 1)];
+        while (!slot.empty()) {
+            Timer *timer = slot.front();
+            slot.pop_front();
+            mLevelCount[0]--;
+
+            timer->level = -1;
+            due.push_back(timer->id);
+        }
+    }
+}
+
+/* earliest expiry, 0 for none. The first occupied slot of a level holds
+ * its earliest timers, cascades on the way are done by advance() when
+ * the thread wakes up.
+ */
+uint64_t SaceTimerWheel::nextTick () const {
+    uint64_t next = 0;
+
+    for (int level = 0; level < SACE_TIMER_LEVELS; level++) {
+        if (mLevelCount[level] == 0)
+            continue;
+
+        int shift = SACE_TIMER_SLOT_BITS * level;
+        uint64_t current = mNow >> shift;
+        for (uint64_t index = current + 1; index <= current + SACE_TIMER_SLOTS; index++) {
+            const list<Timer*> &slot = mWheel[level][index & (SACE_TIMER_SLOTS - 1)];
+            if (slot.empty())
+                continue;
+
+            for (const Timer *timer : slot) {
+                if (next == 0 || timer->expire < next)
+                    next = timer->expire;
+            }
+            break;
+        }
+    }
+
+    return next;
+}
+
+void SaceTimerWheel::rearm () {
+    uint64_t next = nextTick();
+    if (next == mArmed)
+        return;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    /* all zero disarms, the thread sleeps until something is scheduled */
+    if (next > 0) {
+        nsecs_t when = mBase + (nsecs_t)next * TICK;
+        spec.it_value.tv_sec  = when / seconds_to_nanoseconds(1);
+        spec.it_value.tv_nsec = when % seconds_to_nanoseconds(1);
+    }
+
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0)
+        SACE_LOGE("%s timerfd_settime errno=%d errstr=%s", NAME, errno, strerror(errno));
+
+    mArmed = next;
+}
+
+SaceTimerWheel::TimerId SaceTimerWheel::add (nsecs_t delay, nsecs_t period, Callback &callback) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    lock_guard<mutex> _l(mLock);
+
+    if (!mStarted)
+        return 0;
+
+    /* idle wheel, don't make the thread walk the ticks it slept through */
+    if (mTimers.empty()) {
+        uint64_t tick = currentTick();
+        if (tick > mNow)
+            mNow = tick;
+    }
+
+    Timer *timer = new Timer();
+    timer->id       = mNextId++;
+    timer->expire   = tickOf(now + delay);
+    timer->period   = period > 0? (period + TICK - 1) / TICK : 0;
+    timer->callback = callback;
+
+    if (timer->expire <= mNow)
+        timer->expire = mNow + 1;
+
+    mTimers[timer->id] = timer;
+    place(timer);
+
+    if (mArmed == 0 || timer->expire < mArmed)
+        rearm();
+
+    return timer->id;
+}
+
+SaceTimerWheel::TimerId SaceTimerWheel::schedule (nsecs_t delay, Callback callback) {
+    return add(delay, 0, callback);
+}
+
+SaceTimerWheel::TimerId SaceTimerWheel::schedulePeriodic (nsecs_t period, Callback callback) {
+    return add(period, period > 0? period : TICK, callback);
+}
+
+bool SaceTimerWheel::cancel (TimerId id) {
+    bool found = false;
+
+    if (id == 0)
+        return false;
+
+    unique_lock<mutex> _l(mLock);
+    unordered_map<TimerId, Timer*>::iterator it = mTimers.find(id);
+    if (it != mTimers.end()) {
+        unplace(it->second);
+        delete it->second;
+        mTimers.erase(it);
+        found = true;
+    }
+
+    /* its callback may be running right now */
+    if (mStarted && !pthread_equal(pthread_self(), mThread)) {
+        while (mFiring == id)
+            mFiredCond.wait(_l);
+    }
+
+    return found;
+}
+
+void SaceTimerWheel::fire (TimerId id) {
+    Callback callback;
+
+    mLock.lock();
+    unordered_map<TimerId, Timer*>::iterator it = mTimers.find(id);
+    if (it == mTimers.end()) {
+        /* cancelled after it was due */
+        mLock.unlock();
+        return;
+    }
+
+    Timer *timer = it->second;
+    if (timer->period > 0) {
+        callback = timer->callback;
+        timer->expire = mNow + timer->period;
+        place(timer);
+
+        if (mArmed == 0 || timer->expire < mArmed)
+            rearm();
+    }
+    else {
+        callback = move(timer->callback);
+        mTimers.erase(it);
+        delete timer;
+    }
+
+    mFiring = id;
+    mLock.unlock();
+
+    callback();
+
+    mLock.lock();
+    mFiring = 0;
+    mLock.unlock();
+    mFiredCond.notify_all();
+}
+
+void* SaceTimerWheel::timer_thread (void *data) {
+    SaceTimerWheel *self = (SaceTimerWheel*)data;
+    struct pollfd fds[2];
+    uint64_t count;
+
+    prctl(PR_SET_NAME, THREAD_NAME);
+    SaceConfig::applyThreadSched(SACE_THREAD_TIMER);
+
+    fds[0].fd = self->mTimerFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = self->mWakeFd;
+    fds[1].events = POLLIN;
+
+    while (!self->mExit) {
+        int ret = poll(fds, 2, -1);
+        SaceStats::wokeUp(SACE_WAKEUP_TIMER);
+        if (ret < 0) {
+            if (errno != EINTR)
+                SACE_LOGE("%s poll errno=%d errstr=%s", NAME, errno, strerror(errno));
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN)
+            TEMP_FAILURE_RETRY(read(self->mTimerFd, &count, sizeof(count)));
+        if (fds[1].revents & POLLIN)
+            TEMP_FAILURE_RETRY(read(self->mWakeFd, &count, sizeof(count)));
+
+        if (self->mExit)
+            break;
+
+        list<TimerId> due;
+        self->mLock.lock();
+        self->advance(self->currentTick(), due);
+        self->rearm();
+        self->mLock.unlock();
+
+        for (TimerId id : due)
+            self->fire(id);
+    }
+
+    SACE_LOGI("%s Stopping", NAME);
+    return nullptr;
+}
+
+}; //namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_TIMER_WHEEL_H
+#define _SACE_TIMER_WHEEL_H
+
+#include <pthread.h>
+#include <utils/Timers.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+#define SACE_TIMER_SLOT_BITS   6
+#define SACE_TIMER_SLOTS       (1 << SACE_TIMER_SLOT_BITS)
+#define SACE_TIMER_LEVELS      4
+
+namespace android {
+
+/* hierarchical timing wheel of the daemon, every timeout hangs on one
+ * timerfd : schedule/cancel are O(1) and the thread only wakes when a
+ * timer is due, never for a cascade or while nothing is pending.
+ * callbacks run on the timer thread, they must be short and not block.
+ */
+class SaceTimerWheel {
+public:
+    typedef uint64_t TimerId;
+    typedef function<void()> Callback;
+
+private:
+    static const char *NAME;
+    static const char *THREAD_NAME;
+    static const nsecs_t TICK;
+
+    static SaceTimerWheel *mInstance;
+
+    struct Timer {
+        TimerId id;
+        uint64_t expire;   /* tick */
+        uint64_t period;   /* ticks, 0 for one shot */
+        int level;         /* -1 while due and out of the wheel */
+        int slot;
+        list<Timer*>::iterator pos;
+        Callback callback;
+    };
+
+    mutex mLock;
+    condition_variable mFiredCond;
+    list<Timer*> mWheel[SACE_TIMER_LEVELS][SACE_TIMER_SLOTS];
+    uint32_t mLevelCount[SACE_TIMER_LEVELS];
+    unordered_map<TimerId, Timer*> mTimers;
+    TimerId mNextId;
+    /* callback running now, cancel() waits for it */
+    TimerId mFiring;
+
+    nsecs_t mBase;
+    uint64_t mNow;     /* last tick handled */
+    uint64_t mArmed;   /* tick the timerfd fires at, 0 for disarmed */
+
+    int mTimerFd;
+    int mWakeFd;
+    pthread_t mThread;
+    atomic<bool> mExit;
+    bool mStarted;
+
+    uint64_t tickOf (nsecs_t when) const;
+    uint64_t currentTick () const;
+    TimerId add (nsecs_t delay, nsecs_t period, Callback &callback);
+    void place (Timer *timer);
+    void unplace (Timer *timer);
+    void advance (uint64_t tick, list<TimerId> &due);
+    uint64_t nextTick () const;
+    void rearm ();
+    void fire (TimerId id);
+
+    static void* timer_thread (void *data);
+
+public:
+    SaceTimerWheel ();
+
+    static SaceTimerWheel* getInstance ();
+
+    bool start ();
+    void stop ();
+
+    /* delay is rounded up to TICK, 0 is returned if not started */
+    TimerId schedule (nsecs_t delay, Callback callback);
+    TimerId schedulePeriodic (nsecs_t period, Callback callback);
+    /* once it returns the callback is not running and won't run again,
+     * unless called by the callback itself.
+     */
+    bool cancel (TimerId id);
+};
+
+}; //namespace android
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "SaceUring.h"
+#include "sace/SaceLog.h"
+
+namespace android {
+
+static int uring_setup (uint32_t entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter (int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t argsz) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int uring_register (int fd, uint32_t opcode, void *arg, uint32_t nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+SaceUring::SaceUring () {
+    mRingFd = -1;
+    mSqMap  = mCqMap = MAP_FAILED;
+    mSqMapLen = mCqMapLen = 0;
+    mSqes    = (struct io_uring_sqe*)MAP_FAILED;
+    mSqesLen = 0;
+    mSqLocal = 0;
+    mSqEntries = 0;
+
+    mBufRing = (struct io_uring_buf_ring*)MAP_FAILED;
+    mBufRingLen = 0;
+    mBufs = nullptr;
+    mBufGroup = mBufCount = mBufTail = 0;
+    mBufSize = 0;
+}
+
+SaceUring::~SaceUring () {
+    if (mBufs != nullptr)
+        munmap(mBufs, (size_t)mBufCount * mBufSize);
+    if (mBufRing != MAP_FAILED)
+        munmap(mBufRing, mBufRingLen);
+    if (mSqes != MAP_FAILED)
+        munmap(mSqes, mSqesLen);
+    if (mCqMap != MAP_FAILED && mCqMap != mSqMap)
+        munmap(mCqMap, mCqMapLen);
+    if (mSqMap != MAP_FAILED)
+        munmap(mSqMap, mSqMapLen);
+    if (mRingFd >= 0)
+        close(mRingFd);
+}
+
+bool SaceUring::supported () {
+    static int support = -1;
+    if (support >= 0)
+        return support;
+
+    support = 0;
+
+    /* multishot recvmsg with provided buffer rings needs 6.0 */
+    struct utsname uts;
+    int major = 0, minor = 0;
+    if (uname(&uts) < 0 || sscanf(uts.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+        SACE_LOGI("SaceUring kernel %s too old", uts.release);
+        return support;
+    }
+
+    /* may still be denied by seccomp or selinux */
+    SaceUring uring;
+    if (!uring.init(4))
+        return support;
+
+    const uint8_t ops[] = {IORING_OP_ACCEPT, IORING_OP_RECVMSG, IORING_OP_SENDMSG, IORING_OP_READ,
+                           IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL};
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    vector<uint8_t> buf(len, 0);
+    struct io_uring_probe *probe = (struct io_uring_probe*)buf.data();
+    if (uring_register(uring.mRingFd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        SACE_LOGI("SaceUring probe fail %s", strerror(errno));
+        return support;
+    }
+
+    for (uint8_t op : ops) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            SACE_LOGI("SaceUring op %d unsupported", op);
+            return support;
+        }
+    }
+
+    support = 1;
+    return support;
+}
+
+bool SaceUring::init (uint32_t entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    mRingFd = uring_setup(entries, &p);
+    if (mRingFd < 0) {
+        SACE_LOGW("SaceUring io_uring_setup fail %s", strerror(errno));
+        return false;
+    }
+
+    mSqMapLen = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    mCqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        mSqMapLen = mCqMapLen = max(mSqMapLen, mCqMapLen);
+
+    mSqMap = mmap(nullptr, mSqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+    if (mSqMap == MAP_FAILED)
+        goto err;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        mCqMap = mSqMap;
+    else {
+        mCqMap = mmap(nullptr, mCqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+        if (mCqMap == MAP_FAILED)
+            goto err;
+    }
+
+    mSqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    mSqes = (struct io_uring_sqe*)mmap(nullptr, mSqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+    if (mSqes == MAP_FAILED)
+        goto err;
+
+    mSqHead  = (atomic<uint32_t>*)((uint8_t*)mSqMap + p.sq_off.head);
+    mSqTail  = (atomic<uint32_t>*)((uint8_t*)mSqMap + p.sq_off.tail);
+    mSqMask  = (uint32_t*)((uint8_t*)mSqMap + p.sq_off.ring_mask);
+    mSqArray = (uint32_t*)((uint8_t*)mSqMap + p.sq_off.array);
+    mSqEntries = p.sq_entries;
+    mSqLocal = mSqTail->load(memory_order_relaxed);
+
+    mCqHead = (atomic<uint32_t>*)((uint8_t*)mCqMap + p.cq_off.head);
+    mCqTail = (atomic<uint32_t>*)((uint8_t*)mCqMap + p.cq_off.tail);
+    mCqMask = (uint32_t*)((uint8_t*)mCqMap + p.cq_off.ring_mask);
+    mCqes   = (struct io_uring_cqe*)((uint8_t*)mCqMap + p.cq_off.cqes);
+
+    return true;
+
+err:
+    SACE_LOGE("SaceUring mmap ring fail %s", strerror(errno));
+    return false;
+}
+
+bool SaceUring::setupBuffers (uint16_t group, uint16_t count, uint32_t size) {
+    mBufRingLen = count * sizeof(struct io_uring_buf);
+    mBufRing = (struct io_uring_buf_ring*)mmap(nullptr, mBufRingLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mBufRing == MAP_FAILED) {
+        SACE_LOGE("SaceUring mmap buffer ring fail %s", strerror(errno));
+        return false;
+    }
+
+    mBufs = (uint8_t*)mmap(nullptr, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mBufs == MAP_FAILED) {
+        SACE_LOGE("SaceUring mmap buffers fail %s", strerror(errno));
+        mBufs = nullptr;
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)mBufRing;
+    reg.ring_entries = count;
+    reg.bgid         = group;
+    if (uring_register(mRingFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        SACE_LOGE("SaceUring register buffer ring fail %s", strerror(errno));
+        return false;
+    }
+
+    mBufGroup = group;
+    mBufCount = count;
+    mBufSize  = size;
+    mBufTail  = 0;
+    for (uint16_t bid = 0; bid < count; bid++)
+        recycleBuffer(bid);
+
+    return true;
+}
+
+void SaceUring::recycleBuffer (uint16_t bid) {
+    struct io_uring_buf *buf = &mBufRing->bufs[mBufTail & (mBufCount - 1)];
+    buf->addr = (uint64_t)(uintptr_t)buffer(bid);
+    buf->len  = mBufSize;
+    buf->bid  = bid;
+
+    mBufTail++;
+    __atomic_store_n(&mBufRing->tail, mBufTail, __ATOMIC_RELEASE);
+}
+
+/* mSqLock must be held */
+struct io_uring_sqe* SaceUring::getSqe () {
+    uint32_t head = mSqHead->load(memory_order_acquire);
+    if (mSqLocal - head >= mSqEntries) {
+        /* full : hand the queued sqes to the kernel, it consumes them synchronously */
+        uint32_t to_submit = mSqLocal - mSqTail->load(memory_order_relaxed);
+        mSqTail->store(mSqLocal, memory_order_release);
+        uring_enter(mRingFd, to_submit, 0, 0, nullptr, 0);
+
+        head = mSqHead->load(memory_order_acquire);
+        if (mSqLocal - head >= mSqEntries)
+            return nullptr;
+    }
+
+    uint32_t idx = mSqLocal & *mSqMask;
+    struct io_uring_sqe *sqe = &mSqes[idx];
+    mSqArray[idx] = idx;
+    mSqLocal++;
+
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool SaceUring::prepMultishotAccept (int fd, int flags, uint64_t user_data) {
+    lock_guard<mutex> _l(mSqLock);
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd     = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = flags;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool SaceUring::prepMultishotRecvmsg (int fd, const struct msghdr *msg, uint64_t user_data) {
+    lock_guard<mutex> _l(mSqLock);
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd     = fd;
+    sqe->addr   = (uint64_t)(uintptr_t)msg;
+    sqe->len    = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->msg_flags = MSG_CMSG_CLOEXEC;
+    sqe->flags  = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = mBufGroup;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool SaceUring::prepRead (int fd, void *buf, uint32_t len, uint64_t user_data) {
+    lock_guard<mutex> _l(mSqLock);
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd     = fd;
+    sqe->addr   = (uint64_t)(uintptr_t)buf;
+    sqe->len    = len;
+    sqe->off    = (uint64_t)-1;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool SaceUring::prepSendmsg (int fd, const struct msghdr *msg, uint64_t user_data, int close_fd) {
+    lock_guard<mutex> _l(mSqLock);
+
+    /* the linked pair must be queued back to back */
+    uint32_t need = close_fd >= 0? 2 : 1;
+    if (mSqLocal - mSqHead->load(memory_order_acquire) + need > mSqEntries) {
+        uint32_t to_submit = mSqLocal - mSqTail->load(memory_order_relaxed);
+        mSqTail->store(mSqLocal, memory_order_release);
+        uring_enter(mRingFd, to_submit, 0, 0, nullptr, 0);
+
+        if (mSqLocal - mSqHead->load(memory_order_acquire) + need > mSqEntries)
+            return false;
+    }
+
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd     = fd;
+    sqe->addr   = (uint64_t)(uintptr_t)msg;
+    sqe->len    = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = user_data;
+
+    if (close_fd >= 0) {
+        /* hardlink : the close runs even if the send fails */
+        sqe->flags |= IOSQE_IO_HARDLINK;
+
+        sqe = getSqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd     = close_fd;
+        sqe->flags  = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = 0;
+    }
+
+    return true;
+}
+
+bool SaceUring::prepCancel (uint64_t target, uint64_t user_data) {
+    lock_guard<mutex> _l(mSqLock);
+    struct io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd     = -1;
+    sqe->addr   = target;
+    sqe->user_data = user_data;
+    return true;
+}
+
+int SaceUring::submit () {
+    uint32_t to_submit;
+    {
+        lock_guard<mutex> _l(mSqLock);
+        to_submit = mSqLocal - mSqTail->load(memory_order_relaxed);
+        mSqTail->store(mSqLocal, memory_order_release);
+    }
+
+    if (to_submit == 0)
+        return 0;
+
+    int ret = uring_enter(mRingFd, to_submit, 0, 0, nullptr, 0);
+    if (ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        SACE_LOGE("SaceUring submit fail %s", strerror(errno));
+
+    return ret;
+}
+
+int SaceUring::submitAndWait (int timeout_ms) {
+    uint32_t to_submit;
+    {
+        lock_guard<mutex> _l(mSqLock);
+        to_submit = mSqLocal - mSqTail->load(memory_order_relaxed);
+        mSqTail->store(mSqLocal, memory_order_release);
+    }
+
+    struct __kernel_timespec ts;
+    ts.tv_sec  = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    /* no timespec waits for a completion only */
+    if (timeout_ms >= 0)
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    int ret = uring_enter(mRingFd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret < 0 && (errno == ETIME || errno == EINTR))
+        return 0;
+
+    return ret;
+}
+
+bool SaceUring::peekCqe (struct io_uring_cqe **cqe) {
+    uint32_t head = mCqHead->load(memory_order_relaxed);
+    if (head == mCqTail->load(memory_order_acquire))
+        return false;
+
+    *cqe = &mCqes[head & *mCqMask];
+    return true;
+}
+
+void SaceUring::cqeSeen () {
+    mCqHead->store(mCqHead->load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+}; //namespace android
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_URING_H
+#define _SACE_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/* user_data carries an 8-byte aligned object pointer and a tag in the low bits */
+#define SACE_URING_TAG_MASK        0x07ULL
+#define SACE_URING_DATA(ptr, tag)  ((uint64_t)(uintptr_t)(ptr) | (tag))
+#define SACE_URING_TAG(data)       ((data) & SACE_URING_TAG_MASK)
+#define SACE_URING_PTR(data)       ((void*)(uintptr_t)((data) & ~SACE_URING_TAG_MASK))
+
+namespace android {
+
+enum SaceUringTag {
+    SACE_URING_TAG_NONE,
+    SACE_URING_TAG_ACCEPT,
+    SACE_URING_TAG_RECV,
+    SACE_URING_TAG_WAKE,
+    SACE_URING_TAG_SEND,
+    SACE_URING_TAG_CANCEL,
+};
+
+/* minimal io_uring wrapper over the raw syscalls, the platform has no liburing.
+ * sqes may be queued from writer threads, so the submission side is locked;
+ * completions are only reaped by the owning reader thread.
+ */
+class SaceUring {
+    int mRingFd;
+
+    /* submission queue */
+    void *mSqMap;
+    size_t mSqMapLen;
+    atomic<uint32_t> *mSqHead;
+    atomic<uint32_t> *mSqTail;
+    uint32_t *mSqMask;
+    uint32_t *mSqArray;
+    uint32_t mSqEntries;
+    struct io_uring_sqe *mSqes;
+    size_t mSqesLen;
+    uint32_t mSqLocal;
+    mutex mSqLock;
+
+    /* completion queue */
+    void *mCqMap;
+    size_t mCqMapLen;
+    atomic<uint32_t> *mCqHead;
+    atomic<uint32_t> *mCqTail;
+    uint32_t *mCqMask;
+    struct io_uring_cqe *mCqes;
+
+    /* provided receive buffers */
+    struct io_uring_buf_ring *mBufRing;
+    size_t mBufRingLen;
+    uint8_t *mBufs;
+    uint16_t mBufGroup;
+    uint16_t mBufCount;
+    uint16_t mBufTail;
+    uint32_t mBufSize;
+
+    struct io_uring_sqe* getSqe ();
+public:
+    SaceUring ();
+    ~SaceUring ();
+
+    /* kernel has multishot accept/recvmsg and provided buffer rings */
+    static bool supported ();
+
+    bool init (uint32_t entries);
+    bool setupBuffers (uint16_t group, uint16_t count, uint32_t size);
+
+    uint8_t* buffer (uint16_t bid) const {
+        return mBufs + (size_t)bid * mBufSize;
+    }
+    void recycleBuffer (uint16_t bid);
+
+    /* queue requests, false if the submission queue is full */
+    bool prepMultishotAccept (int fd, int flags, uint64_t user_data);
+    /* buffers hold io_uring_recvmsg_out, name and control sized by msg, then payload */
+    bool prepMultishotRecvmsg (int fd, const struct msghdr *msg, uint64_t user_data);
+    bool prepRead (int fd, void *buf, uint32_t len, uint64_t user_data);
+    /* a hardlinked close of close_fd follows the send when close_fd >= 0 */
+    bool prepSendmsg (int fd, const struct msghdr *msg, uint64_t user_data, int close_fd);
+    bool prepCancel (uint64_t target, uint64_t user_data);
+
+    int submit ();
+    /* submit and wait for at least one completion or timeout, < 0 waits forever */
+    int submitAndWait (int timeout_ms);
+
+    /* reap one completion, must call cqeSeen() after handled */
+    bool peekCqe (struct io_uring_cqe **cqe);
+    void cqeSeen ();
+};
+
+}; //namespace android
+
+#endif
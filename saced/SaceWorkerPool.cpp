@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <sys/prctl.h>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+
+#include "SaceWorkerPool.h"
+#include "SaceStats.h"
+#include "SaceConfig.h"
+#include "sace/SaceLog.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+/* messages in a row before the worker gives other strands a turn */
+const uint32_t SaceStrand::RUN_BUDGET = 16;
+
+void SaceStrand::post (const sp<SaceMessageHeader> &msg) {
+    mMailbox[msg->msgPriority].push(msg);
+    if (mPending.fetch_add(1) == 0)
+        mPool->schedule(this);
+}
+
+/* control lane first, as on the excutor threads */
+sp<SaceMessageHeader> SaceStrand::next () {
+    for (int i = 0; i < SACE_MESSAGE_PRIORITY_MAX; i++) {
+        sp<SaceMessageHeader> msg = mMailbox[i].pop();
+        if (msg != nullptr)
+            return msg;
+    }
+
+    return nullptr;
+}
+
+bool SaceStrand::run () {
+    for (uint32_t i = 0; i < RUN_BUDGET; i++) {
+        sp<SaceMessageHeader> msg;
+
+        /* counted after pushed, an earlier producer may still be linking */
+        while ((msg = next()) == nullptr)
+            sched_yield();
+
+        mHandler->handleStrandMessage(msg);
+        msg = nullptr;
+
+        if (mPending.fetch_sub(1) == 1) {
+            /* pairs with waitIdle : either it sees us idle or we see it waiting */
+            if (mWaiters.load() > 0) {
+                lock_guard<mutex> _l(mIdleLock);
+                mIdleCond.notify_all();
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SaceStrand::waitIdle () {
+    unique_lock<mutex> _l(mIdleLock);
+    mWaiters++;
+    mIdleCond.wait(_l, [this] () {
+        return idle();
+    });
+    mWaiters--;
+}
+
+// ----------------------------------------------------------------------------
+const char *SaceWorkerPool::NAME = "SaceWorkerPool";
+
+/* strands scheduled by a worker stay on its own queue */
+static thread_local int current_worker = -1;
+
+bool SaceWorkerPool::start (int workers) {
+    for (int i = 0; i < workers; i++) {
+        Worker *worker = new Worker();
+        worker->pool  = this;
+        worker->index = i;
+
+        if (pthread_create(&worker->thread, nullptr, worker_thread, (void*)worker) != 0) {
+            SACE_LOGE("%s create worker %d errno=%d errstr=%s", NAME, i, errno, strerror(errno));
+            delete worker;
+            break;
+        }
+
+        mWorkers.push_back(worker);
+    }
+
+    SACE_LOGI("%s started %d workers", NAME, (int)mWorkers.size());
+    return mWorkers.size() > 0;
+}
+
+void SaceWorkerPool::stop () {
+    if (mWorkers.empty())
+        return;
+
+    mExit = true;
+    {
+        lock_guard<mutex> _l(mIdleLock);
+        mIdleCond.notify_all();
+    }
+
+    for (Worker *worker : mWorkers) {
+        pthread_join(worker->thread, nullptr);
+        delete worker;
+    }
+    mWorkers.clear();
+}
+
+void SaceWorkerPool::schedule (SaceStrand *strand) {
+    int index = current_worker;
+    if (index < 0 || index >= (int)mWorkers.size())
+        index = mNext++ % mWorkers.size();
+
+    Worker *worker = mWorkers[index];
+    worker->lock.lock();
+    worker->runq.push_back(strand);
+    worker->lock.unlock();
+
+    /* pairs with the mSleeping/mQueued check of a worker going to sleep */
+    mQueued++;
+    if (mSleeping.load() > 0) {
+        lock_guard<mutex> _l(mIdleLock);
+        mIdleCond.notify_one();
+    }
+}
+
+SaceStrand* SaceWorkerPool::take (Worker *self) {
+    SaceStrand *strand = nullptr;
+
+    self->lock.lock();
+    if (!self->runq.empty()) {
+        strand = self->runq.front();
+        self->runq.pop_front();
+    }
+    self->lock.unlock();
+
+    /* steal the most recently queued strand of another worker */
+    for (size_t i = 1; strand == nullptr && i < mWorkers.size(); i++) {
+        Worker *victim = mWorkers[(self->index + i) % mWorkers.size()];
+
+        victim->lock.lock();
+        if (!victim->runq.empty()) {
+            strand = victim->runq.back();
+            victim->runq.pop_back();
+        }
+        victim->lock.unlock();
+    }
+
+    if (strand != nullptr)
+        mQueued--;
+
+    return strand;
+}
+
+void* SaceWorkerPool::worker_thread (void *data) {
+    Worker *self = (Worker*)data;
+    SaceWorkerPool *pool = self->pool;
+    char name[16];
+
+    snprintf(name, sizeof(name), "SEWorker.%d", self->index);
+    prctl(PR_SET_NAME, name);
+    SaceConfig::applyThreadSched(SACE_THREAD_WORKER);
+    current_worker = self->index;
+
+    while (!pool->mExit) {
+        SaceStrand *strand = pool->take(self);
+        if (strand == nullptr) {
+            unique_lock<mutex> _l(pool->mIdleLock);
+            pool->mSleeping++;
+            if (pool->mQueued.load() <= 0 && !pool->mExit) {
+                pool->mIdleCond.wait(_l);
+                SaceStats::wokeUp(SACE_WAKEUP_WORKER);
+            }
+            pool->mSleeping--;
+            continue;
+        }
+
+        if (strand->run())
+            pool->schedule(strand);
+    }
+
+    return nullptr;
+}
+
+}; //namespace android
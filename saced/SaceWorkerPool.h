@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_WORKER_POOL_H
+#define _SACE_WORKER_POOL_H
+
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "SaceMessage.h"
+
+using namespace std;
+
+namespace android {
+class SaceWorkerPool;
+
+class SaceStrandHandler {
+public:
+    virtual void handleStrandMessage (const sp<SaceMessageHeader> &msg) = 0;
+    virtual ~SaceStrandHandler () {}
+};
+
+/* serial lane : its messages run one at a time in post order, on
+ * whichever pool worker picks the strand up.
+ */
+class SaceStrand {
+    static const uint32_t RUN_BUDGET;
+
+    SaceWorkerPool *mPool;
+    SaceStrandHandler *mHandler;
+    /* one lane per SaceMessagePriority */
+    SaceMailbox<SaceMessageHeader> mMailbox[SACE_MESSAGE_PRIORITY_MAX];
+    /* posted but not handled yet, the strand is scheduled while > 0 */
+    atomic<uint32_t> mPending;
+    /* threads in waitIdle(), the worker only signals when there are some */
+    atomic<uint32_t> mWaiters;
+    mutex mIdleLock;
+    condition_variable mIdleCond;
+
+    sp<SaceMessageHeader> next ();
+
+public:
+    SaceStrand ():mPool(nullptr), mHandler(nullptr), mPending(0), mWaiters(0) {}
+
+    void attach (SaceWorkerPool *pool, SaceStrandHandler *handler) {
+        mPool    = pool;
+        mHandler = handler;
+    }
+
+    void post (const sp<SaceMessageHeader> &msg);
+
+    bool idle () const {
+        return mPending.load() == 0;
+    }
+
+    /* until everything posted so far is handled */
+    void waitIdle ();
+
+    /* worker side, true if messages are left and it must be scheduled again */
+    bool run ();
+};
+
+/* workers with their own run queue of strands, an idle worker steals
+ * from the others before it sleeps.
+ */
+class SaceWorkerPool {
+    static const char *NAME;
+
+    struct Worker {
+        SaceWorkerPool *pool;
+        int index;
+        pthread_t thread;
+        mutex lock;
+        deque<SaceStrand*> runq;
+    };
+
+    vector<Worker*> mWorkers;
+    /* may dip below 0 while a strand is taken before it is counted */
+    atomic<int32_t> mQueued;
+    atomic<int32_t> mSleeping;
+    atomic<uint32_t> mNext;
+    atomic<bool> mExit;
+    mutex mIdleLock;
+    condition_variable mIdleCond;
+
+    SaceStrand* take (Worker *self);
+    static void* worker_thread (void *data);
+public:
+    SaceWorkerPool ():mQueued(0), mSleeping(0), mNext(0), mExit(false) {}
+    ~SaceWorkerPool () {
+        stop();
+    }
+
+    bool start (int workers);
+    void stop ();
+
+    bool running () const {
+        return !mWorkers.empty();
+    }
+
+    void schedule (SaceStrand *strand);
+};
+
+}; //namespace android
+
+#endif
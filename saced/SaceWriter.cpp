@@ -16,86 +16,409 @@
 
 
 #include <sys/socket.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
 #include <cutils/sockets.h>
 #include "SaceWriter.h"
+#include "SaceUring.h"
 
 namespace android {
 
-void SaceSocketWriter::sendResult (const SaceResult &result) {
-    struct iovec  iov[1];
-    struct msghdr msg;
-    struct cmsghdr *pcmsg;
+#define SEND_WAIT_TIMEOUT 1000 //ms
 
-    union {
-        struct cmsghdr cm;
-        char control[CMSG_SPACE(sizeof(int))];
-    } control_un;
-    memset(control_un.control, sizeof(control_un.control), 0);
+/* client sockets are non-blocking, wait a bounded time for the peer to drain */
+static int send_socket_msg (int sockfd, struct msghdr *msg) {
+    while (true) {
+        int ret = TEMP_FAILURE_RETRY(sendmsg(sockfd, msg, MSG_NOSIGNAL));
+        if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return ret;
 
-    Parcel parcel;
-    result.writeToParcel(&parcel);
+        struct pollfd pfd = {sockfd, POLLOUT, 0};
+        ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, SEND_WAIT_TIMEOUT));
+        if (ret <= 0) {
+            if (ret == 0)
+                errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+}
 
-    iov[0].iov_base = (void*)parcel.data();
-    iov[0].iov_len  = parcel.dataSize();
+/* fds of a result in the order the client takes them */
+static void collect_result_fds (const SaceResult &result, vector<int> &fds) {
+    if (result.resultType == SACE_RESULT_TYPE_FD)
+        fds.push_back(result.resultFd);
 
-    msg.msg_name    = nullptr;
-    msg.msg_namelen = 0;
-    msg.msg_iov    = iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control    = nullptr;
-    msg.msg_controllen = 0;
+    for (auto &rslt : result.results)
+        collect_result_fds(rslt, fds);
+}
 
-    if (result.resultType == SACE_RESULT_TYPE_FD) {
-        msg.msg_control    = control_un.control;
-        msg.msg_controllen = sizeof(control_un.control);
+static void close_fds (vector<int> &fds) {
+    for (int fd : fds)
+        close(fd);
+    fds.clear();
+}
 
-        pcmsg = CMSG_FIRSTHDR(&msg);
-        pcmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+const size_t SaceSocketWriter::DEF_QUEUE_BYTES = 256 * 1024;
+
+SaceSocketWriter::~SaceSocketWriter () {
+    for (SendRequest *req : mSendQueue) {
+        close_fds(req->fds);
+        delete req;
+    }
+}
+
+void SaceSocketWriter::buildMsg (SendRequest *req) {
+    req->iov.iov_base = req->data.data() + req->sent;
+    req->iov.iov_len  = req->data.size() - req->sent;
+
+    memset(&req->msg, 0, sizeof(req->msg));
+    req->msg.msg_iov    = &req->iov;
+    req->msg.msg_iovlen = 1;
+
+    /* the fds ride on the first byte of their frame */
+    if (req->sent == 0 && !req->fds.empty()) {
+        size_t len = sizeof(int) * req->fds.size();
+
+        memset(req->control_un.control, 0, sizeof(req->control_un.control));
+        req->msg.msg_control    = req->control_un.control;
+        req->msg.msg_controllen = CMSG_SPACE(len);
+
+        struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&req->msg);
+        pcmsg->cmsg_len   = CMSG_LEN(len);
         pcmsg->cmsg_level = SOL_SOCKET;
         pcmsg->cmsg_type  = SCM_RIGHTS;
-        *((int*)CMSG_DATA(pcmsg)) = result.resultFd;
+        memcpy(CMSG_DATA(pcmsg), req->fds.data(), len);
+    }
+}
+
+/* mSendLock must be held */
+void SaceSocketWriter::popLocked () {
+    SendRequest *req = mSendQueue.front();
+    mSendQueue.pop_front();
+
+    mQueuedBytes -= req->data.size();
+    close_fds(req->fds);
+    delete req;
+}
+
+/* mSendLock must be held, io_uring : a single dup is closed by the linked close,
+ * several are closed on completion.
+ */
+bool SaceSocketWriter::issueSend (SendRequest *req) {
+    buildMsg(req);
+
+    int close_fd = (req->sent == 0 && req->fds.size() == 1)? req->fds[0] : -1;
+    if (!mUring->prepSendmsg(sockfd, &req->msg, SACE_URING_DATA(req, SACE_URING_TAG_SEND), close_fd)) {
+        SACE_LOGE("%s io_uring submission queue full", getName());
+        return false;
     }
 
-    int ret = TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, MSG_WAITALL));
-    if (ret <= 0)
-        SACE_LOGE("%s handle result fail %s errstr=%s ret=%d", getName(), result.to_string().c_str(), strerror(errno), ret);
+    if (close_fd >= 0)
+        req->fds.clear();
+    req->inflight = this;
+    return true;
 }
 
-void SaceSocketWriter::sendResponse (const SaceStatusResponse &response) {
-    struct iovec  iov[1];
-    struct msghdr msg;
+/* mSendLock must be held, epoll : send until EAGAIN, true if drained.
+ * queued frames go out together, their fds ride on the first byte of the
+ * batch and the client hands them to FD results in frame order.
+ */
+bool SaceSocketWriter::flushLocked () {
+    while (!mSendQueue.empty()) {
+        struct msghdr msg;
+        size_t niov = 0;
+        int nfds = 0;
+        int *fds = (int*)CMSG_DATA(&mControl.cm);
 
-    SACE_LOGI("%s writeResponse %s", getName(), response.to_string().c_str());
+        for (SendRequest *req : mSendQueue) {
+            if (niov >= MAX_COALESCE_FRAMES)
+                break;
+
+            if (req->sent == 0 && !req->fds.empty()) {
+                if (nfds + req->fds.size() > SACE_MAX_RECV_FDS)
+                    break;
+                for (int fd : req->fds)
+                    fds[nfds++] = fd;
+            }
+
+            mIov[niov].iov_base = req->data.data() + req->sent;
+            mIov[niov].iov_len  = req->data.size() - req->sent;
+            niov++;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = mIov;
+        msg.msg_iovlen = niov;
+        if (nfds > 0) {
+            msg.msg_control    = mControl.control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+            mControl.cm.cmsg_len   = CMSG_LEN(sizeof(int) * nfds);
+            mControl.cm.cmsg_level = SOL_SOCKET;
+            mControl.cm.cmsg_type  = SCM_RIGHTS;
+        }
+
+        int ret = TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT));
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+
+            /* peer is gone, the reader shard will remove it */
+            SACE_LOGE("%s send fail errstr=%s, drop %d frames", getName(), strerror(errno), (int)mSendQueue.size());
+            while (!mSendQueue.empty())
+                popLocked();
+            return true;
+        }
+
+        /* all fds have been passed with the first chunk */
+        for (size_t i = 0; i < niov && nfds > 0; i++)
+            close_fds(mSendQueue[i]->fds);
+
+        size_t sent = ret;
+        while (sent > 0) {
+            SendRequest *req = mSendQueue.front();
+            size_t remain = req->data.size() - req->sent;
+            if (sent < remain) {
+                req->sent += sent;
+                break;
+            }
+
+            sent -= remain;
+            popLocked();
+        }
+    }
+
+    return true;
+}
+
+/* mSendLock must be held */
+void SaceSocketWriter::watchWritable (bool on) {
+    if (mEpollFd < 0 || mWantWrite == on)
+        return;
+
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    if (on)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = mEpollPtr;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_MOD, sockfd, &ev) < 0)
+        SACE_LOGE("%s watch writable fail %s", getName(), strerror(errno));
+
+    mWantWrite = on;
+}
+
+void SaceSocketWriter::queueSend (const Parcel &parcel, const vector<int> &fds) {
+    SendRequest *req = new SendRequest();
+    req->data.assign(parcel.data(), parcel.data() + parcel.dataSize());
+    req->sent = 0;
+
+    /* the executor keeps its fds, the queue owns dups */
+    for (int fd : fds) {
+        int dupfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupfd < 0) {
+            SACE_LOGE("%s dup result fd fail %s", getName(), strerror(errno));
+            close_fds(req->fds);
+            delete req;
+            return;
+        }
+        req->fds.push_back(dupfd);
+    }
+
+    bool submit = false;
+    {
+        lock_guard<mutex> _l(mSendLock);
+        if (mClosed)
+            goto drop;
+
+        if (mQueuedBytes + req->data.size() > mQueueLimit) {
+            SACE_LOGW("%s outbound queue overflow %d bytes, %s", getName(), (int)mQueuedBytes,
+                mOverflow == SACE_OVERFLOW_DROP? "drop" : "disconnect");
+
+            /* the reader shard sees the hangup and destroys the client */
+            if (mOverflow == SACE_OVERFLOW_DISCONNECT) {
+                mClosed = true;
+                shutdown(sockfd, SHUT_RDWR);
+            }
+            goto drop;
+        }
+
+        mSendQueue.push_back(req);
+        mQueuedBytes += req->data.size();
+        if (mSendQueue.size() > 1 || mCorked > 0)
+            return;
+
+        kickLocked(&submit);
+    }
+
+    if (submit)
+        mUring->submit();
+    return;
+
+drop:
+    close_fds(req->fds);
+    delete req;
+}
+
+/* mSendLock must be held, start sending the queue head */
+void SaceSocketWriter::kickLocked (bool *submit) {
+    if (mUring != nullptr) {
+        while (!mSendQueue.empty() && mSendQueue.front()->inflight == nullptr) {
+            if (issueSend(mSendQueue.front())) {
+                *submit = true;
+                break;
+            }
+            popLocked();
+        }
+    }
+    else if (!mWantWrite && !flushLocked())
+        watchWritable(true);
+}
+
+void SaceSocketWriter::cork () {
+    lock_guard<mutex> _l(mSendLock);
+    mCorked++;
+}
+
+void SaceSocketWriter::uncork () {
+    bool submit = false;
+    {
+        lock_guard<mutex> _l(mSendLock);
+        if (--mCorked > 0 || mClosed || mSendQueue.empty())
+            return;
+
+        kickLocked(&submit);
+    }
+
+    if (submit)
+        mUring->submit();
+}
+
+void SaceSocketWriter::onWritable () {
+    lock_guard<mutex> _l(mSendLock);
+    if (mClosed)
+        return;
+
+    if (flushLocked())
+        watchWritable(false);
+}
+
+void SaceSocketWriter::onSendComplete (SendRequest *req, int res) {
+    /* the caller holds a reference until we return */
+    req->inflight = nullptr;
+
+    {
+        lock_guard<mutex> _l(mSendLock);
+        if (res < 0)
+            SACE_LOGE("%s io_uring sendmsg fail errstr=%s", getName(), strerror(-res));
+        else {
+            req->sent += res;
+            /* passed with the first chunk */
+            close_fds(req->fds);
+        }
+
+        /* short send, the rest goes before anything else */
+        if (res > 0 && req->sent < req->data.size() && !mClosed && issueSend(req))
+            goto submit;
+
+        popLocked();
+        while (!mSendQueue.empty() && !mClosed) {
+            if (issueSend(mSendQueue.front()))
+                goto submit;
+            popLocked();
+        }
+        return;
+    }
+
+submit:
+    mUring->submit();
+}
+
+/* socket is going away, drop what is not in flight */
+void SaceSocketWriter::close () {
+    lock_guard<mutex> _l(mSendLock);
+    mClosed = true;
+    mEpollFd = -1;
+
+    while (!mSendQueue.empty() && mSendQueue.back()->inflight == nullptr) {
+        SendRequest *req = mSendQueue.back();
+        mSendQueue.pop_back();
+
+        mQueuedBytes -= req->data.size();
+        close_fds(req->fds);
+        delete req;
+    }
+}
+
+void SaceSocketWriter::sendResult (const SaceResult &result) {
     Parcel parcel;
-    response.writeToParcel(&parcel);
+    result.writeToParcel(&parcel);
 
-    iov[0].iov_base = (void*)parcel.data();
-    iov[0].iov_len  = parcel.dataSize();
+    vector<int> fds;
+    collect_result_fds(result, fds);
+    queueSend(parcel, fds);
+}
 
-    msg.msg_name    = nullptr;
-    msg.msg_namelen = 0;
-    msg.msg_iov    = iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control    = nullptr;
-    msg.msg_controllen = 0;
+void SaceSocketWriter::sendResponse (const SaceStatusResponse &response) {
+    SACE_LOGI("%s writeResponse %s", getName(), response.to_string().c_str());
 
-    int ret = TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, 0));
-    if (ret <= 0)
-        SACE_LOGE("%s response fail errstr=%s ret=%d", getName(), strerror(errno), ret);
+    Parcel parcel;
+    response.writeToParcel(&parcel);
+    queueSend(parcel, vector<int>());
 }
 
 // ----------------------------------------------------------
 void SaceBinderWriter::sendResult (const SaceResult &result) {
+    if (this->result == nullptr) {
+        /* oneway, fds are dup'ed into the client before it returns */
+        if (listener == nullptr || !listener->onResult(result).isOk())
+            SACE_LOGE("%s onResult fail %s", getName(), result.to_string().c_str());
+        return;
+    }
+
     *(this->result) = result;
     if (sem_post(&sync_sem) < 0)
         SACE_LOGE("%s sem_post errno%d errstr=%s", getName(), errno, strerror(errno));
 }
 
 void SaceBinderWriter::sendResponse (const SaceStatusResponse &response) {
-    if (listener != nullptr)
-        listener->onResponse(response);
-    else
+    if (listener == nullptr) {
         SACE_LOGE("%s writeResponse %s", getName(), response.to_string().c_str());
+        return;
+    }
+
+    {
+        lock_guard<mutex> _l(mPendingLock);
+        if (mCorked > 0) {
+            mPending.push_back(response);
+            return;
+        }
+    }
+
+    listener->onResponse(response);
+}
+
+void SaceBinderWriter::cork () {
+    lock_guard<mutex> _l(mPendingLock);
+    mCorked++;
+}
+
+void SaceBinderWriter::uncork () {
+    vector<SaceStatusResponse> responses;
+    {
+        lock_guard<mutex> _l(mPendingLock);
+        if (--mCorked > 0)
+            return;
+        responses.swap(mPending);
+    }
+
+    if (responses.size() == 1)
+        listener->onResponse(responses[0]);
+    else if (responses.size() > 1 && !listener->onResponses(responses).isOk()) {
+        /* listener built before onResponses existed */
+        SACE_LOGW("%s onResponses fail, deliver %d responses one by one", getName(), (int)responses.size());
+        for (auto &response : responses)
+            listener->onResponse(response);
+    }
 }
 
 void SaceBinderWriter::waitResult () {
@@ -103,4 +426,264 @@ void SaceBinderWriter::waitResult () {
         SACE_LOGE("%s sem_wait errno=%d errstr=%s", getName(), errno, strerror(errno));
 }
 
+// ----------------------------------------------------------
+const char* SaceBatchWriter::NAME = "SWBatch";
+
+SaceBatchWriter::SaceBatchWriter (pid_t pid, sp<SaceWriter> writer, const SaceCommand &cmd):SaceWriter(NAME, pid) {
+    mWriter = writer;
+    mRemain = cmd.batch.size();
+    mDone.assign(mRemain, false);
+
+    mBatch.sequence = cmd.sequence;
+    mBatch.name = cmd.name;
+    mBatch.resultType   = SACE_RESULT_TYPE_BATCH;
+    mBatch.resultStatus = SACE_RESULT_STATUS_OK;
+    mBatch.resultFd = -1;
+    mBatch.results.resize(mRemain);
+
+    for (size_t i = 0; i < mRemain; i++) {
+        mBatch.results[i].sequence = cmd.batch[i].sequence;
+        mBatch.results[i].name = cmd.batch[i].name;
+        mBatch.results[i].resultFd = -1;
+    }
+}
+
+void SaceBatchWriter::sendResult (const SaceResult &result) {
+    SaceResult batch;
+    {
+        lock_guard<mutex> _l(mLock);
+        size_t i;
+        for (i = 0; i < mDone.size(); i++) {
+            if (!mDone[i] && mBatch.results[i].sequence == result.sequence)
+                break;
+        }
+
+        if (i >= mDone.size()) {
+            SACE_LOGW("%s unexpected %s", getName(), result.to_string().c_str());
+            return;
+        }
+
+        /* the excutor closes its fd once we return, keep a dup until the batch leaves */
+        mBatch.results[i] = result;
+        if (result.resultFd >= 0) {
+            mBatch.results[i].resultFd = fcntl(result.resultFd, F_DUPFD_CLOEXEC, 0);
+            if (mBatch.results[i].resultFd < 0) {
+                SACE_LOGE("%s dup result fd errno=%d errstr=%s", getName(), errno, strerror(errno));
+                mBatch.results[i].resultStatus = SACE_RESULT_STATUS_FAIL;
+            }
+        }
+
+        mDone[i] = true;
+        if (--mRemain > 0)
+            return;
+
+        batch = mBatch;
+    }
+
+    SACE_LOGI("%s batch complete %s", getName(), batch.to_string().c_str());
+    mWriter->sendResult(batch);
+
+    /* the client writer queued dups of its own */
+    closeResultFds(batch);
+}
+
+SaceBatchWriter::~SaceBatchWriter () {
+    /* never completed, the dups of the results we got are still ours */
+    if (mRemain > 0)
+        closeResultFds(mBatch);
+}
+
+void SaceBatchWriter::closeResultFds (SaceResult &batch) {
+    for (SaceResult &result : batch.results) {
+        if (result.resultFd >= 0)
+            close(result.resultFd);
+        result.resultFd = -1;
+    }
+}
+
+void SaceBatchWriter::sendResponse (const SaceStatusResponse &response) {
+    mWriter->sendResponse(response);
+}
+
+void SaceBatchWriter::cork () {
+    mWriter->cork();
+}
+
+void SaceBatchWriter::uncork () {
+    mWriter->uncork();
+}
+
+// ----------------------------------------------------------
+const size_t SaceShmWriter::MAX_PENDING_BYTES = 256 * 1024;
+
+/* fds can't live in the ring, they follow their frame on the socket in result order */
+static int send_result_fds (int sockfd, const vector<int> &fds) {
+    struct iovec  iov[1];
+    struct msghdr msg;
+    struct cmsghdr *pcmsg;
+    uint8_t byte = 0;
+    size_t len = sizeof(int) * fds.size();
+
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)];
+    } control_un;
+    memset(control_un.control, 0, sizeof(control_un.control));
+
+    iov[0].iov_base = &byte;
+    iov[0].iov_len  = sizeof(byte);
+
+    msg.msg_name    = nullptr;
+    msg.msg_namelen = 0;
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = CMSG_SPACE(len);
+
+    pcmsg = CMSG_FIRSTHDR(&msg);
+    pcmsg->cmsg_len   = CMSG_LEN(len);
+    pcmsg->cmsg_level = SOL_SOCKET;
+    pcmsg->cmsg_type  = SCM_RIGHTS;
+    memcpy(CMSG_DATA(pcmsg), fds.data(), len);
+
+    return send_socket_msg(sockfd, &msg);
+}
+
+SaceShmWriter::~SaceShmWriter () {
+    for (PendingFrame &frame : mPending)
+        close_fds(frame.fds);
+}
+
+void SaceShmWriter::sendFrame (const Parcel &parcel, const vector<int> &fds) {
+    lock_guard<mutex> _l(channel->completeLock);
+    if (mClosed)
+        return;
+
+    /* nothing overtakes queued frames, their fds are matched in order */
+    if (mPending.empty() && publishLocked(parcel.data(), parcel.dataSize(), fds)) {
+        if (mCorked <= 0)
+            ringLocked();
+        return;
+    }
+
+    if (mClosed)
+        return;
+
+    if (mPendingBytes + parcel.dataSize() > MAX_PENDING_BYTES) {
+        SACE_LOGW("%s completion queue overflow %d bytes, disconnect", getName(), (int)mPendingBytes);
+        disconnectLocked();
+        return;
+    }
+
+    /* the executor keeps its fds, the queue owns dups */
+    PendingFrame frame;
+    frame.data.assign(parcel.data(), parcel.data() + parcel.dataSize());
+    for (int fd : fds) {
+        int dupfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupfd < 0) {
+            SACE_LOGE("%s dup result fd fail %s", getName(), strerror(errno));
+            close_fds(frame.fds);
+            return;
+        }
+        frame.fds.push_back(dupfd);
+    }
+
+    mPendingBytes += frame.data.size();
+    mPending.push_back(move(frame));
+
+    /* corked frames may be what fills the ring */
+    ringLocked();
+}
+
+/* completeLock must be held, false if the ring is full and needSpace is armed */
+bool SaceShmWriter::publishLocked (const uint8_t *data, size_t len, const vector<int> &fds) {
+    SaceRing &ring = channel->region.complete;
+
+    do {
+        if (ring.push(data, len)) {
+            /* the client reads them once it pops the frame, a lost fd message would shift every later result */
+            if (!fds.empty() && send_result_fds(channel->sockfd, fds) <= 0) {
+                SACE_LOGE("%s send result fd fail errstr=%s", getName(), strerror(errno));
+                disconnectLocked();
+            }
+            return true;
+        }
+    } while (!ring.prepareFull(len));
+
+    return false;
+}
+
+/* completeLock must be held, true once the queue is empty */
+bool SaceShmWriter::flushLocked () {
+    bool pushed = false;
+
+    while (!mPending.empty() && !mClosed) {
+        PendingFrame &frame = mPending.front();
+        if (!publishLocked(frame.data.data(), frame.data.size(), frame.fds))
+            break;
+
+        pushed = true;
+        mPendingBytes -= frame.data.size();
+        close_fds(frame.fds);
+        mPending.pop_front();
+    }
+
+    if (pushed)
+        ringLocked();
+    return mPending.empty();
+}
+
+/* completeLock must be held, the reader shard sees the hangup and destroys the client */
+void SaceShmWriter::disconnectLocked () {
+    mClosed = true;
+    shutdown(channel->sockfd, SHUT_RDWR);
+
+    for (PendingFrame &frame : mPending)
+        close_fds(frame.fds);
+    mPending.clear();
+    mPendingBytes = 0;
+}
+
+void SaceShmWriter::flush () {
+    lock_guard<mutex> _l(channel->completeLock);
+    if (!mClosed)
+        flushLocked();
+}
+
+/* completeLock must be held */
+void SaceShmWriter::ringLocked () {
+    uint64_t value = 1;
+
+    if (channel->region.complete.needWakeup() && TEMP_FAILURE_RETRY(write(channel->complete_bell, &value, sizeof(value))) < 0)
+        SACE_LOGE("%s ring complete doorbell errno=%d errstr=%s", getName(), errno, strerror(errno));
+}
+
+void SaceShmWriter::cork () {
+    lock_guard<mutex> _l(channel->completeLock);
+    mCorked++;
+}
+
+void SaceShmWriter::uncork () {
+    lock_guard<mutex> _l(channel->completeLock);
+    if (--mCorked <= 0)
+        ringLocked();
+}
+
+void SaceShmWriter::sendResult (const SaceResult &result) {
+    Parcel parcel;
+    result.writeToParcel(&parcel);
+
+    vector<int> fds;
+    collect_result_fds(result, fds);
+    sendFrame(parcel, fds);
+}
+
+void SaceShmWriter::sendResponse (const SaceStatusResponse &response) {
+    SACE_LOGI("%s writeResponse %s", getName(), response.to_string().c_str());
+
+    Parcel parcel;
+    response.writeToParcel(&parcel);
+    sendFrame(parcel, vector<int>());
+}
+
 }; //namespace android
@@ -25,6 +25,13 @@
 #include "android/ISaceListener.h"
 #include <sace/SaceTypes.h>
 #include <sace/SaceLog.h>
+#include <sace/SaceRing.h>
+#include <sace/SaceStream.h>
+#include "SaceConfig.h"
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <sys/socket.h>
 
 namespace android {
 
@@ -50,6 +57,10 @@ public:
     virtual void sendResult (const SaceResult &) = 0;
     virtual void sendResponse (const SaceStatusResponse &) = 0;
 
+    /* while corked, frames are held back and leave together on uncork */
+    virtual void cork () {}
+    virtual void uncork () {}
+
     bool operator == (SaceWriter* writer) const {
         return writer == nullptr? false : mId == writer->mId;
     }
@@ -59,28 +70,145 @@ public:
     }
 };
 
+/* corks every writer added to it until the batch goes out of scope */
+class SaceWriterBatch {
+    vector<sp<SaceWriter>> mWriters;
+
+    SaceWriterBatch (const SaceWriterBatch &);
+    SaceWriterBatch& operator = (const SaceWriterBatch &);
+public:
+    SaceWriterBatch () {}
+
+    ~SaceWriterBatch () {
+        for (auto &wr : mWriters)
+            wr->uncork();
+    }
+
+    void add (const sp<SaceWriter> &writer) {
+        for (auto &wr : mWriters) {
+            if (wr.get() == writer.get())
+                return;
+        }
+
+        writer->cork();
+        mWriters.push_back(writer);
+    }
+};
+
 // ---------------------------------------------------------
+class SaceUring;
+
+/* results never block the executor : frames go to a bounded per-client queue,
+ * flushed right away when the socket has room and later by the reader shard.
+ * epoll : queued frames are coalesced into one sendmsg with their fds.
+ */
 class SaceSocketWriter : public SaceWriter {
+    static const size_t DEF_QUEUE_BYTES;
+    static const size_t MAX_COALESCE_FRAMES = 64;
+
     int sockfd;
+
 public:
+    /* one queued frame, its fds are dups owned by the queue */
+    struct SendRequest {
+        /* io_uring : set while the sendmsg is in flight */
+        sp<SaceSocketWriter> inflight;
+        vector<uint8_t> data;
+        size_t sent;
+        vector<int> fds;
+        struct iovec  iov;
+        struct msghdr msg;
+        union {
+            struct cmsghdr cm;
+            char control[CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)];
+        } control_un;
+    };
+
     explicit SaceSocketWriter (const char* name, pid_t pid, int fd):SaceWriter(name, pid) {
-        sockfd = fd;
+        sockfd  = fd;
+        mUring  = nullptr;
+        mEpollFd  = -1;
+        mEpollPtr = nullptr;
+        mWantWrite = false;
+        mClosed = false;
+        mQueuedBytes = 0;
+        mQueueLimit  = DEF_QUEUE_BYTES;
+        mOverflow    = SACE_OVERFLOW_DISCONNECT;
+        mCorked      = 0;
     }
-    virtual ~SaceSocketWriter() {}
+    virtual ~SaceSocketWriter();
 
     virtual void sendResult (const SaceResult &);
     virtual void sendResponse (const SaceStatusResponse &);
+    virtual void cork ();
+    virtual void uncork ();
+
+    void setOutQueue (size_t limit, enum SaceOverflowPolicy policy) {
+        mQueueLimit = limit;
+        mOverflow   = policy;
+    }
+
+    /* set by the reader shard owning the socket, before any command is read */
+    void attachUring (SaceUring *uring) {
+        mUring = uring;
+    }
+    void attachEpoll (int epfd, void *ptr) {
+        mEpollFd  = epfd;
+        mEpollPtr = ptr;
+    }
+
+    /* invoked in the reader shard thread */
+    void onWritable ();
+    void onSendComplete (SendRequest *req, int res);
+    void close ();
+
+private:
+    SaceUring *mUring;
+    int   mEpollFd;
+    void *mEpollPtr;
+    bool  mWantWrite;
+
+    mutex mSendLock;
+    deque<SendRequest*> mSendQueue;
+    size_t mQueuedBytes;
+    size_t mQueueLimit;
+    enum SaceOverflowPolicy mOverflow;
+    bool mClosed;
+    int  mCorked;
+
+    struct iovec mIov[MAX_COALESCE_FRAMES];
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * SACE_MAX_RECV_FDS)];
+    } mControl;
+
+    void kickLocked (bool *submit);
+    void queueSend (const Parcel &parcel, const vector<int> &fds);
+    void buildMsg (SendRequest *req);
+    bool issueSend (SendRequest *req);
+    bool flushLocked ();
+    void watchWritable (bool on);
+    void popLocked ();
 };
 
 // ---------------------------------------------------------
+/* without rslt the result goes back through ISaceListener.onResult,
+ * otherwise it is stored to rslt for waitResult.
+ */
 class SaceBinderWriter : public SaceWriter {
     sp<ISaceListener> listener;
     SaceResult    *result;
     sem_t         sync_sem;
+
+    /* responses held while corked, delivered by one onResponses */
+    mutex mPendingLock;
+    vector<SaceStatusResponse> mPending;
+    int   mCorked;
 public:
     explicit SaceBinderWriter (const char* name, pid_t pid, sp<ISaceListener>& listener, SaceResult *rslt):SaceWriter(name, pid) {
         this->listener = listener;
         this->result   = rslt;
+        this->mCorked  = 0;
 
         if (sem_init(&sync_sem, 0, 0) < 0)
             SACE_LOGE("%s sem_init errno=%d errstr=%s", getName(), errno, strerror(errno));
@@ -89,10 +217,102 @@ public:
 
     virtual void sendResult (const SaceResult &);
     virtual void sendResponse (const SaceStatusResponse &);
+    virtual void cork ();
+    virtual void uncork ();
 
     void waitResult();
 };
 
+// ---------------------------------------------------------
+/* gathers the results of a batch's sub commands, the batch result goes out
+ * through the client writer once every sub command has answered.
+ */
+class SaceBatchWriter : public SaceWriter {
+    static const char *NAME;
+
+    sp<SaceWriter> mWriter;
+    mutex mLock;
+    SaceResult mBatch;
+    vector<bool> mDone;
+    size_t mRemain;
+
+    static void closeResultFds (SaceResult &batch);
+public:
+    explicit SaceBatchWriter (pid_t pid, sp<SaceWriter> writer, const SaceCommand &cmd);
+    virtual ~SaceBatchWriter();
+
+    virtual void sendResult (const SaceResult &);
+    /* later responses of the sub commands go straight to the client */
+    virtual void sendResponse (const SaceStatusResponse &);
+    virtual void cork ();
+    virtual void uncork ();
+};
+
+// ---------------------------------------------------------
+/* rings and doorbells of one shared-memory client, shared by reader and writer */
+class SaceShmChannel : public RefBase {
+public:
+    int sockfd;
+    int submit_bell;
+    int complete_bell;
+    SaceShmRegion region;
+    /* completion ring has a single producer */
+    mutex completeLock;
+
+    SaceShmChannel () {
+        sockfd = submit_bell = complete_bell = -1;
+    }
+
+    virtual ~SaceShmChannel () {
+        if (sockfd >= 0) close(sockfd);
+        if (submit_bell >= 0) close(submit_bell);
+        if (complete_bell >= 0) close(complete_bell);
+    }
+};
+
+/* results never block the executor : a frame that doesn't fit the completion
+ * ring waits in a bounded queue, flushed by the reader shard once the client
+ * rings the submit doorbell after making room.
+ */
+class SaceShmWriter : public SaceWriter {
+    static const size_t MAX_PENDING_BYTES;
+
+    /* one queued frame, its fds are dups owned by the queue */
+    struct PendingFrame {
+        vector<uint8_t> data;
+        vector<int> fds;
+    };
+
+    sp<SaceShmChannel> channel;
+    /* doorbell is rung once on uncork */
+    int mCorked;
+    deque<PendingFrame> mPending;
+    size_t mPendingBytes;
+    bool mClosed;
+
+    void sendFrame (const Parcel &parcel, const vector<int> &fds);
+    bool publishLocked (const uint8_t *data, size_t len, const vector<int> &fds);
+    bool flushLocked ();
+    void disconnectLocked ();
+    void ringLocked ();
+public:
+    explicit SaceShmWriter (const char* name, pid_t pid, sp<SaceShmChannel> &chan):SaceWriter(name, pid) {
+        channel = chan;
+        mCorked = 0;
+        mPendingBytes = 0;
+        mClosed = false;
+    }
+    virtual ~SaceShmWriter();
+
+    virtual void sendResult (const SaceResult &);
+    virtual void sendResponse (const SaceStatusResponse &);
+    virtual void cork ();
+    virtual void uncork ();
+
+    /* invoked in the reader shard thread on the submit doorbell */
+    void flush ();
+};
+
 }; //namespace android
 
 #endif
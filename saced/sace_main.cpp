@@ -25,6 +25,9 @@
 #include "sace/SaceLog.h"
 #include "SaceCommandMonitor.h"
 #include "SaceCommandDispatcher.h"
+#include "SaceConfig.h"
+#include "SaceSpawn.h"
+#include "SaceSpawner.h"
 #include "SaceMessage.h"
 
 using namespace android;
@@ -56,6 +59,8 @@ static void exit_sace () {
     sace_cmd_monitor->stopListen();
     /* stop dispatching */
     sace_cmd_dispatcher->stop();
+    /* after the excutors, nothing spawns anymore */
+    SaceSpawner::getInstance()->stop();
 
     delete sace_cmd_monitor.release();
 }
@@ -64,7 +69,14 @@ int main(void) {
     SACE_LOGI("SACE Starting(%d)......", getpid());
 
     prctl(PR_SET_PDEATHSIG, SIGHUP);
-    g_event_fd = eventfd(0, 0);
+
+    SaceSpawn::saveProcessSched();
+
+    /* before any thread or fd, the helper only inherits the bare process */
+    if (SaceConfig::spawner() && !SaceSpawner::getInstance()->start())
+        SACE_LOGW("SaceSpawner not started, spawn from saced");
+
+    g_event_fd = eventfd(0, EFD_CLOEXEC);
     if (g_event_fd < 0) {
         SACE_LOGE("SACE Initialize Exit EventFd Failed");
         return -1;
@@ -9,3 +9,36 @@ LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libsace
 LOCAL_MODULE := test_cmd
 
 #include $(BUILD_EXECUTABLE)
+
+# unit tests of saced internals, built with its sources minus sace_main.cpp
+include $(CLEAR_VARS)
+
+SACED_PATH := ../saced
+LOCAL_SRC_FILES :=                          \
+	test_excutor.cpp                        \
+	test_message_pool.cpp                   \
+	test_ring.cpp                           \
+	test_spawn.cpp                          \
+	test_stream.cpp                         \
+	test_timer_wheel.cpp                    \
+	test_worker_pool.cpp                    \
+	$(SACED_PATH)/SaceCommandDispatcher.cpp \
+	$(SACED_PATH)/SaceCommandMonitor.cpp    \
+	$(SACED_PATH)/SaceConfig.cpp            \
+	$(SACED_PATH)/SaceEvent.cpp             \
+	$(SACED_PATH)/SaceExcutor.cpp           \
+	$(SACED_PATH)/SaceMessage.cpp           \
+	$(SACED_PATH)/SaceMessagePool.cpp       \
+	$(SACED_PATH)/SaceReader.cpp            \
+	$(SACED_PATH)/SaceSpawn.cpp             \
+	$(SACED_PATH)/SaceSpawner.cpp           \
+	$(SACED_PATH)/SaceStats.cpp             \
+	$(SACED_PATH)/SaceTimerWheel.cpp        \
+	$(SACED_PATH)/SaceUring.cpp             \
+	$(SACED_PATH)/SaceWriter.cpp            \
+	$(SACED_PATH)/SaceWorkerPool.cpp        \
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../saced $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../libsace/include
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libselinux libcap libsace libprocessgroup
+LOCAL_MODULE := sace_unit_test
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SaceConfig.h"
+#include "SaceExcutor.h"
+#include "SaceTimerWheel.h"
+#include "SaceWriter.h"
+
+using namespace android;
+
+#define RESULT_WAIT_MS 5000
+
+/* keeps every result it is given */
+class TestWriter : public SaceWriter {
+    mutex mLock;
+    condition_variable mCond;
+    vector<SaceResult> mResults;
+public:
+    explicit TestWriter (pid_t pid):SaceWriter("TestWriter", pid) {}
+
+    virtual void sendResult (const SaceResult &result) override {
+        lock_guard<mutex> _l(mLock);
+        mResults.push_back(result);
+        mCond.notify_all();
+    }
+
+    virtual void sendResponse (const SaceStatusResponse &) override {}
+
+    size_t count () {
+        lock_guard<mutex> _l(mLock);
+        return mResults.size();
+    }
+
+    /* the index-th result, false if it didn't come in time */
+    bool waitResult (size_t index, SaceResult *result) {
+        unique_lock<mutex> _l(mLock);
+        if (!mCond.wait_for(_l, chrono::milliseconds(RESULT_WAIT_MS), [&] { return mResults.size() > index; }))
+            return false;
+
+        *result = mResults[index];
+        return true;
+    }
+};
+
+static sp<SaceReaderMessage> makeMessage (enum SaceNormalCommandType cmdType, uint32_t sequence, uint64_t label,
+        const sp<TestWriter> &writer, pid_t pid, const char *command = "") {
+    sp<SaceCommand> cmd = new SaceCommand();
+    cmd->type = SACE_TYPE_NORMAL;
+    cmd->normalCmdType = cmdType;
+    cmd->flags    = SACE_CMD_FLAG_IN;
+    cmd->sequence = sequence;
+    cmd->label    = label;
+    cmd->name     = "test";
+    cmd->command  = command;
+
+    sp<SaceReaderMessage> msg = new SaceReaderMessage();
+    msg->msgCmd    = cmd;
+    msg->msgWriter = writer;
+    msg->msgClient = SaceClientIdentifier(getuid(), pid);
+    msg->msgHandler  = typeCmdToMsg(cmd->type);
+    msg->msgPriority = priorityOfMsg(msg);
+    return msg;
+}
+
+class SaceExcutorTest : public ::testing::Test {
+protected:
+    static void SetUpTestSuite () {
+        /* sace_pclose hangs its kill on the daemon wheel */
+        ASSERT_TRUE(SaceTimerWheel::getInstance()->start());
+    }
+};
+
+/* holds its first message until open() */
+class GateExcutor : public SaceExcutor {
+    mutex mLock;
+    condition_variable mCond;
+    bool mOpen;
+    bool mEntered;
+    int mRan;
+public:
+    GateExcutor ():SaceExcutor(SACE_MESSAGE_HANDLER_NORMAL, "TestGate", "TestGate.MT") {
+        mOpen    = false;
+        mEntered = false;
+        mRan     = 0;
+    }
+
+    bool waitEntered () {
+        unique_lock<mutex> _l(mLock);
+        return mCond.wait_for(_l, chrono::milliseconds(RESULT_WAIT_MS), [this] { return mEntered; });
+    }
+
+    void open () {
+        lock_guard<mutex> _l(mLock);
+        mOpen = true;
+        mCond.notify_all();
+    }
+
+    bool waitRan (int count) {
+        unique_lock<mutex> _l(mLock);
+        return mCond.wait_for(_l, chrono::milliseconds(RESULT_WAIT_MS), [&] { return mRan >= count; });
+    }
+
+protected:
+    virtual void excuteNormal (const sp<SaceMessageHeader> &msg __unused) override {
+        unique_lock<mutex> _l(mLock);
+        mEntered = true;
+        mCond.notify_all();
+        mCond.wait(_l, [this] { return mOpen; });
+        mRan++;
+        mCond.notify_all();
+    }
+};
+
+/* spawns over the queue limit are answered BUSY right away, control messages still get in */
+TEST_F(SaceExcutorTest, BusyShedding) {
+    int limit = SaceConfig::excutorQueueLimit();
+    if (limit <= 0)
+        GTEST_SKIP() << "persist.sace.excutor.queue disables the limit";
+
+    GateExcutor excutor;
+    sp<TestWriter> writer = new TestWriter(100);
+    ASSERT_TRUE(excutor.init());
+
+    ASSERT_TRUE(excutor.excute(makeMessage(SACE_NORMAL_CMD_START, 0, 0, writer, 100)));
+    ASSERT_TRUE(excutor.waitEntered());
+
+    for (int i = 1; i <= limit; i++)
+        ASSERT_TRUE(excutor.excute(makeMessage(SACE_NORMAL_CMD_START, i, 0, writer, 100)));
+    EXPECT_EQ(0u, writer->count());
+
+    for (int i = 0; i < 3; i++) {
+        SaceResult result;
+        ASSERT_TRUE(excutor.excute(makeMessage(SACE_NORMAL_CMD_START, limit + 1 + i, 0, writer, 100)));
+        ASSERT_EQ((size_t)i + 1, writer->count());
+        ASSERT_TRUE(writer->waitResult(i, &result));
+        EXPECT_EQ(SACE_RESULT_STATUS_BUSY, result.resultStatus);
+        EXPECT_EQ((uint32_t)(limit + 1 + i), result.sequence);
+    }
+
+    ASSERT_TRUE(excutor.excute(makeMessage(SACE_NORMAL_CMD_CLOSE, limit + 4, 0, writer, 100)));
+    EXPECT_EQ(3u, writer->count());
+
+    string dump;
+    excutor.dump(dump);
+    EXPECT_NE(string::npos, dump.find("busy=3")) << dump;
+
+    excutor.open();
+    EXPECT_TRUE(excutor.waitRan(limit + 2));
+    EXPECT_EQ(3u, writer->count());
+
+    excutor.uninit();
+}
+
+TEST(SaceCancelListTest, PerClient) {
+    SaceCancelList list;
+
+    EXPECT_FALSE(list.take(100, 7));
+
+    list.add(100, 7);
+    EXPECT_FALSE(list.take(200, 7));
+    EXPECT_FALSE(list.take(100, 8));
+    EXPECT_TRUE(list.take(100, 7));
+    /* once */
+    EXPECT_FALSE(list.take(100, 7));
+}
+
+/* the expire time only sheds commands without a deadline, a longer deadline is honoured */
+TEST_F(SaceExcutorTest, ExpireRespectsDeadline) {
+    if (SaceConfig::excutorShedPolicy() != SACE_SHED_EXPIRED)
+        GTEST_SKIP() << "persist.sace.excutor.shed doesn't expire";
+
+    int expire = SaceConfig::excutorExpireMs();
+    GateExcutor excutor;
+    sp<TestWriter> writer = new TestWriter(100);
+    ASSERT_TRUE(excutor.init());
+
+    ASSERT_TRUE(excutor.excute(makeMessage(SACE_NORMAL_CMD_START, 0, 0, writer, 100)));
+    ASSERT_TRUE(excutor.waitEntered());
+
+    sp<SaceReaderMessage> timed = makeMessage(SACE_NORMAL_CMD_START, 1, 0, writer, 100);
+    timed->msgCmd->setTimeout(expire + 10000);
+    ASSERT_TRUE(excutor.excute(timed));
+    ASSERT_TRUE(excutor.excute(makeMessage(SACE_NORMAL_CMD_START, 2, 0, writer, 100)));
+
+    usleep((expire + 100) * 1000);
+    excutor.open();
+
+    SaceResult result;
+    ASSERT_TRUE(writer->waitResult(0, &result));
+    EXPECT_EQ(SACE_RESULT_STATUS_TIMEOUT, result.resultStatus);
+    EXPECT_EQ(2u, result.sequence);
+
+    EXPECT_TRUE(excutor.waitRan(2));
+    EXPECT_EQ(1u, writer->count());
+
+    excutor.uninit();
+}
+
+/* a client's CANCEL only reaches its own commands, queued or running */
+TEST_F(SaceExcutorTest, CancelIsPerClient) {
+    const pid_t pidA = 1001, pidB = 1002;
+    const uint32_t sequence = 7;
+
+    SaceNormalExcutor excutor;
+    sp<TestWriter> writerA = new TestWriter(pidA);
+    sp<TestWriter> writerB = new TestWriter(pidB);
+    SaceResult result;
+    ASSERT_TRUE(excutor.init());
+
+    /* A cancels its start before sending it */
+    excutor.excute(makeMessage(SACE_NORMAL_CMD_CANCEL, 1, SEQUENCE_TO_LABEL(sequence, 0), writerA, pidA));
+    ASSERT_TRUE(writerA->waitResult(0, &result));
+    EXPECT_EQ(SACE_RESULT_STATUS_OK, result.resultStatus);
+
+    /* B's start of the same sequence is not A's */
+    excutor.excute(makeMessage(SACE_NORMAL_CMD_START, sequence, 0, writerB, pidB, "sleep 30"));
+    ASSERT_TRUE(writerB->waitResult(0, &result));
+    ASSERT_EQ(SACE_RESULT_STATUS_OK, result.resultStatus);
+    ASSERT_EQ(SACE_RESULT_TYPE_FD, result.resultType);
+    uint64_t label = result.label;
+
+    excutor.excute(makeMessage(SACE_NORMAL_CMD_START, sequence, 0, writerA, pidA, "sleep 30"));
+    ASSERT_TRUE(writerA->waitResult(1, &result));
+    EXPECT_EQ(SACE_RESULT_STATUS_CANCELLED, result.resultStatus);
+
+    /* A naming B's running command leaves it alone */
+    excutor.excute(makeMessage(SACE_NORMAL_CMD_CANCEL, 2, label, writerA, pidA));
+    ASSERT_TRUE(writerA->waitResult(2, &result));
+
+    /* still running, B can close it */
+    excutor.excute(makeMessage(SACE_NORMAL_CMD_CLOSE, 3, label, writerB, pidB));
+    ASSERT_TRUE(writerB->waitResult(1, &result));
+    EXPECT_EQ(SACE_RESULT_STATUS_OK, result.resultStatus);
+
+    excutor.excute(makeMessage(SACE_NORMAL_CMD_CLOSE, 4, label, writerB, pidB));
+    ASSERT_TRUE(writerB->waitResult(2, &result));
+    EXPECT_EQ(SACE_RESULT_STATUS_FAIL, result.resultStatus);
+
+    excutor.uninit();
+}
+
+/* reads the first sub result fd while the batch is forwarded */
+class BatchCheckWriter : public SaceWriter {
+public:
+    string data;
+    int fd;
+
+    BatchCheckWriter ():SaceWriter("BatchCheckWriter", 100), fd(-1) {}
+
+    virtual void sendResult (const SaceResult &result) override {
+        char buf[16];
+        ASSERT_EQ(2u, result.results.size());
+
+        fd = result.results[0].resultFd;
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len > 0)
+            data.assign(buf, len);
+    }
+
+    virtual void sendResponse (const SaceStatusResponse &) override {}
+};
+
+/* the excutor closes its result fd once sendResult returns */
+TEST(SaceBatchWriterTest, KeepsResultFds) {
+    SaceCommand cmd;
+    cmd.type = SACE_TYPE_BATCH;
+    cmd.batch.resize(2);
+    cmd.batch[0].sequence = 1;
+    cmd.batch[1].sequence = 2;
+
+    sp<BatchCheckWriter> client = new BatchCheckWriter();
+    sp<SaceBatchWriter> batch = new SaceBatchWriter(100, client, cmd);
+
+    int first[2], second[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, first));
+
+    SaceResult result;
+    result.sequence = 1;
+    result.resultType = SACE_RESULT_TYPE_FD;
+    result.resultFd = first[0];
+    batch->sendResult(result);
+    close(first[0]);
+
+    /* likely takes the number of the closed fd */
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, second));
+    ASSERT_EQ(1, send(first[1], "x", 1, MSG_NOSIGNAL));
+
+    result.sequence = 2;
+    result.resultFd = second[0];
+    batch->sendResult(result);
+
+    EXPECT_EQ("x", client->data);
+    /* dropped once forwarded */
+    EXPECT_LT(fcntl(client->fd, F_GETFD), 0);
+
+    close(first[1]);
+    close(second[0]);
+    close(second[1]);
+}
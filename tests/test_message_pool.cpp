@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SaceMessage.h"
+
+using namespace android;
+
+#define POOL_MESSAGES 64
+
+/* tells when the block goes back */
+class CountedMessage : public SaceEventMessage {
+    int *mGone;
+public:
+    explicit CountedMessage (int *gone):mGone(gone) {}
+    virtual ~CountedMessage () { (*mGone)++; }
+};
+
+TEST(SaceMessagePoolTest, LastReferenceFrees) {
+    int gone = 0;
+    sp<SaceMessageHeader> msg = new CountedMessage(&gone);
+    sp<SaceMessageHeader> copy = msg;
+
+    msg.clear();
+    EXPECT_EQ(0, gone);
+    copy.clear();
+    EXPECT_EQ(1, gone);
+}
+
+/* the mailbox reference is dropped once popped */
+TEST(SaceMessagePoolTest, MailboxReference) {
+    int gone = 0;
+    SaceMailbox<SaceMessageHeader> mailbox;
+
+    mailbox.push(new CountedMessage(&gone));
+    EXPECT_EQ(0, gone);
+
+    sp<SaceMessageHeader> msg = mailbox.pop();
+    ASSERT_TRUE(msg != nullptr);
+    EXPECT_EQ(0, gone);
+    msg.clear();
+    EXPECT_EQ(1, gone);
+}
+
+/* blocks freed on another thread come back to their pool */
+TEST(SaceMessagePoolTest, ReturnedAcrossThreads) {
+    int gone = 0;
+    vector<sp<SaceMessageHeader>> msgs;
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < POOL_MESSAGES; i++)
+            msgs.push_back(new CountedMessage(&gone));
+
+        thread([&msgs] { msgs.clear(); }).join();
+    }
+    EXPECT_EQ(3 * POOL_MESSAGES, gone);
+}
+
+/* messages outliving the thread which built them orphan its pool */
+TEST(SaceMessagePoolTest, OutliveOwnerThread) {
+    int gone = 0;
+    vector<sp<SaceMessageHeader>> msgs;
+
+    thread([&msgs, &gone] {
+        for (int i = 0; i < POOL_MESSAGES; i++)
+            msgs.push_back(new CountedMessage(&gone));
+        /* one back to the pool before the thread exits */
+        msgs.pop_back();
+    }).join();
+    EXPECT_EQ(1, gone);
+
+    msgs.clear();
+    EXPECT_EQ(POOL_MESSAGES, gone);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sace/SaceRing.h>
+
+using namespace android;
+
+#define RING_SIZE 1024
+
+/* a length-prefixed frame, the payload is a pattern of seed */
+static vector<uint8_t> makeFrame (uint32_t len, uint8_t seed) {
+    vector<uint8_t> frame(len);
+    memcpy(frame.data(), &len, sizeof(len));
+    for (uint32_t i = SACE_FRAME_LEN_SIZE; i < len; i++)
+        frame[i] = (uint8_t)(seed + i);
+    return frame;
+}
+
+class SaceRingTest : public ::testing::Test {
+protected:
+    void *base;
+    SaceRing ring;
+
+    virtual void SetUp () override {
+        base = aligned_alloc(SACE_RING_CACHELINE, SaceRing::regionSize(RING_SIZE));
+        ASSERT_NE(nullptr, base);
+        ring.init(base, RING_SIZE);
+    }
+
+    virtual void TearDown () override {
+        free(base);
+    }
+
+    bool push (const vector<uint8_t> &frame) {
+        return ring.push(frame.data(), frame.size());
+    }
+};
+
+TEST_F(SaceRingTest, Attach) {
+    SaceRing peer;
+    EXPECT_TRUE(peer.attach(base, RING_SIZE));
+    EXPECT_FALSE(peer.attach(base, RING_SIZE * 2));
+
+    vector<uint8_t> frame = makeFrame(32, 1), out;
+    ASSERT_TRUE(push(frame));
+    ASSERT_EQ(SaceStreamBuffer::FRAME_READY, peer.pop(out, SACE_FRAME_LEN_SIZE));
+    EXPECT_EQ(frame, out);
+}
+
+TEST_F(SaceRingTest, Fifo) {
+    vector<uint8_t> out;
+
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(SaceStreamBuffer::FRAME_NONE, ring.pop(out, SACE_FRAME_LEN_SIZE));
+
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(push(makeFrame(16 + i * 8, i)));
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(SaceStreamBuffer::FRAME_READY, ring.pop(out, SACE_FRAME_LEN_SIZE));
+        EXPECT_EQ(makeFrame(16 + i * 8, i), out);
+    }
+
+    EXPECT_TRUE(ring.empty());
+}
+
+/* frame sizes prime to the ring size split frames across the end of the data */
+TEST_F(SaceRingTest, Wraparound) {
+    vector<uint8_t> out;
+
+    for (int i = 0; i < 200; i++) {
+        vector<uint8_t> frame = makeFrame(100 + i % 7, i);
+        ASSERT_TRUE(push(frame));
+        ASSERT_EQ(SaceStreamBuffer::FRAME_READY, ring.pop(out, SACE_FRAME_LEN_SIZE));
+        ASSERT_EQ(frame, out) << "frame " << i;
+    }
+}
+
+TEST_F(SaceRingTest, Full) {
+    vector<uint8_t> frame = makeFrame(100, 0), out;
+    int pushed = 0;
+
+    while (push(frame))
+        pushed++;
+    EXPECT_EQ(RING_SIZE / 100, pushed);
+
+    /* what is left still takes a smaller frame */
+    EXPECT_TRUE(push(makeFrame(RING_SIZE - pushed * 100, 1)));
+    EXPECT_FALSE(push(makeFrame(SACE_FRAME_LEN_SIZE, 2)));
+
+    ASSERT_EQ(SaceStreamBuffer::FRAME_READY, ring.pop(out, SACE_FRAME_LEN_SIZE));
+    EXPECT_TRUE(push(frame));
+}
+
+/* user-004 : a producer facing a full ring is told when room is back */
+TEST_F(SaceRingTest, NeedSpace) {
+    vector<uint8_t> frame = makeFrame(200, 0), out;
+
+    EXPECT_FALSE(ring.needSpace());
+
+    while (push(frame));
+    ASSERT_TRUE(ring.prepareFull(frame.size()));
+
+    ASSERT_EQ(SaceStreamBuffer::FRAME_READY, ring.pop(out, SACE_FRAME_LEN_SIZE));
+    EXPECT_TRUE(ring.needSpace());
+    /* once per prepareFull */
+    EXPECT_FALSE(ring.needSpace());
+    EXPECT_TRUE(push(frame));
+}
+
+TEST_F(SaceRingTest, PrepareFullWithRoom) {
+    vector<uint8_t> frame = makeFrame(200, 0), out;
+
+    while (push(frame));
+    ASSERT_EQ(SaceStreamBuffer::FRAME_READY, ring.pop(out, SACE_FRAME_LEN_SIZE));
+
+    /* the consumer made room before the flag was armed */
+    EXPECT_FALSE(ring.prepareFull(frame.size()));
+    EXPECT_FALSE(ring.needSpace());
+}
+
+TEST_F(SaceRingTest, NeedWakeup) {
+    vector<uint8_t> out;
+
+    EXPECT_FALSE(ring.needWakeup());
+
+    ASSERT_TRUE(ring.prepareWait());
+    ASSERT_TRUE(push(makeFrame(16, 0)));
+    EXPECT_TRUE(ring.needWakeup());
+    EXPECT_FALSE(ring.needWakeup());
+
+    /* frames are pending, the consumer must not sleep */
+    EXPECT_FALSE(ring.prepareWait());
+    EXPECT_FALSE(ring.needWakeup());
+
+    ASSERT_EQ(SaceStreamBuffer::FRAME_READY, ring.pop(out, SACE_FRAME_LEN_SIZE));
+    ASSERT_TRUE(ring.prepareWait());
+    ring.finishWait();
+    ASSERT_TRUE(push(makeFrame(16, 0)));
+    EXPECT_FALSE(ring.needWakeup());
+}
+
+/* lengths come from the peer and are never trusted */
+TEST_F(SaceRingTest, InvalidLength) {
+    vector<uint8_t> out;
+
+    /* longer than what was pushed */
+    vector<uint8_t> frame = makeFrame(64, 0);
+    uint32_t len = 128;
+    memcpy(frame.data(), &len, sizeof(len));
+    ASSERT_TRUE(push(frame));
+    EXPECT_EQ(SaceStreamBuffer::FRAME_INVALID, ring.pop(out, SACE_FRAME_LEN_SIZE));
+
+    /* shorter than the smallest frame */
+    ring.init(base, RING_SIZE);
+    ASSERT_TRUE(push(makeFrame(16, 0)));
+    EXPECT_EQ(SaceStreamBuffer::FRAME_INVALID, ring.pop(out, 32));
+
+    /* a partial length */
+    ring.init(base, RING_SIZE);
+    ASSERT_TRUE(ring.push(frame.data(), 2));
+    EXPECT_EQ(SaceStreamBuffer::FRAME_INVALID, ring.pop(out, SACE_FRAME_LEN_SIZE));
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SaceConfig.h"
+#include "SaceSpawn.h"
+
+using namespace android;
+
+TEST(SaceSpawnTest, SplitPlainWords) {
+    vector<string> argv;
+
+    ASSERT_TRUE(SaceSpawn::splitCommand("ls -l /data", &argv));
+    EXPECT_EQ(vector<string>({"ls", "-l", "/data"}), argv);
+
+    ASSERT_TRUE(SaceSpawn::splitCommand("  \tsetprop\t\tsys.a  1 \t", &argv));
+    EXPECT_EQ(vector<string>({"setprop", "sys.a", "1"}), argv);
+
+    /* '=' past argv[0] is only an argument */
+    ASSERT_TRUE(SaceSpawn::splitCommand("dd if=/dev/zero of=/dev/null count=1", &argv));
+    EXPECT_EQ(4u, argv.size());
+}
+
+/* anything sh would interpret stays with sh */
+TEST(SaceSpawnTest, SplitLeavesShell) {
+    const char *commands[] = {
+        "ls | grep a", "ls && true", "ls; ls", "echo a > /dev/null", "cat < /dev/null",
+        "(ls)", "echo $HOME", "echo `id`", "echo \"a b\"", "echo 'a b'", "ls *", "ls ?",
+        "ls [ab]", "echo {a,b}", "ls ~", "ls # comment", "ls\nid", "echo a\\ b", "sleep 1 &",
+    };
+    vector<string> argv;
+
+    for (const char *command : commands)
+        EXPECT_FALSE(SaceSpawn::splitCommand(command, &argv)) << command;
+
+    /* environment assignment */
+    EXPECT_FALSE(SaceSpawn::splitCommand("LD_LIBRARY_PATH=/tmp ls", &argv));
+    EXPECT_FALSE(SaceSpawn::splitCommand("", &argv));
+    EXPECT_FALSE(SaceSpawn::splitCommand(" \t ", &argv));
+}
+
+class SaceSpawnPathTest : public ::testing::Test {
+protected:
+    string savedPath;
+    bool hadPath;
+
+    virtual void SetUp () override {
+        const char *path = getenv("PATH");
+        hadPath = path != nullptr;
+        savedPath = hadPath? path : "";
+    }
+
+    virtual void TearDown () override {
+        if (hadPath)
+            setenv("PATH", savedPath.c_str(), 1);
+        else
+            unsetenv("PATH");
+    }
+
+    /* first PATH entry holding name */
+    static string which (const string &dirs, const string &name) {
+        for (size_t pos = 0; pos <= dirs.size();) {
+            size_t end = dirs.find(':', pos);
+            if (end == string::npos)
+                end = dirs.size();
+
+            string candidate = dirs.substr(pos, end - pos) + "/" + name;
+            if (end > pos && access(candidate.c_str(), X_OK) == 0)
+                return candidate;
+            pos = end + 1;
+        }
+        return "";
+    }
+};
+
+TEST_F(SaceSpawnPathTest, KeepsSlash) {
+    string path;
+
+    ASSERT_TRUE(SaceSpawn::resolvePath("/no/such/binary", &path));
+    EXPECT_EQ("/no/such/binary", path);
+
+    ASSERT_TRUE(SaceSpawn::resolvePath("./run.sh", &path));
+    EXPECT_EQ("./run.sh", path);
+}
+
+TEST_F(SaceSpawnPathTest, SearchesPath) {
+    string path;
+    string sh = which(savedPath, "sh");
+    if (sh.empty())
+        GTEST_SKIP() << "no sh on PATH";
+
+    /* empty entries are skipped */
+    string dir = sh.substr(0, sh.rfind('/'));
+    setenv("PATH", (string("/no/such/dir::") + dir).c_str(), 1);
+
+    SaceSpawn::forgetPath("sh");
+    ASSERT_TRUE(SaceSpawn::resolvePath("sh", &path));
+    EXPECT_EQ(sh, path);
+
+    EXPECT_FALSE(SaceSpawn::resolvePath("sace_no_such_binary", &path));
+}
+
+/* lookups are cached until the exec of one misses */
+TEST_F(SaceSpawnPathTest, ForgetPath) {
+    string path;
+    string sh = which(savedPath, "sh");
+    if (sh.empty())
+        GTEST_SKIP() << "no sh on PATH";
+
+    setenv("PATH", sh.substr(0, sh.rfind('/')).c_str(), 1);
+    SaceSpawn::forgetPath("sh");
+    ASSERT_TRUE(SaceSpawn::resolvePath("sh", &path));
+
+    setenv("PATH", "/no/such/dir", 1);
+    ASSERT_TRUE(SaceSpawn::resolvePath("sh", &path));
+    EXPECT_EQ(sh, path);
+
+    SaceSpawn::forgetPath("sh");
+    EXPECT_FALSE(SaceSpawn::resolvePath("sh", &path));
+}
+
+/* only children of a thread that left the defaults pay for the reset */
+TEST(SaceSpawnTest, SchedResetPerThread) {
+    bool applied = false;
+
+    thread background([&applied] () {
+        SaceConfig::applyThreadSched(SACE_THREAD_BACKGROUND);
+        applied = SaceConfig::threadSchedApplied();
+    });
+    background.join();
+
+    EXPECT_EQ(!SaceConfig::threadSched(SACE_THREAD_BACKGROUND).empty(), applied);
+    EXPECT_FALSE(SaceConfig::threadSchedApplied());
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <sace/SaceStream.h>
+
+using namespace android;
+
+static vector<uint8_t> makeFrame (uint32_t len, uint8_t seed) {
+    vector<uint8_t> frame(len);
+    memcpy(frame.data(), &len, sizeof(len));
+    for (uint32_t i = SACE_FRAME_LEN_SIZE; i < len; i++)
+        frame[i] = (uint8_t)(seed + i);
+    return frame;
+}
+
+/* what a recv of len bytes does */
+static void feed (SaceStreamBuffer &buffer, const uint8_t *data, size_t len) {
+    uint8_t *dst = buffer.reserve(len);
+    ASSERT_GE(buffer.writable(), len);
+    memcpy(dst, data, len);
+    buffer.commit(len);
+}
+
+static void expectFrame (SaceStreamBuffer &buffer, const vector<uint8_t> &frame) {
+    const uint8_t *data;
+    uint32_t len;
+
+    ASSERT_EQ(SaceStreamBuffer::FRAME_READY, buffer.nextFrame(&data, &len));
+    ASSERT_EQ(frame.size(), len);
+    EXPECT_EQ(0, memcmp(frame.data(), data, len));
+    buffer.consume(len);
+}
+
+TEST(SaceStreamBufferTest, Empty) {
+    SaceStreamBuffer buffer;
+    const uint8_t *data;
+    uint32_t len;
+
+    EXPECT_EQ(0u, buffer.pending());
+    EXPECT_EQ(SaceStreamBuffer::FRAME_NONE, buffer.nextFrame(&data, &len));
+}
+
+/* a frame split across reads, down to a byte each */
+TEST(SaceStreamBufferTest, Fragmented) {
+    SaceStreamBuffer buffer;
+    vector<uint8_t> frame = makeFrame(40, 3);
+    const uint8_t *data;
+    uint32_t len;
+
+    for (size_t i = 0; i + 1 < frame.size(); i++) {
+        feed(buffer, &frame[i], 1);
+        ASSERT_EQ(SaceStreamBuffer::FRAME_NONE, buffer.nextFrame(&data, &len)) << "byte " << i;
+    }
+
+    feed(buffer, &frame.back(), 1);
+    expectFrame(buffer, frame);
+    EXPECT_EQ(0u, buffer.pending());
+}
+
+/* several frames and the head of the next in one read */
+TEST(SaceStreamBufferTest, Coalesced) {
+    SaceStreamBuffer buffer;
+    vector<uint8_t> frames[3] = {makeFrame(24, 0), makeFrame(60, 1), makeFrame(8, 2)};
+    vector<uint8_t> next = makeFrame(30, 3);
+    vector<uint8_t> stream;
+    const uint8_t *data;
+    uint32_t len;
+
+    for (auto &frame : frames)
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    stream.insert(stream.end(), next.begin(), next.begin() + 10);
+    feed(buffer, stream.data(), stream.size());
+
+    for (auto &frame : frames)
+        expectFrame(buffer, frame);
+    EXPECT_EQ(SaceStreamBuffer::FRAME_NONE, buffer.nextFrame(&data, &len));
+    EXPECT_EQ(10u, buffer.pending());
+
+    feed(buffer, next.data() + 10, next.size() - 10);
+    expectFrame(buffer, next);
+}
+
+/* the partial frame is moved to the front when the buffer grows */
+TEST(SaceStreamBufferTest, ReserveKeepsPartialFrame) {
+    SaceStreamBuffer buffer;
+    vector<uint8_t> first = makeFrame(SACE_STREAM_READ_SIZE - 100, 0);
+    vector<uint8_t> second = makeFrame(3 * SACE_STREAM_READ_SIZE, 1);
+
+    feed(buffer, first.data(), first.size());
+    feed(buffer, second.data(), 50);
+    expectFrame(buffer, first);
+
+    feed(buffer, second.data() + 50, second.size() - 50);
+    expectFrame(buffer, second);
+    EXPECT_EQ(0u, buffer.pending());
+}
+
+TEST(SaceStreamBufferTest, MaxFrame) {
+    SaceStreamBuffer buffer;
+    vector<uint8_t> frame = makeFrame(SACE_MAX_FRAME_SIZE, 0);
+
+    for (size_t off = 0; off < frame.size(); off += SACE_STREAM_READ_SIZE)
+        feed(buffer, frame.data() + off, min((size_t)SACE_STREAM_READ_SIZE, frame.size() - off));
+
+    expectFrame(buffer, frame);
+}
+
+TEST(SaceStreamBufferTest, InvalidLength) {
+    const uint8_t *data;
+    uint32_t len;
+
+    SaceStreamBuffer small(16);
+    vector<uint8_t> frame = makeFrame(8, 0);
+    feed(small, frame.data(), frame.size());
+    EXPECT_EQ(SaceStreamBuffer::FRAME_INVALID, small.nextFrame(&data, &len));
+
+    /* refused on the length alone, before the body is buffered */
+    SaceStreamBuffer large;
+    uint32_t huge = SACE_MAX_FRAME_SIZE + 1;
+    feed(large, (const uint8_t*)&huge, sizeof(huge));
+    EXPECT_EQ(SaceStreamBuffer::FRAME_INVALID, large.nextFrame(&data, &len));
+
+    large.clear();
+    EXPECT_EQ(0u, large.pending());
+    EXPECT_EQ(SaceStreamBuffer::FRAME_NONE, large.nextFrame(&data, &len));
+}
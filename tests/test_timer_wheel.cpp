@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SaceStats.h"
+#include "SaceTimerWheel.h"
+
+using namespace android;
+
+class SaceTimerWheelTest : public ::testing::Test {
+protected:
+    SaceTimerWheel wheel;
+
+    mutex lock;
+    vector<pair<int, nsecs_t>> fired;
+    nsecs_t origin;
+
+    virtual void SetUp () override {
+        ASSERT_TRUE(wheel.start());
+        origin = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
+    virtual void TearDown () override {
+        wheel.stop();
+    }
+
+    SaceTimerWheel::TimerId after (int index, int delay_ms) {
+        return wheel.schedule(milliseconds_to_nanoseconds(delay_ms), [this, index] () {
+            lock_guard<mutex> _l(lock);
+            fired.push_back(make_pair(index, systemTime(SYSTEM_TIME_MONOTONIC) - origin));
+        });
+    }
+
+    size_t firedCount () {
+        lock_guard<mutex> _l(lock);
+        return fired.size();
+    }
+
+    bool waitFired (size_t count, int timeout_ms) {
+        for (int i = 0; i < timeout_ms / 10; i++) {
+            if (firedCount() >= count)
+                return true;
+            usleep(10 * 1000);
+        }
+        return firedCount() >= count;
+    }
+};
+
+TEST_F(SaceTimerWheelTest, NotStarted) {
+    SaceTimerWheel idle;
+    EXPECT_EQ(0u, idle.schedule(milliseconds_to_nanoseconds(10), [] () {}));
+    EXPECT_FALSE(idle.cancel(0));
+}
+
+/* level 0 holds 64 ticks (640ms), later ones are cascaded down before they fire */
+TEST_F(SaceTimerWheelTest, CascadeKeepsOrder) {
+    const int delays[] = {1300, 30, 700, 650, 100, 2000};
+    const int count = sizeof(delays) / sizeof(delays[0]);
+
+    for (int i = 0; i < count; i++)
+        ASSERT_NE(0u, after(i, delays[i]));
+
+    ASSERT_TRUE(waitFired(count, 4000));
+
+    lock_guard<mutex> _l(lock);
+    for (int i = 0; i < count; i++) {
+        int index = fired[i].first;
+        /* rounded up to the tick, never early */
+        EXPECT_GE(fired[i].second, milliseconds_to_nanoseconds(delays[index])) << "timer " << index;
+        EXPECT_LT(fired[i].second, milliseconds_to_nanoseconds(delays[index] + 500)) << "timer " << index;
+
+        if (i > 0) {
+            EXPECT_LT(delays[fired[i - 1].first], delays[index]);
+        }
+    }
+}
+
+/* armed for the expiry itself, not for every cascade on the way */
+TEST_F(SaceTimerWheelTest, FarTimerDoesNotWake) {
+    uint64_t before = SaceStats::wakeups(SACE_WAKEUP_TIMER);
+    after(0, 2500);
+
+    usleep(2000 * 1000);
+    EXPECT_EQ(before, SaceStats::wakeups(SACE_WAKEUP_TIMER));
+    EXPECT_EQ(0u, firedCount());
+
+    ASSERT_TRUE(waitFired(1, 1500));
+
+    lock_guard<mutex> _l(lock);
+    EXPECT_GE(fired[0].second, milliseconds_to_nanoseconds(2500));
+}
+
+TEST_F(SaceTimerWheelTest, CancelBeforeFire) {
+    SaceTimerWheel::TimerId near = after(0, 50);
+    SaceTimerWheel::TimerId far  = after(1, 800);
+    after(2, 100);
+
+    EXPECT_TRUE(wheel.cancel(near));
+    EXPECT_TRUE(wheel.cancel(far));
+    EXPECT_FALSE(wheel.cancel(far));
+
+    ASSERT_TRUE(waitFired(1, 1000));
+    usleep(1000 * 1000);
+
+    lock_guard<mutex> _l(lock);
+    ASSERT_EQ(1u, fired.size());
+    EXPECT_EQ(2, fired[0].first);
+}
+
+/* cancel returns once the running callback is done, and it never runs again */
+TEST_F(SaceTimerWheelTest, CancelWhileFiring) {
+    atomic<bool> running(false);
+    atomic<int> runs(0);
+
+    SaceTimerWheel::TimerId id = wheel.schedulePeriodic(milliseconds_to_nanoseconds(20), [&] () {
+        running = true;
+        usleep(200 * 1000);
+        runs++;
+        running = false;
+    });
+    ASSERT_NE(0u, id);
+
+    for (int i = 0; i < 100 && !running; i++)
+        usleep(10 * 1000);
+    ASSERT_TRUE(running);
+
+    EXPECT_TRUE(wheel.cancel(id));
+    EXPECT_FALSE(running);
+
+    int done = runs;
+    usleep(300 * 1000);
+    EXPECT_EQ(done, runs.load());
+}
+
+TEST_F(SaceTimerWheelTest, CancelFromCallback) {
+    atomic<int> runs(0);
+    atomic<SaceTimerWheel::TimerId> id(0);
+    atomic<bool> cancelled(false);
+
+    id = wheel.schedulePeriodic(milliseconds_to_nanoseconds(20), [&] () {
+        runs++;
+        /* must not wait for itself */
+        cancelled = wheel.cancel(id);
+    });
+    ASSERT_NE(0u, id.load());
+
+    for (int i = 0; i < 100 && runs == 0; i++)
+        usleep(10 * 1000);
+    usleep(200 * 1000);
+
+    EXPECT_TRUE(cancelled);
+    EXPECT_EQ(1, runs.load());
+}
+
+TEST_F(SaceTimerWheelTest, StopClearsTimers) {
+    after(0, 100);
+    wheel.stop();
+    usleep(200 * 1000);
+    EXPECT_EQ(0u, firedCount());
+
+    ASSERT_TRUE(wheel.start());
+    origin = systemTime(SYSTEM_TIME_MONOTONIC);
+    after(1, 20);
+    ASSERT_TRUE(waitFired(1, 1000));
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SaceWorkerPool.h"
+
+using namespace android;
+
+#define STRANDS   8
+#define PRODUCERS 4
+#define MESSAGES  2000
+
+class TestMessage : public SaceEventMessage {
+public:
+    int strand;
+    int seq;
+
+    TestMessage (int strand, int seq, enum SaceMessagePriority priority = SACE_MESSAGE_PRIORITY_NORMAL) {
+        this->strand = strand;
+        this->seq    = seq;
+        msgPriority  = priority;
+        msgEvent     = SACE_EVENT_TYPE_UNKOWN;
+    }
+};
+
+class TestHandler : public SaceStrandHandler {
+public:
+    function<void(TestMessage*)> handle;
+
+    virtual void handleStrandMessage (const sp<SaceMessageHeader> &msg) override {
+        handle(static_cast<TestMessage*>(msg.get()));
+    }
+};
+
+class SaceWorkerPoolTest : public ::testing::Test {
+protected:
+    SaceWorkerPool pool;
+    SaceStrand strands[STRANDS];
+    TestHandler handler;
+    atomic<int> handled;
+
+    virtual void SetUp () override {
+        handled = 0;
+        for (int i = 0; i < STRANDS; i++)
+            strands[i].attach(&pool, &handler);
+    }
+
+    virtual void TearDown () override {
+        pool.stop();
+    }
+
+    void post (int strand, int seq, enum SaceMessagePriority priority = SACE_MESSAGE_PRIORITY_NORMAL) {
+        strands[strand].post(new TestMessage(strand, seq, priority));
+    }
+
+    bool waitIdle (int timeout_ms) {
+        for (int i = 0; i < timeout_ms / 10; i++) {
+            bool idle = true;
+            for (int j = 0; j < STRANDS; j++)
+                idle = idle && strands[j].idle();
+            if (idle)
+                return true;
+            usleep(10 * 1000);
+        }
+        return false;
+    }
+};
+
+/* one producer per strand, whatever worker runs it its messages keep their order */
+TEST_F(SaceWorkerPoolTest, OrderPerStrand) {
+    vector<int> seen[STRANDS];
+
+    handler.handle = [&] (TestMessage *msg) {
+        seen[msg->strand].push_back(msg->seq);
+        handled++;
+    };
+    ASSERT_TRUE(pool.start(4));
+
+    vector<thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(thread([this, p] () {
+            for (int seq = 0; seq < MESSAGES; seq++) {
+                for (int s = p; s < STRANDS; s += PRODUCERS)
+                    post(s, seq);
+            }
+        }));
+    }
+    for (auto &producer : producers)
+        producer.join();
+
+    ASSERT_TRUE(waitIdle(10000));
+    EXPECT_EQ(STRANDS * MESSAGES, handled.load());
+
+    for (int s = 0; s < STRANDS; s++) {
+        ASSERT_EQ((size_t)MESSAGES, seen[s].size()) << "strand " << s;
+        for (int seq = 0; seq < MESSAGES; seq++)
+            ASSERT_EQ(seq, seen[s][seq]) << "strand " << s;
+    }
+}
+
+/* many producers on one strand, never two of its messages at once */
+TEST_F(SaceWorkerPoolTest, SerialWithinStrand) {
+    atomic<int> active(0);
+    atomic<int> overlaps(0);
+
+    handler.handle = [&] (TestMessage *msg __unused) {
+        if (active.fetch_add(1) != 0)
+            overlaps++;
+        sched_yield();
+        active--;
+        handled++;
+    };
+    ASSERT_TRUE(pool.start(4));
+
+    vector<thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(thread([this] () {
+            for (int seq = 0; seq < MESSAGES; seq++)
+                post(0, seq);
+        }));
+    }
+    for (auto &producer : producers)
+        producer.join();
+
+    ASSERT_TRUE(waitIdle(10000));
+    EXPECT_EQ(PRODUCERS * MESSAGES, handled.load());
+    EXPECT_EQ(0, overlaps.load());
+}
+
+/* a blocked strand doesn't hold the others back */
+TEST_F(SaceWorkerPoolTest, StrandsRunInParallel) {
+    atomic<int> arrived(0);
+    atomic<int> met(0);
+
+    handler.handle = [&] (TestMessage *msg __unused) {
+        arrived++;
+        for (int i = 0; i < 200 && arrived.load() < 2; i++)
+            usleep(10 * 1000);
+        if (arrived.load() == 2)
+            met++;
+    };
+    ASSERT_TRUE(pool.start(2));
+
+    post(0, 0);
+    post(1, 0);
+
+    ASSERT_TRUE(waitIdle(5000));
+    EXPECT_EQ(2, met.load());
+}
+
+/* control messages overtake the normal ones still queued on the strand */
+TEST_F(SaceWorkerPoolTest, ControlLaneFirst) {
+    mutex lock;
+    vector<int> order;
+    atomic<bool> gate(false);
+    atomic<bool> blocked(false);
+
+    handler.handle = [&] (TestMessage *msg) {
+        if (msg->seq == 0) {
+            blocked = true;
+            while (!gate)
+                usleep(1000);
+        }
+
+        lock_guard<mutex> _l(lock);
+        order.push_back(msg->seq);
+    };
+    ASSERT_TRUE(pool.start(1));
+
+    post(0, 0);
+    while (!blocked)
+        usleep(1000);
+
+    post(0, 1);
+    post(0, 2);
+    post(0, 3, SACE_MESSAGE_PRIORITY_CONTROL);
+    gate = true;
+
+    ASSERT_TRUE(waitIdle(5000));
+    EXPECT_EQ(vector<int>({0, 3, 1, 2}), order);
+}
+
+/* waitIdle returns once the strand drained, without polling */
+TEST_F(SaceWorkerPoolTest, WaitIdle) {
+    handler.handle = [&] (TestMessage *msg __unused) {
+        usleep(1000);
+        handled++;
+    };
+    ASSERT_TRUE(pool.start(2));
+
+    for (int seq = 0; seq < 100; seq++)
+        post(0, seq);
+
+    strands[0].waitIdle();
+    EXPECT_TRUE(strands[0].idle());
+    EXPECT_EQ(100, handled.load());
+
+    /* already idle */
+    strands[0].waitIdle();
+}